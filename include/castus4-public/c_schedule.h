@@ -1,3 +1,7 @@
+#ifndef Castus4publicCSchedule_h
+#define Castus4publicCSchedule_h
+
+#include <stddef.h>
 
 #include <castus4-public/schedule_object.h>
 #include <castus4-public/schedule.h>
@@ -12,6 +16,10 @@
 * Ruby has been done
 **/
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /**
 * Converts the schedule time to a string
 *
@@ -57,7 +65,7 @@ bool schedule_load(Castus4publicSchedule* self, const char* path);
 * Returns the string representation of the schedule type
 *
 * \param self Pointer to the schedule
-* \return The schedule string
+* \return The schedule string. It is static, do not free it.
 *
 * There are 5 types of schedules.   They are Yearly, Monthly, Weekly, Daily and Interval
 **/
@@ -81,18 +89,23 @@ int schedule_globals_count(Castus4publicSchedule* self);
 /**
 * \param self Pointer to the schedule
 * \param pos The position of the key
-* \return The key at pos
+* \return The key at pos, or NULL if pos is out of range
 *
-* \sa schedule_globals_count
+* The string is owned by the schedule, do not free it. Walking pos upward
+* from 0 is O(1) per call.
+*
+* \sa schedule_globals_count, schedule_globals_begin
 **/
 const char *schedule_global_item_key(Castus4publicSchedule* self, unsigned int pos);
 
 /**
 * \param self Pointer to the schedule
 * \param pos The position of the keys value
-* \return The keys value at pos
+* \return The keys value at pos, or NULL if pos is out of range
+*
+* The string is owned by the schedule, do not free it.
 *
-* \sa schedule_globals_count
+* \sa schedule_globals_count, schedule_globals_begin
 **/
 const char *schedule_global_item_value(Castus4publicSchedule* self, unsigned int pos);
 
@@ -108,10 +121,46 @@ int schedule_item_count(Castus4publicSchedule* self);
 /**
 * \param self Pointer to the schedule
 * \param pos The position of the schedule item to return
-* \return The schedule item at the position
+* \return The schedule item at the position, or NULL if pos is out of range
+*
+* Walking pos upward from 0 is O(1) per call.
+*
+* \sa schedule_items_begin
 **/
 Castus4publicSchedule::ScheduleItem *schedule_item(Castus4publicSchedule* self, int pos);
 
+/**
+* One schedule item as filled in by schedule_export_items()
+*
+* start and end are in microseconds from the start of the schedule, or -1
+* if the item has no valid time. item points at the NUL terminated "item"
+* value of length item_length, or is NULL when the item has none.
+**/
+struct schedule_item_export {
+    long long start;
+    long long end;
+    Castus4publicSchedule::ScheduleItem *handle;
+    const char *item;
+    size_t item_length;
+};
+
+/**
+* \param self Pointer to the schedule
+* \param first Position of the first item to export
+* \param out Caller-provided array of at least max entries
+* \param max Number of entries in out
+* \return The number of entries filled in
+*
+* Exports the start/end time and item of up to max schedule items in one call,
+* parsing each time only once. Use this instead of calling schedule_item() and
+* item_start_time() per position, which is quadratic on large schedules.
+*
+* The strings and handles point into memory owned by the schedule. They stay
+* valid until the item is modified or removed, or the schedule is reloaded or
+* freed. Do not free them.
+**/
+int schedule_export_items(Castus4publicSchedule* self, int first, struct schedule_item_export *out, int max);
+
 /**
 * \param self The pointer to the schedule
 * \return Number of blocks.
@@ -125,14 +174,39 @@ int schedule_block_count(Castus4publicSchedule* self);
 * \param self Pointer to the schedule
 * \param pos The position of the block
 *
-* \return The block at pos
-* \sa schedule_block_count()
+* \return The block at pos, or NULL if pos is out of range
+* \sa schedule_block_count(), schedule_blocks_begin
 **/
 Castus4publicSchedule::ScheduleBlock *schedule_block(Castus4publicSchedule* self, int pos);
 
+/**
+* One schedule block as filled in by schedule_export_blocks()
+*
+* Same layout and lifetime rules as struct schedule_item_export, with name
+* pointing at the block's "block" value.
+**/
+struct schedule_block_export {
+    long long start;
+    long long end;
+    Castus4publicSchedule::ScheduleBlock *handle;
+    const char *name;
+    size_t name_length;
+};
+
+/**
+* \param self Pointer to the schedule
+* \param first Position of the first block to export
+* \param out Caller-provided array of at least max entries
+* \param max Number of entries in out
+* \return The number of entries filled in
+*
+* \sa schedule_export_items
+**/
+int schedule_export_blocks(Castus4publicSchedule* self, int first, struct schedule_block_export *out, int max);
+
 /**
 * \param self Pointer to the block
-* \return Name of the block
+* \return Name of the block, or NULL if it has none. Owned by the block.
 **/
 const char *block_name( Castus4publicSchedule::ScheduleBlock *self );
 
@@ -158,10 +232,22 @@ int block_entry_count( Castus4publicSchedule::ScheduleBlock *self );
 /**
 * \param self Pointer to the block
 * \param pos The position for the block entry
-* \return The block entries key
+* \return The block entries key, owned by the block
+*
+* Like item_entry_key(), walking positions in order is O(1) per call.
+*
+* \sa block_entries_begin
 **/
 const char *block_entry_key(Castus4publicSchedule::ScheduleBlock* self, int pos);
 
+/**
+* \param self Pointer to the block
+* \param pos The position for the block entry
+* \return The block entries value, owned by the block
+* \sa block_entries_begin
+**/
+const char *block_entry_value(Castus4publicSchedule::ScheduleBlock* self, int pos);
+
 /**
 * \param self Pointer to the schedule item
 * \return The relative time the schedule item starts at
@@ -185,17 +271,397 @@ int item_entry_count( Castus4publicSchedule::ScheduleItem *self );
 /**
 * \param self Pointer to the schedule item
 * \param pos The position of the entry
-* \return The entry key at pos
+* \return The entry key at pos, owned by the item
+*
+* The position reached is remembered (per thread), so walking one item's
+* entries 0, 1, 2... is O(1) per call.
+*
+* \sa item_entries_begin
 **/
 const char *item_entry_key(Castus4publicSchedule::ScheduleItem* self, int pos);
 
 /**
 * \param self Pointer to the schedule item
 * \param pos The position of the entry
-* \return The entry key's value at pos
+* \return The entry key's value at pos, owned by the item
+* \sa item_entries_begin
 **/
 const char *item_entry_value(Castus4publicSchedule::ScheduleItem* self, int pos);
 
+// Cursors
+
+/**
+* Opaque cursors for walking a schedule without restarting from the
+* beginning on every call.
+*
+* A cursor is created by one of the *_begin() functions, advanced with
+* *_next() and released with *_free(). Every step is O(1). Strings returned
+* through a cursor are borrowed from the schedule and stay valid until that
+* entry is modified or removed, or the schedule is reloaded or freed.
+*
+* A cursor becomes invalid if the container it walks is modified other than
+* through the cursor itself.
+**/
+typedef struct schedule_entry_cursor schedule_entry_cursor;
+typedef struct schedule_item_cursor schedule_item_cursor;
+typedef struct schedule_block_cursor schedule_block_cursor;
+
+/**
+* \param self Pointer to the schedule
+* \return A cursor at the first global name = value pair
+**/
+schedule_entry_cursor *schedule_globals_begin(Castus4publicSchedule* self);
+
+/**
+* \param self Pointer to the schedule item
+* \return A cursor at the first entry of the item
+**/
+schedule_entry_cursor *item_entries_begin(Castus4publicSchedule::ScheduleItem* self);
+
+/**
+* \param self Pointer to the block
+* \return A cursor at the first entry of the block
+**/
+schedule_entry_cursor *block_entries_begin(Castus4publicSchedule::ScheduleBlock* self);
+
+/**
+* \param c The cursor
+* \return true if the cursor points at an entry, false once past the end
+**/
+bool entry_cursor_valid(schedule_entry_cursor* c);
+
+/**
+* Moves the cursor to the next entry
+*
+* \param c The cursor
+* \return true if the cursor still points at an entry
+**/
+bool entry_cursor_next(schedule_entry_cursor* c);
+
+/**
+* \param c The cursor
+* \param length If not NULL, receives the length of the key
+* \return The key at the cursor, or NULL past the end
+**/
+const char *entry_cursor_key(schedule_entry_cursor* c, size_t *length);
+
+/**
+* \param c The cursor
+* \param length If not NULL, receives the length of the value
+* \return The value at the cursor, or NULL past the end
+**/
+const char *entry_cursor_value(schedule_entry_cursor* c, size_t *length);
+
+/**
+* \param c The cursor to release
+**/
+void entry_cursor_free(schedule_entry_cursor* c);
+
+/**
+* \param self Pointer to the schedule
+* \return A cursor at the first schedule item
+**/
+schedule_item_cursor *schedule_items_begin(Castus4publicSchedule* self);
+
+/**
+* \param c The cursor
+* \return true if the cursor points at an item
+**/
+bool item_cursor_valid(schedule_item_cursor* c);
+
+/**
+* Moves the cursor to the next item
+*
+* \param c The cursor
+* \return true if the cursor still points at an item
+**/
+bool item_cursor_next(schedule_item_cursor* c);
+
+/**
+* \param c The cursor
+* \return The item at the cursor, or NULL past the end
+**/
+Castus4publicSchedule::ScheduleItem *item_cursor_item(schedule_item_cursor* c);
+
+/**
+* \param c The cursor to release
+**/
+void item_cursor_free(schedule_item_cursor* c);
+
+/**
+* \param self Pointer to the schedule
+* \return A cursor at the first schedule block
+**/
+schedule_block_cursor *schedule_blocks_begin(Castus4publicSchedule* self);
+
+/**
+* \param c The cursor
+* \return true if the cursor points at a block
+**/
+bool block_cursor_valid(schedule_block_cursor* c);
+
+/**
+* Moves the cursor to the next block
+*
+* \param c The cursor
+* \return true if the cursor still points at a block
+**/
+bool block_cursor_next(schedule_block_cursor* c);
+
+/**
+* \param c The cursor
+* \return The block at the cursor, or NULL past the end
+**/
+Castus4publicSchedule::ScheduleBlock *block_cursor_block(schedule_block_cursor* c);
+
+/**
+* \param c The cursor to release
+**/
+void block_cursor_free(schedule_block_cursor* c);
+
+// Editing
+
+/**
+* Clears the schedule and starts an empty one of the given type
+*
+* \param self Pointer to the schedule
+* \param type One of the C4_SCHED_TYPE_* values from schedule.h
+* \return true if successful
+**/
+bool schedule_init(Castus4publicSchedule* self, int type);
+
+/**
+* \param self Pointer to the schedule
+* \param key Name of the global value
+* \param value The value. Multi-line values are separated by newlines.
+**/
+void schedule_set_global(Castus4publicSchedule* self, const char *key, const char *value);
+
+/**
+* \param self Pointer to the schedule
+* \param key Name of the global value to remove
+**/
+void schedule_delete_global(Castus4publicSchedule* self, const char *key);
 
+/**
+* Inserts a new empty item
+*
+* \param self Pointer to the schedule
+* \param pos Position to insert at. Negative or past the end appends. A
+* schedule kept in start time order places the item by its start time instead.
+* \return The new item, owned by the schedule
+**/
+Castus4publicSchedule::ScheduleItem *schedule_add_item(Castus4publicSchedule* self, int pos);
+
+/**
+* Inserts a copy of an existing item
+*
+* \param self Pointer to the schedule
+* \param src The item to copy. It may belong to another schedule.
+* \param pos Position to insert at. Negative or past the end appends. A
+* schedule kept in start time order places the item by its start time instead.
+* \return The new item, owned by the schedule
+**/
+Castus4publicSchedule::ScheduleItem *schedule_copy_item(Castus4publicSchedule* self, const Castus4publicSchedule::ScheduleItem *src, int pos);
+
+/**
+* Removes count items starting at first
+*
+* \param self Pointer to the schedule
+* \param first Position of the first item to remove
+* \param count Number of items to remove
+* \return The number of items removed
+**/
+int schedule_erase_items(Castus4publicSchedule* self, int first, int count);
+
+/**
+* Inserts a new empty block
+*
+* \param self Pointer to the schedule
+* \param pos Position to insert at. Negative or past the end appends.
+* \return The new block, owned by the schedule
+**/
+Castus4publicSchedule::ScheduleBlock *schedule_add_block(Castus4publicSchedule* self, int pos);
+
+/**
+* Removes count blocks starting at first
+*
+* \param self Pointer to the schedule
+* \param first Position of the first block to remove
+* \param count Number of blocks to remove
+* \return The number of blocks removed
+**/
+int schedule_erase_blocks(Castus4publicSchedule* self, int first, int count);
+
+/**
+* Sets an item's value through the schedule. "start" and "end" move the
+* item as retiming it would, so this is the call to use on a schedule kept
+* in start time order (set_ordered_items()) or inside begin_edit()/commit().
+*
+* \param self Pointer to the schedule
+* \param item An item of this schedule
+* \param key The entry name
+* \param value The entry value, or NULL to remove it
+* \return false if item is not in the schedule or a time was rejected
+**/
+bool schedule_set_item_value(Castus4publicSchedule* self, Castus4publicSchedule::ScheduleItem* item, const char *key, const char *value);
+
+/**
+* Sets an item's start time through the schedule, keeping its end and the
+* schedule's ordering (see schedule_set_item_value())
+*
+* \param self Pointer to the schedule
+* \param item An item of this schedule
+* \param t Start time in microseconds from the start of the schedule
+* \return false if item is not in the schedule or the time was rejected
+**/
+bool schedule_set_item_start_time_us(Castus4publicSchedule* self, Castus4publicSchedule::ScheduleItem* item, long long t);
+
+/**
+* Sets an item's stop time through the schedule (see schedule_set_item_value())
+*
+* \param self Pointer to the schedule
+* \param item An item of this schedule
+* \param t Stop time in microseconds from the start of the schedule
+* \return false if item is not in the schedule or the time was rejected
+**/
+bool schedule_set_item_stop_time_us(Castus4publicSchedule* self, Castus4publicSchedule::ScheduleItem* item, long long t);
+
+/**
+* Sorts the items and blocks by start time
+*
+* \param self Pointer to the schedule
+**/
+void schedule_sort(Castus4publicSchedule* self);
+
+/**
+* \param self Pointer to the schedule item
+* \param key The entry name
+* \return The entry value, or NULL if not set. Owned by the item.
+**/
+const char *item_get_value(Castus4publicSchedule::ScheduleItem* self, const char *key);
+
+/**
+* Changes the item alone: the schedule does not see it. Setting "start" or
+* "end" this way on a schedule kept in start time order, or inside
+* begin_edit()/commit(), loses the ordering; use schedule_set_item_value().
+*
+* \param self Pointer to the schedule item
+* \param key The entry name
+* \param value The entry value
+**/
+void item_set_value(Castus4publicSchedule::ScheduleItem* self, const char *key, const char *value);
+
+/**
+* \param self Pointer to the schedule item
+* \param key The entry name to remove
+**/
+void item_delete_value(Castus4publicSchedule::ScheduleItem* self, const char *key);
+
+/**
+* \param self Pointer to the schedule item
+* \return The start time in microseconds, or -1 if it has none
+**/
+long long item_start_time_us(Castus4publicSchedule::ScheduleItem* self);
+
+/**
+* \param self Pointer to the schedule item
+* \return The stop time in microseconds, or -1 if it has none
+**/
+long long item_stop_time_us(Castus4publicSchedule::ScheduleItem* self);
+
+/**
+* Changes the item alone, see item_set_value(). Use
+* schedule_set_item_start_time_us() on an ordered schedule or in a batch.
+*
+* \param self Pointer to the schedule item
+* \param t Start time in microseconds from the start of the schedule
+**/
+void item_set_start_time_us(Castus4publicSchedule::ScheduleItem* self, long long t);
+
+/**
+* Changes the item alone, see item_set_value(). Use
+* schedule_set_item_stop_time_us() on an ordered schedule or in a batch.
+*
+* \param self Pointer to the schedule item
+* \param t Stop time in microseconds from the start of the schedule
+**/
+void item_set_stop_time_us(Castus4publicSchedule::ScheduleItem* self, long long t);
+
+/**
+* \param self Pointer to the block
+* \param key The entry name
+* \return The entry value, or NULL if not set. Owned by the block.
+**/
+const char *block_get_value(Castus4publicSchedule::ScheduleBlock* self, const char *key);
+
+/**
+* \param self Pointer to the block
+* \param key The entry name
+* \param value The entry value
+**/
+void block_set_value(Castus4publicSchedule::ScheduleBlock* self, const char *key, const char *value);
+
+/**
+* \param self Pointer to the block
+* \param key The entry name to remove
+**/
+void block_delete_value(Castus4publicSchedule::ScheduleBlock* self, const char *key);
+
+/**
+* \param self Pointer to the block
+* \return The start time in microseconds, or -1 if it has none
+**/
+long long block_start_time_us(Castus4publicSchedule::ScheduleBlock* self);
+
+/**
+* \param self Pointer to the block
+* \return The stop time in microseconds, or -1 if it has none
+**/
+long long block_stop_time_us(Castus4publicSchedule::ScheduleBlock* self);
+
+/**
+* \param self Pointer to the block
+* \param t Start time in microseconds from the start of the schedule
+**/
+void block_set_start_time_us(Castus4publicSchedule::ScheduleBlock* self, long long t);
+
+/**
+* \param self Pointer to the block
+* \param t Stop time in microseconds from the start of the schedule
+**/
+void block_set_stop_time_us(Castus4publicSchedule::ScheduleBlock* self, long long t);
+
+// Serializing
+
+/**
+* Writes the schedule text into a caller buffer
+*
+* \param self Pointer to the schedule
+* \param buf The buffer. May be NULL if size is 0.
+* \param size Size of buf in bytes
+* \param length If not NULL, receives the length of the full text without the NUL
+* \return true if the whole text (and NUL) fit in buf
+*
+* Like snprintf, a too small buffer receives as much as fits, NUL terminated,
+* and length tells how much to allocate for a second call.
+**/
+bool schedule_write_to_buffer(Castus4publicSchedule* self, char *buf, size_t size, size_t *length);
+
+/**
+* Writes the schedule text into a buffer owned by the schedule
+*
+* \param self Pointer to the schedule, from schedule_alloc()
+* \param length If not NULL, receives the length of the text without the NUL
+* \return The NUL terminated text, or NULL on error
+*
+* The buffer is reused (and grown as needed) by the next call, and is freed
+* with the schedule. Do not free it.
+**/
+const char *schedule_write_out(Castus4publicSchedule* self, size_t *length);
 
+#ifdef __cplusplus
+}
+#endif
 
+#endif // Castus4publicCSchedule_h
@@ -0,0 +1,36 @@
+#ifndef Castus4publicDurationIndex_h
+#define Castus4publicDurationIndex_h
+
+#include <string>
+#include <vector>
+
+/* Media files sorted by duration, for "everything between a and b long" queries in
+ * O(log n + k), which is what filling breaks and gaps comes down to. Adding and removing keep
+ * the order (O(n) each); build() sorts a batch added with add_unsorted() in one go. */
+class castus4public_duration_index {
+public:
+	class entry {
+	public:
+		unsigned long long		duration_us;
+		std::string			path;
+	public:
+		bool operator<(const entry &a) const;
+	};
+public:
+	castus4public_duration_index();
+	~castus4public_duration_index();
+public:
+	void clear();
+	void add(const std::string &path,const unsigned long long duration_us);
+	void add_unsorted(const std::string &path,const unsigned long long duration_us);
+	void build();
+	bool remove(const std::string &path,const unsigned long long duration_us);
+	// entries with min_us <= duration <= max_us, shortest first. Returns how many.
+	size_t range(const unsigned long long min_us,const unsigned long long max_us,std::vector<const entry*> &out) const;
+	// the longest entry no longer than max_us, NULL if none
+	const entry *longest_within(const unsigned long long max_us) const;
+public:
+	std::vector<entry>			entries;
+};
+
+#endif // Castus4publicDurationIndex_h
@@ -0,0 +1,71 @@
+#ifndef Castus4publicMediaCatalog_h
+#define Castus4publicMediaCatalog_h
+
+#include <castus4-public/metadata.h>
+#include <castus4-public/duration_index.h>
+
+#include <string>
+#include <unordered_map>
+#include <map>
+
+/* Metadata of every media file in a set of directories, kept in memory and kept current by
+ * inotify watches on the directories and their .castusmeta.* directories. Lookups are a hash
+ * lookup with no filesystem access.
+ *
+ * Nothing happens behind the caller's back: poll fd() for readability (or just call
+ * process_events() now and then), and process_events() applies what changed and calls the change
+ * callback for each media file added, changed or removed. A media file is in the catalog while
+ * both it and its metadata file exist.
+ *
+ * Without inotify support, add_directory() still loads the catalog, but it does not follow
+ * changes. The same goes for a directory whose watch could not be added (out of watches,
+ * ENOSPC, being the usual reason): add_directory() loads it, keeps it for the next rescan and
+ * returns false with errno set. Every watch that could not be added, including those on the
+ * .castusmeta.* directories, counts in watch_failures, the last reason in watch_error.
+ *
+ * durations indexes every entry with a known duration, kept up to date the same way. */
+class castus4public_media_catalog {
+public:
+	enum change_type {
+		Added=0,
+		Changed,
+		Removed
+	};
+	typedef void (*change_cb_t)(castus4public_media_catalog &catalog,const std::string &path,const enum change_type type,void *opaque);
+public:
+	castus4public_media_catalog();
+	~castus4public_media_catalog();
+public:
+	// watches are only set up after open(); adding directories works either way
+	bool open();
+	void close();
+	int fd() const;
+	bool add_directory(const char *dir_path);
+	size_t process_events();
+	void set_callback(change_cb_t cb,void *opaque);
+
+	const castus4public_metadata_list *lookup(const std::string &path) const;
+	size_t size() const;
+public:
+	std::unordered_map<std::string,castus4public_metadata_list>	entries;	// by media file path
+	castus4public_duration_index					durations;
+	size_t								watch_failures;
+	int								watch_error;
+private:
+	class watch {
+	public:
+		std::string			path;		// the directory watched
+		std::string			media_path;	// for a .castusmeta.* directory, its media file
+	};
+	void refresh(const std::string &media_path);
+	bool watch_metadir(const std::string &dir_path,const char *name);
+	void rescan();
+private:
+	int					inotify_fd;
+	change_cb_t				callback;
+	void*					callback_opaque;
+	std::map<int,watch>			watches;
+	std::map<std::string,int>		directories;	// media directory -> watch (-1 if none)
+};
+
+#endif // Castus4publicMediaCatalog_h
@@ -1,24 +1,71 @@
+#ifndef Castus4publicMetadata_h
+#define Castus4publicMetadata_h
+
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include <string>
 #include <list>
 #include <map>
 
+/* Well-known metadata values parsed into typed members. Anything missing or unparseable is left
+ * at 0 (or empty): duration in microseconds from "duration" (seconds), "type", "width" and
+ * "height" in pixels, and "frame rate" as a decimal or a ratio such as 30000/1001. */
+class castus4public_metadata_fields {
+public:
+	castus4public_metadata_fields();
+	void parse(const std::map<std::string,std::string> &list);
+	// the same from any store: get(opaque,name) gives the value, NUL terminated and valid until
+	// the next call, or NULL if there is none
+	void parse(const char *(*get)(void *opaque,const char *name),void *opaque);
+	void clear();
+public:
+	unsigned long long			duration_us;
+	std::string				type;
+	unsigned int				width;
+	unsigned int				height;
+	double					frame_rate;
+};
+
 class castus4public_metadata_list {
 public:
 	castus4public_metadata_list();
 	~castus4public_metadata_list();
 public:
 	bool read_metadata(const char *path);
+	bool write_metadata(const char *path) const;
+	// path relative to the directory open as dirfd (or AT_FDCWD)
+	bool read_metadata_at(int dirfd,const char *path);
+	bool write_metadata_at(int dirfd,const char *path) const;
+	void format_metadata(std::string &out) const;
+	// replace the list with what read_metadata() makes of this text
+	void parse_metadata(const std::string &in);
 	void clear();
-	const char *getValue(const char *name);
+	const char *getValue(const char *name) const;
 	void setValue(const char *name,const char *value);
 	void setValue(const char *name,std::string &value);
+	// parsed on first use after a change. Call invalidate_fields() after changing list directly.
+	const castus4public_metadata_fields &fields() const;
+	void invalidate_fields();
 public:
 	std::map<std::string,std::string>	list;
+private:
+	mutable castus4public_metadata_fields	fields_cache;
+	mutable bool				fields_valid;
 };
 
 bool castus4public_is_metadata_dir(const char *path);
 bool castus4public_is_metadata_dir(const std::string &path);
 std::string castus4public_file_to_metadata_dir(const char *path);
 std::string castus4public_file_to_metadata_dir(const std::string &path);
+// the metadata file itself. Given a bare file name, the result is relative to its directory.
+std::string castus4public_file_to_metadata_file(const char *path);
+std::string castus4public_file_to_metadata_file(const std::string &path);
+// temporary file name to write beside path before renaming over it
+std::string castus4public_metadata_temp_path(const std::string &path);
+// create and open a temporary file for path (relative to dirfd), never reusing or following
+// anything already there. like is the file it is to replace, or NULL: its permissions are copied,
+// and its owner where we may. Returns the fd, or -1 with errno set.
+int castus4public_metadata_create_temp(int dirfd,const std::string &path,std::string &tmp_path,const struct stat *like);
 
+#endif // Castus4publicMetadata_h
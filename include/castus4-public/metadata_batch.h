@@ -0,0 +1,29 @@
+#ifndef Castus4publicMetadataBatch_h
+#define Castus4publicMetadataBatch_h
+
+#include <castus4-public/metadata.h>
+
+#include <string>
+#include <vector>
+
+/* Metadata of many media files read concurrently by a pool of worker threads, for volumes where
+ * each open and read waits on the network far longer than it takes. Results come back in the
+ * order the files were given, each with its own error (an errno value, 0 on success; ENOENT if
+ * the file has no metadata). */
+class castus4public_metadata_result {
+public:
+	castus4public_metadata_result();
+public:
+	std::string			path;	// media file
+	castus4public_metadata_list	meta;
+	int				error;
+};
+
+// threads 0 picks a default suited to network storage (more threads than cores)
+bool castus4public_read_metadata_batch(const std::vector<std::string> &files,std::vector<castus4public_metadata_result> &out,unsigned int threads=0);
+// files named relative to the directory open as dirfd; result paths are as given
+bool castus4public_read_metadata_batch_at(int dirfd,const std::vector<std::string> &files,std::vector<castus4public_metadata_result> &out,unsigned int threads=0);
+// every media file (not dot files) in a directory, in readdir order
+bool castus4public_read_metadata_dir(const char *dir_path,std::vector<castus4public_metadata_result> &out,unsigned int threads=0);
+
+#endif // Castus4publicMetadataBatch_h
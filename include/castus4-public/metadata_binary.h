@@ -0,0 +1,70 @@
+#ifndef Castus4publicMetadataBinary_h
+#define Castus4publicMetadataBinary_h
+
+#include <castus4-public/metadata.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <string>
+
+/* Compact binary copy of a metadata file, kept beside it as "metadata.bin" in the same
+ * .castusmeta.* directory.
+ *
+ * The file is a fixed header, an array of (key, value) offset/length records sorted by key, and
+ * a string table. It is mapped read-only and looked up by binary search, with nothing parsed or
+ * copied. The header carries the (dev, inode, mtime, size) of the text file it was made from,
+ * and read_metadata() only uses it while that still matches: anything that rewrites the text
+ * file, Castus included, makes it stale and the text file is read instead.
+ *
+ * Values are stored as the text file's multi-line values are, joined with newlines. The layout
+ * is native byte order; a file from a machine of the other order reads as invalid.
+ *
+ * Castus does not write sidecars itself: update_at(), or the castus4-public_metabin tool, makes
+ * them for existing libraries. */
+class castus4public_metadata_binary {
+public:
+	castus4public_metadata_binary();
+	~castus4public_metadata_binary();
+public:
+	// path relative to dirfd (or AT_FDCWD). Fails if the file is missing or malformed.
+	bool open_at(int dirfd,const char *path);
+	void close();
+	bool is_open() const;
+	// true if the text file with this stat is the one the binary was made from
+	bool matches(const struct stat &text_st) const;
+	size_t size() const;
+	// not NUL terminated
+	const char *key(const size_t i,size_t &len) const;
+	const char *value(const size_t i,size_t &len) const;
+	const char *find(const char *name,size_t &len) const;
+	void to_list(castus4public_metadata_list &meta) const;
+	// the well-known values straight from the mapped records, with no list built
+	void to_fields(castus4public_metadata_fields &fields) const;
+public:
+	// serialize meta as read back from its text form (see parse_metadata()), stamped with the
+	// stat of the text file it matches
+	static void format(std::string &out,const castus4public_metadata_list &meta,const struct stat &text_st);
+	// write atomically (temp file and rename), stamped with the stat of the text file
+	static bool write_at(int dirfd,const char *path,const castus4public_metadata_list &meta,const struct stat &text_st);
+	// make the sidecar of an existing metadata file (path relative to dirfd) current, for files
+	// written before there were sidecars or by something that does not write them. Holds a
+	// shared lock on the text file meanwhile, so a writer's newer sidecar is never replaced.
+	// true if the sidecar is current afterwards.
+	static bool update_at(int dirfd,const char *meta_path);
+private:
+	const unsigned char*			base;
+	size_t					length;
+	size_t					count;
+	const unsigned char*			records;
+	const unsigned char*			strings;
+	size_t					strings_length;
+};
+
+// the binary sidecar beside a metadata file path ("…/metadata" gives "…/metadata.bin")
+std::string castus4public_metadata_file_to_binary(const std::string &meta_path);
+// the well-known values of a metadata file (path relative to dirfd): from a current sidecar
+// without parsing the text or building a list, else from the text file
+bool castus4public_read_metadata_fields_at(int dirfd,const char *meta_path,castus4public_metadata_fields &fields);
+
+#endif // Castus4publicMetadataBinary_h
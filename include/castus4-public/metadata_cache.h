@@ -0,0 +1,72 @@
+#ifndef Castus4publicMetadataCache_h
+#define Castus4publicMetadataCache_h
+
+#include <castus4-public/metadata.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+#include <map>
+
+/* Parsed metadata kept across runs in one cache file, so that scanning a directory of media
+ * does not open and parse every .castusmeta.* file every time.
+ *
+ * An entry is keyed by the (dev, inode, mtime, size) of the metadata file it was parsed from and
+ * is checked with one stat() of that file. Optionally, with trust_directory_mtime, a directory
+ * whose own mtime has not changed since the last scan is not looked into at all. That catches
+ * media added, removed or renamed, but not metadata rewritten in place, so only turn it on where
+ * metadata is written once when the media is added.
+ *
+ * save() writes a temporary file and renames it over the old one, so readers never see half a
+ * cache. A missing or damaged cache file just starts an empty cache, and so does one owned by
+ * another user or writable by group or other: keep the cache in a directory only its user can
+ * write to. */
+class castus4public_metadata_cache {
+public:
+	class stamp {
+	public:
+		stamp();
+		void from_stat(const struct stat &st);
+		bool operator==(const stamp &a) const;
+		bool operator!=(const stamp &a) const;
+	public:
+		unsigned long long		dev;
+		unsigned long long		ino;
+		long long			mtime_sec;
+		long				mtime_nsec;
+		long long			size;
+	};
+	class entry {
+	public:
+		stamp				st;	// of the metadata file
+		castus4public_metadata_list	meta;
+	};
+	class directory {
+	public:
+		stamp				st;
+		std::vector<std::string>	files;	// media files in it that have metadata
+	};
+	typedef std::vector<std::pair<std::string,const castus4public_metadata_list*> > scan_result;
+public:
+	castus4public_metadata_cache();
+	~castus4public_metadata_cache();
+public:
+	bool load(const char *path);
+	bool save(const char *path);
+	void clear();
+	// metadata of a media file, NULL if it has none. Valid until the cache next changes.
+	const castus4public_metadata_list *lookup(const std::string &file_path);
+	// media files (not dot files) in a directory that have metadata, with that metadata
+	bool scan(const char *dir_path,scan_result &out);
+private:
+	const castus4public_metadata_list *lookup_at(int dirfd,const std::string &meta_path,const std::string &file_path);
+public:
+	bool					trust_directory_mtime;
+	bool					dirty;
+	std::map<std::string,entry>		entries;	// by media file path
+	std::map<std::string,directory>		directories;
+};
+
+#endif // Castus4publicMetadataCache_h
@@ -0,0 +1,60 @@
+#ifndef Castus4publicMetadataWriter_h
+#define Castus4publicMetadataWriter_h
+
+#include <castus4-public/metadata.h>
+
+#include <sys/types.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+#include <map>
+
+/* Rewrites the metadata of many media files with one sync per filesystem instead of one fsync
+ * per file.
+ *
+ * add() writes each file's new metadata to a temporary file in its .castusmeta.* directory
+ * (created if missing) and nothing else: readers still see the old metadata and no lock is
+ * held. commit() then syncs each filesystem once (syncfs), renames every file into place under a
+ * brief LOCK_EX on the old one, and syncs again so the renames are durable too. A crash before
+ * commit() returns leaves each file either old or new, never empty or partial. Each file's
+ * metadata.bin sidecar is staged and renamed along with it.
+ *
+ * add() notes which file it is replacing (inode, mtime and size, or that there was none), and
+ * commit() checks under the lock that it is still that file. One changed by someone else in
+ * between is left alone and fails with ESTALE, rather than being overwritten with metadata
+ * built from what it used to say. The new files keep the old ones' permissions and owner.
+ *
+ * Files not committed are discarded by abort() or the destructor. Failures are collected in
+ * failed as (media path, errno). */
+class castus4public_metadata_writer {
+public:
+	castus4public_metadata_writer();
+	~castus4public_metadata_writer();
+public:
+	bool add(const std::string &media_path,const castus4public_metadata_list &meta);
+	bool commit();
+	void abort();
+	size_t pending() const;
+public:
+	std::vector<std::pair<std::string,int> >	failed;
+private:
+	class file {
+	public:
+		std::string			media_path;
+		std::string			meta_path;
+		std::string			tmp_path;
+		std::string			bin_path;	// metadata.bin sidecar
+		std::string			bin_tmp_path;	// empty if it could not be staged
+		bool				had_old;	// stamp of the file replaced, taken at add()
+		ino_t				old_ino;
+		struct timespec			old_mtime;
+		off_t				old_size;
+	};
+	bool sync_all();
+private:
+	std::vector<file>			files;
+	std::map<dev_t,int>			sync_fds;	// one open directory per filesystem written to
+};
+
+#endif // Castus4publicMetadataWriter_h
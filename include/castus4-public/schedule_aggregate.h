@@ -0,0 +1,40 @@
+#ifndef Castus4publicScheduleAggregate_h
+#define Castus4publicScheduleAggregate_h
+
+#include <castus4-public/schedule_object.h>
+
+#include <vector>
+
+/* Time covered by the items matching a predicate (e.g. advertisement=1), as prefix sums over the
+ * merged matching intervals. Any window sum is two lookups; a bucket table (one entry per
+ * 'bucket' of timeline) makes each lookup O(1) for any realistic item density. worst_window()
+ * finds the window of a given length with the most matching time in O(n).
+ *
+ * Overlapping matches are merged first, so nothing is counted twice. When the schedule length is
+ * known, windows running past the end wrap around to the start, as the schedule does. */
+class Castus4publicScheduleAggregate {
+public:
+	typedef Castus4publicSchedule::ideal_time_t	ideal_time_t;
+	typedef bool (*predicate_t)(const Castus4publicSchedule::ScheduleItem &item,void *opaque);
+public:
+							Castus4publicScheduleAggregate();
+							~Castus4publicScheduleAggregate();
+	bool						build(const Castus4publicSchedule &schedule,predicate_t pred,void *opaque,const ideal_time_t bucket=60000000LL);
+	// items where name equals value, or where value is NULL, where name is set to anything but "0"
+	bool						build(const Castus4publicSchedule &schedule,const char *name,const char *value,const ideal_time_t bucket=60000000LL);
+	void						clear();
+
+	ideal_time_t					total() const;
+	ideal_time_t					covered_before(const ideal_time_t t) const;
+	ideal_time_t					window_sum(const ideal_time_t a,const ideal_time_t b) const;
+	ideal_time_t					worst_window(const ideal_time_t window,ideal_time_t *start=NULL) const;
+public:
+	std::vector<ideal_time_t>			starts;		// merged matching intervals, sorted
+	std::vector<ideal_time_t>			ends;
+	std::vector<ideal_time_t>			prefix;		// prefix[i] = matching time before starts[i]
+	std::vector<size_t>				bucket_first;	// first interval ending after the bucket starts
+	ideal_time_t					bucket;
+	ideal_time_t					length;		// schedule length, 0 if unknown (no wrap)
+};
+
+#endif // Castus4publicScheduleAggregate_h
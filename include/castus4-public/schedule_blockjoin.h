@@ -0,0 +1,49 @@
+#ifndef Castus4publicScheduleBlockJoin_h
+#define Castus4publicScheduleBlockJoin_h
+
+#include <castus4-public/schedule_object.h>
+
+#include <vector>
+
+/* Which schedule block each item falls in, and per-block totals, from one sweep over the items
+ * and blocks in start order (each time string is parsed once).
+ *
+ * An item lies in a block if the block covers it entirely. Any other block it overlaps (all of
+ * them, if none covers it) is listed as a partial overlap. Fill and ad time are the time the block's items (or its ad items,
+ * advertisement > 0 as autochop marks them) cover inside the block, overlaps counted once. The
+ * item count includes items that only partly overlap.
+ *
+ * Pending time shifts are written out first. */
+class Castus4publicScheduleBlockJoin {
+public:
+	typedef Castus4publicSchedule::ideal_time_t	ideal_time_t;
+
+	class ItemResult {
+	public:
+		const Castus4publicSchedule::ScheduleItem*	item;
+		ideal_time_t				start;
+		ideal_time_t				end;
+		long					block;		// index into blocks, -1 if none contains it
+		std::vector<size_t>			partial;	// other blocks it overlaps
+	};
+	class BlockResult {
+	public:
+		const Castus4publicSchedule::ScheduleBlock*	block;
+		ideal_time_t				start;
+		ideal_time_t				end;
+		ideal_time_t				fill;
+		ideal_time_t				ad_time;
+		size_t					item_count;
+	};
+public:
+							Castus4publicScheduleBlockJoin();
+							~Castus4publicScheduleBlockJoin();
+	// items and blocks without valid times are left out
+	bool						join(const Castus4publicSchedule &schedule);
+	void						clear();
+public:
+	std::vector<ItemResult>				items;		// in start order
+	std::vector<BlockResult>			blocks;		// in start order
+};
+
+#endif // Castus4publicScheduleBlockJoin_h
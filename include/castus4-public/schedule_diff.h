@@ -0,0 +1,65 @@
+#ifndef Castus4publicScheduleDiff_h
+#define Castus4publicScheduleDiff_h
+
+#include <castus4-public/schedule_object.h>
+
+#include <string>
+#include <vector>
+#include <map>
+
+/* Edit script turning one schedule's items and blocks into another's.
+ *
+ * Both sides are sorted by start time and merged in one pass; records with the same start and
+ * the same content hash (ScheduleItem::getContentHash()) are unchanged. Of what is left, a record whose content is unchanged but
+ * whose times moved is a retime, a record replaced at the same start time is a value change, and
+ * the rest are removes and adds. Ops name the record they act on by its original start time and
+ * content hash, so the script only applies to the schedule it was computed from.
+ *
+ * Globals are not diffed. Pending time shifts on either schedule are applied before computing. */
+class Castus4publicScheduleDiff {
+public:
+	typedef Castus4publicSchedule::ideal_time_t	ideal_time_t;
+
+	enum op_type {
+		Add=0,
+		Remove,
+		Retime,
+		Change
+	};
+	enum record_type {
+		Item=0,
+		Block
+	};
+
+	class Op {
+	public:
+						Op();
+	public:
+		enum op_type			op;
+		enum record_type		record;
+		ideal_time_t			start;		// Remove/Retime/Change: record acted on
+		unsigned long long		hash;
+		ideal_time_t			new_start;	// Retime
+		ideal_time_t			new_end;
+		std::map<std::string,std::string> entry;	// Add: whole record. Change: values set
+		std::vector<std::string>	deleted;	// Change: values removed
+	};
+public:
+							Castus4publicScheduleDiff();
+							~Castus4publicScheduleDiff();
+	bool						compute(const Castus4publicSchedule &from,const Castus4publicSchedule &to);
+	// fails without changing the schedule if any record an op names is not there.
+	// Items and blocks come out in start time order. Also false, with the script
+	// applied, if an item it touched is left without valid times (see commit()).
+	bool						apply(Castus4publicSchedule &schedule) const;
+	bool						empty() const;
+	void						clear();
+
+	// compact text form, one op per line with its values on the tab-indented lines after it
+	void						write(std::string &out) const;
+	bool						read(const std::string &in);
+public:
+	std::vector<Op>					ops;
+};
+
+#endif // Castus4publicScheduleDiff_h
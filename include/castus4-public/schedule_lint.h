@@ -0,0 +1,40 @@
+#ifndef Castus4publicScheduleLint_h
+#define Castus4publicScheduleLint_h
+
+#include <castus4-public/schedule_object.h>
+
+#include <vector>
+
+/* Sweep-line checks over the item timeline of a schedule: overlapping items, dead air between
+ * items, items that end before they start and items that run past the end of the schedule. */
+class Castus4publicScheduleLint {
+public:
+	typedef Castus4publicSchedule::ideal_time_t	ideal_time_t;
+
+	enum issue_type {
+		Overlap=0,		// [start,end) is covered by both item and other
+		Gap,			// nothing plays in [start,end); other is the item before, item the one after (either may be NULL)
+		ZeroLength,		// item ends at or before its start
+		PastEnd,		// item runs past interval_length; [start,end) is the overhang
+		InvalidTime		// item has no usable start or end
+	};
+
+	class Issue {
+	public:
+							Issue();
+	public:
+		enum issue_type				type;
+		ideal_time_t				start;
+		ideal_time_t				end;
+		const Castus4publicSchedule::ScheduleItem*	item;
+		const Castus4publicSchedule::ScheduleItem*	other;
+	};
+public:
+	// appends to issues: InvalidTime issues first, in list order, as they have
+	// no place on the timeline, then everything else in time order. gaps
+	// shorter than min_gap are ignored. returns true if nothing was found
+	static bool					analyze(const Castus4publicSchedule &schedule,std::vector<Issue> &issues,const ideal_time_t min_gap=0);
+	static const char*				issue_name(const enum issue_type t);
+};
+
+#endif // Castus4publicScheduleLint_h
@@ -0,0 +1,63 @@
+#ifndef Castus4publicScheduleMediaJoin_h
+#define Castus4publicScheduleMediaJoin_h
+
+#include <castus4-public/schedule_object.h>
+
+#include <string>
+#include <vector>
+
+/* Checks the items of a schedule against the metadata of the media they play.
+ *
+ * The item paths are collected once each, however many items play them, and their metadata is
+ * read in one concurrent batch (castus4public_read_metadata_batch), one read per file. Then:
+ *
+ * - media whose metadata cannot be read is reported Missing if the media file itself is gone,
+ *   NoMetadata if it is there,
+ * - media whose metadata has no usable "duration" is reported NoDuration, once,
+ * - each item whose "item duration" differs from the media's duration by more than the
+ *   tolerance is reported DurationMismatch. Items without "item duration" are not compared.
+ *
+ * Media issues carry the first item that plays the file; look in media[].items for the rest. */
+class Castus4publicScheduleMediaJoin {
+public:
+	typedef Castus4publicSchedule::ideal_time_t	ideal_time_t;
+
+	enum issue_type {
+		Missing=0,
+		NoMetadata,
+		NoDuration,
+		DurationMismatch
+	};
+
+	class Media {
+	public:
+						Media();
+	public:
+		std::string				path;
+		int					error;		// errno from reading the metadata, 0 if read
+		unsigned long long			duration_us;	// 0 if unknown
+		std::vector<const Castus4publicSchedule::ScheduleItem*>	items;	// in schedule order
+	};
+	class Issue {
+	public:
+						Issue();
+	public:
+		enum issue_type				type;
+		size_t					media;		// index into media
+		const Castus4publicSchedule::ScheduleItem*	item;
+		unsigned long long			item_duration_us;	// DurationMismatch only
+		unsigned long long			media_duration_us;	// DurationMismatch only
+	};
+public:
+							Castus4publicScheduleMediaJoin();
+							~Castus4publicScheduleMediaJoin();
+	// threads 0 means the batch reader's default. returns true if nothing was found
+	bool						check(const Castus4publicSchedule &schedule,const ideal_time_t tolerance=500000,const unsigned int threads=0);
+	void						clear();
+	static const char*				issue_name(const enum issue_type t);
+public:
+	std::vector<Media>				media;		// in order of first use
+	std::vector<Issue>				issues;		// media issues by media, then mismatches in schedule order
+};
+
+#endif // Castus4publicScheduleMediaJoin_h
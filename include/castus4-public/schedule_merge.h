@@ -0,0 +1,45 @@
+#ifndef Castus4publicScheduleMerge_h
+#define Castus4publicScheduleMerge_h
+
+#include <castus4-public/schedule_object.h>
+
+#include <string>
+#include <vector>
+
+/* Items of several schedules (a main channel schedule plus overlays, secondary events...)
+ * interleaved by start time: a k-way merge with a heap over each schedule's items in start
+ * order. The view points at the sources' items instead of copying them, so the sources must
+ * outlive it and stay unchanged. Items starting at the same time come out in source order, and
+ * in list order within a source.
+ *
+ * Time shifts made on a source after add() are picked up when merging. */
+class Castus4publicScheduleMerge {
+public:
+	typedef Castus4publicSchedule::ideal_time_t	ideal_time_t;
+
+	class Entry {
+	public:
+		ideal_time_t				start;
+		ideal_time_t				end;
+		size_t					source;		// index in the order sources were added
+		const Castus4publicSchedule::ScheduleItem*	item;
+	};
+public:
+							Castus4publicScheduleMerge();
+							~Castus4publicScheduleMerge();
+	// returns the source index. name is what materialize() tags its items with,
+	// the index as a string if empty.
+	size_t						add(const Castus4publicSchedule &schedule,const std::string &name=std::string());
+	void						clear();
+	void						merge(std::vector<Entry> &out) const;
+
+	// copy the merged items into a new schedule, tagging each with tag=<source name> unless
+	// tag is NULL. Type, globals and blocks come from the first source. Fails, leaving out
+	// alone, if the sources are not all of one schedule type and interval length.
+	bool						materialize(Castus4publicSchedule &out,const char *tag="source") const;
+public:
+	std::vector<const Castus4publicSchedule*>	sources;
+	std::vector<std::string>			names;
+};
+
+#endif // Castus4publicScheduleMerge_h
@@ -29,6 +29,12 @@ public:
 	typedef signed long long			ideal_time_t;
 
 	static const ideal_time_t			ideal_time_t_invalid = (ideal_time_t)(-1LL);
+
+	// sort key: a parsed time and the position of the record it belongs to
+	struct ideal_time_key {
+		ideal_time_t				time;
+		size_t					index;
+	};
 public:
 	enum entry_parse_mode {
 		Global=0,
@@ -42,11 +48,17 @@ public:
 	static void common_std_map_name_value_pair_entry(std::map<std::string,std::string> &entry,const std::string &name,const std::string &value);
 	static ideal_time_t				time_tm_to_ideal_time(const struct tm &t,const unsigned long usec,const int schedule_type);
 	static void					ideal_time_to_time_tm(struct tm &tm,unsigned long &usec,ideal_time_t t,const int schedule_type);
+	static void					radix_sort_time_keys(std::vector<ideal_time_key> &keys);
+	// 64-bit hash of a record's canonical form: entries in key order, with start
+	// and end as ideal times so different spellings of one time hash alike
+	static unsigned long long			entry_content_hash(const std::map<std::string,std::string> &entry,const bool with_times=true);
 public:
 	class ScheduleItem {
 	public:
 							ScheduleItem(const int schedule_type);
+							ScheduleItem(const ScheduleItem &a);
 							~ScheduleItem();
+		ScheduleItem&				operator=(const ScheduleItem &a);
 		void					takeNameValuePair(const std::string &name,const std::string &value);
 		const char*				getValue(const char *name) const;
 		void					setValue(const char *name,const char *value);
@@ -69,14 +81,32 @@ public:
 
 		bool					operator<(const ScheduleItem &a) const;
 		bool					operator==(const ScheduleItem &a) const;
+
+		// hash of the canonical form (see entry_content_hash()), cached until the next
+		// setValue()/deleteValue()/takeNameValuePair(). Call invalidateContentHash()
+		// after changing entry directly.
+		unsigned long long			getContentHash() const;
+		void					invalidateContentHash();
+
+		// changes along with the content hash, and is never the same for two copies, so a
+		// position within entry can be cached against (record, stamp)
+		unsigned long long			getEntryStamp() const;
 	public:
 		std::map<std::string,std::string> 	entry;
 		int					schedule_type;
+	private:
+		void					entryChanged();
+	private:
+		mutable unsigned long long		hash_cache;
+		mutable bool				hash_cache_valid;
+		unsigned long long			entry_stamp;
 	};
 	class ScheduleBlock {
 	public:
 							ScheduleBlock(const int schedule_type);
+							ScheduleBlock(const ScheduleBlock &a);
 							~ScheduleBlock();
+		ScheduleBlock&				operator=(const ScheduleBlock &a);
 		void					takeNameValuePair(const std::string &name,const std::string &value);
 		const char*				getValue(const char *name) const;
 		void					setValue(const char *name,const char *value);
@@ -99,13 +129,48 @@ public:
 
 		bool					operator<(const ScheduleBlock &a) const;
 		bool					operator==(const ScheduleBlock &a) const;
+
+		// hash of the canonical form (see entry_content_hash()), cached until the next
+		// setValue()/deleteValue()/takeNameValuePair(). Call invalidateContentHash()
+		// after changing entry directly.
+		unsigned long long			getContentHash() const;
+		void					invalidateContentHash();
+
+		// changes along with the content hash, and is never the same for two copies, so a
+		// position within entry can be cached against (record, stamp)
+		unsigned long long			getEntryStamp() const;
 	public:
 		std::map<std::string,std::string> 	entry;
 		int					schedule_type;
+	private:
+		void					entryChanged();
+	private:
+		mutable unsigned long long		hash_cache;
+		mutable bool				hash_cache_valid;
+		unsigned long long			entry_stamp;
+	};
+public:
+	typedef std::list<ScheduleItem>::iterator	item_iterator;
+
+	// index behind the ordered item mode (schedule_index.cpp). A copied
+	// schedule starts without one and rebuilds it on first use; pending
+	// shifts are written into the copy's items, the original is left alone.
+	class ItemIndex;
+	class ItemIndexRef {
+	public:
+							ItemIndexRef();
+							ItemIndexRef(const ItemIndexRef &a);
+							~ItemIndexRef();
+		ItemIndexRef&				operator=(const ItemIndexRef &a);
+		void					reset();
+	public:
+		ItemIndex*				index;
 	};
 public:
 							Castus4publicSchedule();
+							Castus4publicSchedule(const Castus4publicSchedule &a);
 	virtual						~Castus4publicSchedule();
+	Castus4publicSchedule&				operator=(const Castus4publicSchedule &a);
 	void						reset();
 	void						end_load();
 	void						begin_load();
@@ -117,6 +182,46 @@ public:
 	void						sort_schedule_items_rev(); // only for testing
 	void						sort_schedule_blocks_rev(); // only for testing
 
+	// ordered item mode: schedule_items stays sorted by start time as long as
+	// items are added, removed and retimed through these calls
+	void						set_ordered_items(bool on);
+	bool						ordered_items() const;
+	item_iterator					insert_item(const ScheduleItem &item);
+	// pos is where the item goes while order is not kept (unordered mode, or
+	// inside a batch); in ordered mode it is placed by start time as above
+	item_iterator					insert_item(item_iterator pos,const ScheduleItem &item);
+	item_iterator					erase_item(item_iterator i);
+	// the item's position, or schedule_items.end() if it is not in this
+	// schedule. O(log n) in ordered mode, a walk of the list otherwise.
+	item_iterator					find_item(const ScheduleItem *item);
+	bool						retime_item(item_iterator i,const ideal_time_t start,const ideal_time_t end);
+
+	// move every item starting at or after 'from' by delta. O(log n) in
+	// ordered mode, where the item strings are rewritten lazily: read times
+	// through item_start_time()/item_end_time(), or call apply_time_shifts()
+	// before using ScheduleItem::getStartTime() etc. on the list directly.
+	// write_out(), the C API and the analysis classes taking a schedule apply
+	// them first.
+	bool						shift_items(const ideal_time_t from,const ideal_time_t delta);
+	ideal_time_t					item_start_time(item_iterator i);
+	ideal_time_t					item_end_time(item_iterator i);
+	void						apply_time_shifts() const;
+
+	// batched edits: between begin_edit() and commit(), insert_item(),
+	// erase_item(), retime_item() and set_item_value() change the list
+	// directly and ordering is restored once at commit() (in either mode,
+	// if anything was added or retimed), which also checks the times of every
+	// item touched. Nests; the outermost commit() counts.
+	void						begin_edit();
+	bool						commit(std::vector<item_iterator> *invalid=NULL);
+	bool						in_edit() const;
+	bool						set_item_value(item_iterator i,const char *name,const char *value);
+
+	// hash of the whole schedule: type, globals and defaults, plus the items and
+	// blocks as unordered sets, so equal schedules hash alike whatever their
+	// order on disk. Pending time shifts are applied first.
+	unsigned long long				content_hash() const;
+
 	bool						write_out(FILE *fp);
 	static bool					write_out_stdio_cb(Castus4publicSchedule *_this,const char *line,void *opaque);
 
@@ -126,12 +231,19 @@ public:
 	bool						write_out(writeout_cb_t f,void *opaque);
 
 	bool						write_out_name_value_pair(const std::string &name,const std::string &value,writeout_cb_t f,void *opaque,bool tab,bool spcequ);
+
+	// bumped by every call above that adds, removes or reorders items or blocks, or reloads the
+	// schedule. Code that changes schedule_items, schedule_blocks or global_values directly
+	// must call changed() afterwards, or positions cached against it (the C API's and the
+	// ordered item index) go stale.
+	void						changed();
 public:
 	bool						head;
 	std::string					entry;			// if within { ... } block
 	bool						in_entry;
 	enum entry_parse_mode				entry_mode;
 // parsed output
+	ItemIndexRef					item_index;
 	std::list<ScheduleItem>				schedule_items;
 	std::list<ScheduleBlock>			schedule_blocks;
 	std::map<std::string,std::string>		defaults_values;
@@ -139,6 +251,18 @@ public:
 	std::map<std::string,std::string>		global_values;
 	int						schedule_type;
 	int						interval_length;
+	bool						keep_items_ordered;
+	int						edit_depth;
+	std::map<const ScheduleItem*,item_iterator>	edit_touched;
+	std::map<const ScheduleItem*,item_iterator>	edit_failed;		// retimes rejected in this batch
+	bool						edit_reordered;		// items added or retimed in this batch
+	unsigned long long				generation;
+private:
+	bool						item_index_in_sync() const;
+	bool						item_index_matches() const;
+	void						item_index_changed();
+	void						rebuild_item_index();
+	void						copy_time_shifts(Castus4publicSchedule &to) const;
 };
 
 #endif // Castus4publicSchedule_h
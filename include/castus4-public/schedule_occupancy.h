@@ -0,0 +1,53 @@
+#ifndef Castus4publicScheduleOccupancy_h
+#define Castus4publicScheduleOccupancy_h
+
+#include <castus4-public/schedule_object.h>
+
+#include <vector>
+
+/* Occupancy of the schedule timeline at a fixed resolution (one second by default).
+ *
+ * Each slot keeps a count of the items (or blocks) covering it, plus two bitsets derived from
+ * the counts: covered (count >= 1) and double booked (count >= 2). Coverage queries then run a
+ * word (64 slots) at a time with popcount. Times are rounded to the nearest slot boundary, so
+ * items that meet mid-slot are neither a gap nor an overlap. Counts saturate at 255. */
+class Castus4publicScheduleOccupancy {
+public:
+	typedef Castus4publicSchedule::ideal_time_t	ideal_time_t;
+
+	enum source {
+		Items=0,
+		Blocks
+	};
+public:
+							Castus4publicScheduleOccupancy();
+							~Castus4publicScheduleOccupancy();
+	// length 0 means the schedule's interval_length, or the last end time if that is not known
+	bool						build(const Castus4publicSchedule &schedule,const enum source src=Items,const ideal_time_t resolution=1000000,ideal_time_t length=0);
+	void						clear();
+
+	// incremental update for one edited item: remove its old range, add the new one
+	void						add(const ideal_time_t start,const ideal_time_t end);
+	void						remove(const ideal_time_t start,const ideal_time_t end);
+	void						update(const ideal_time_t old_start,const ideal_time_t old_end,const ideal_time_t start,const ideal_time_t end);
+
+	bool						any_uncovered(const ideal_time_t a,const ideal_time_t b) const;
+	bool						any_double_booked(const ideal_time_t a,const ideal_time_t b) const;
+	ideal_time_t					covered_time() const;
+	ideal_time_t					covered_time(const ideal_time_t a,const ideal_time_t b) const;
+	ideal_time_t					double_booked_time(const ideal_time_t a,const ideal_time_t b) const;
+private:
+	size_t						to_slot(const ideal_time_t t) const;
+	void						adjust(const ideal_time_t start,const ideal_time_t end,const int delta);
+	void						fill(const size_t a,const size_t b,const int c);
+	static size_t					count_bits(const std::vector<unsigned long long> &bits,size_t a,size_t b);
+public:
+	ideal_time_t					resolution;
+	ideal_time_t					length;
+	size_t						slots;
+	std::vector<unsigned char>			count;
+	std::vector<unsigned long long>		covered;
+	std::vector<unsigned long long>		doubled;
+};
+
+#endif // Castus4publicScheduleOccupancy_h
@@ -0,0 +1,113 @@
+#ifndef Castus4publicScheduleRefIndex_h
+#define Castus4publicScheduleRefIndex_h
+
+#include <castus4-public/schedule_object.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <unordered_map>
+#include <string>
+#include <vector>
+#include <map>
+
+/* Which schedules play a media file, how often, and when next, across a set of schedule files,
+ * without loading any of them to ask.
+ *
+ * Each schedule file is recorded with the (dev, inode, mtime, size) it had when read, and
+ * update() only loads it again once that changes, so keeping the index current over many
+ * channels costs a stat() per schedule. Lookups of media nothing plays, the usual answer before
+ * deleting a file, are mostly turned away by a Bloom filter without touching the map. The filter
+ * cannot forget, so it is rebuilt once enough media has dropped out of the index.
+ *
+ * Schedule and media paths are kept canonical (realpath(), or that of the directory for a file
+ * that is gone), so one file named two ways is still one file. Paths that cannot be resolved at
+ * all are kept as given.
+ *
+ * The time until the next airing is only known for daily and weekly schedules, and for monthly
+ * schedules within the current month (and only on days it has): months differ in length, and
+ * yearly and interval schedules do not map onto the clock the same way. Otherwise it is
+ * ideal_time_t_invalid.
+ *
+ * save() writes a temporary file and renames it over the old one; the filter is not saved but
+ * rebuilt by load(). A missing or damaged index file just starts an empty index, and so does one
+ * owned by another user or writable by group or other: keep the index in a directory only its
+ * user can write to. */
+class Castus4publicScheduleRefIndex {
+public:
+	typedef Castus4publicSchedule::ideal_time_t	ideal_time_t;
+
+	class stamp {
+	public:
+		stamp();
+		void from_stat(const struct stat &st);
+		bool operator==(const stamp &a) const;
+		bool operator!=(const stamp &a) const;
+	public:
+		unsigned long long		dev;
+		unsigned long long		ino;
+		long long			mtime_sec;
+		long				mtime_nsec;
+		long long			size;
+	};
+	class media_refs {
+	public:
+		media_refs();
+	public:
+		size_t				count;		// items playing it
+		std::vector<ideal_time_t>	starts;		// sorted, those with a valid start only
+	};
+	class schedule_refs {
+	public:
+		schedule_refs();
+	public:
+		stamp				st;
+		int				schedule_type;
+		ideal_time_t			length;		// 0 if the schedule does not repeat
+		std::map<std::string,media_refs>	media;
+	};
+	class Reference {
+	public:
+		std::string			schedule;
+		size_t				count;
+		ideal_time_t			until;		// from now to the next airing, ideal_time_t_invalid if none
+	};
+public:
+	Castus4publicScheduleRefIndex();
+	~Castus4publicScheduleRefIndex();
+public:
+	// read the schedule again if it changed since last time. A schedule that is gone or will not
+	// load is dropped from the index and false returned.
+	bool update(const std::string &schedule_path);
+	// update every schedule listed and drop any not listed. false if any failed to load.
+	bool update_all(const std::vector<std::string> &schedule_paths);
+	void remove(const std::string &schedule_path);
+	void clear();
+	// false means no schedule plays it; true may rarely be wrong, lookup() is exact
+	bool maybe_referenced(const std::string &media_path) const;
+	bool referenced(const std::string &media_path) const;
+	// in schedule path order. now 0 means the current time
+	size_t lookup(const std::string &media_path,std::vector<Reference> &out,time_t now=0) const;
+	size_t schedule_count() const;
+	size_t media_count() const;
+	bool load(const char *path);
+	bool save(const char *path);
+public:
+	bool					dirty;		// changed since load() or save()
+private:
+	void index_schedule(const std::string &schedule_path,const schedule_refs &s);
+	void unindex_schedule(const std::string &schedule_path,const schedule_refs &s);
+	void bloom_add(const std::string &media_path);
+	bool bloom_test(const std::string &media_path) const;
+	void bloom_rebuild();
+	static unsigned long long hash(const std::string &s);
+	static std::string canonical(const std::string &path);
+private:
+	std::map<std::string,schedule_refs>	schedules;
+	std::unordered_map<std::string,std::vector<std::string> >	by_media;	// media path to schedule paths
+	std::vector<unsigned long long>		bloom;
+	size_t					bloom_removed;	// media dropped since the filter was built
+};
+
+#endif // Castus4publicScheduleRefIndex_h
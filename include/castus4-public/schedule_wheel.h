@@ -0,0 +1,86 @@
+#ifndef Castus4publicScheduleTimingWheel_h
+#define Castus4publicScheduleTimingWheel_h
+
+#include <castus4-public/schedule_object.h>
+
+#include <string>
+#include <vector>
+#include <map>
+
+/* Start and end events of a schedule's items and blocks, dispatched in time order from a
+ * hierarchical timing wheel: four levels of 256 slots, each level covering 256 times the span of
+ * the one below, with events further out than that kept on an overflow list. Each event is
+ * touched once per level on its way down, and runs of empty slots are skipped whole, so
+ * advancing costs O(1) amortized per tick however far apart the events are.
+ *
+ * load() can be called again after the schedule changes. Events are matched by time, type and
+ * record content, so only the events that changed come out of or go into the wheel. The events
+ * point at the schedule's records, so reload after any change and before the next advance().
+ * Events earlier than the wheel's position are not loaded. */
+class Castus4publicScheduleTimingWheel {
+public:
+	typedef Castus4publicSchedule::ideal_time_t	ideal_time_t;
+
+	enum source {
+		Items=1,
+		Blocks=2
+	};
+	// at the same time, an end dispatches before a start
+	enum event_type {
+		End=0,
+		Start
+	};
+
+	static const unsigned int			level_bits = 8;
+	static const unsigned int			level_slots = 1u << level_bits;
+	static const unsigned int			levels = 4;
+
+	class Event {
+	public:
+		ideal_time_t				time;
+		enum event_type				type;
+		const Castus4publicSchedule::ScheduleItem*	item;	// one of item or block is set
+		const Castus4publicSchedule::ScheduleBlock*	block;
+	private:
+		friend class Castus4publicScheduleTimingWheel;
+		unsigned long long			tick;
+		Event*					prev;
+		Event*					next;
+		unsigned int				level;
+		Event**					head;
+		std::map<std::string,Event*>::iterator	key;
+	};
+
+	typedef void (*callback_t)(const Event &ev,void *opaque);
+public:
+							Castus4publicScheduleTimingWheel(const ideal_time_t resolution=1000);
+							~Castus4publicScheduleTimingWheel();
+	// drop all events and move the wheel to 'now'
+	void						reset(const ideal_time_t now=0);
+	// origin is added to every schedule time, to dispatch in absolute time
+	bool						load(const Castus4publicSchedule &schedule,const int sources=Items|Blocks,const ideal_time_t origin=0);
+	// dispatch every event at or before 'now' (to tick resolution), returns the number dispatched.
+	// the callback must not load, reset or advance the wheel.
+	size_t						advance(const ideal_time_t now,callback_t cb,void *opaque);
+	// time of the next event, or ideal_time_t_invalid if none
+	ideal_time_t					next_time() const;
+	size_t						size() const;
+private:
+	unsigned long long				to_tick(const ideal_time_t t) const;
+	void						link(Event *ev);
+	void						unlink(Event *ev);
+	void						cascade(const unsigned int level);
+	void						add(const std::string &key,const ideal_time_t t,const enum event_type type,
+								const Castus4publicSchedule::ScheduleItem *item,const Castus4publicSchedule::ScheduleBlock *block);
+	void						destroy(Event *ev);
+	static ideal_time_t				earliest(const Event *ev,const ideal_time_t best);
+private:
+	ideal_time_t					resolution;
+	unsigned long long				current;	// next tick to dispatch
+	Event*						slot[levels][level_slots];
+	Event*						overflow;
+	size_t						count[levels+1];
+	std::map<std::string,Event*>			events;
+};
+
+#endif // Castus4publicScheduleTimingWheel_h
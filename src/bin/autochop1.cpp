@@ -7,6 +7,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <pwd.h>
 #include <stdio.h>
 #include <ctype.h>
 #include <math.h>
@@ -17,6 +19,7 @@
 #include <castus4-public/chomp.h>
 #include <castus4-public/schedule_object.h>
 #include <castus4-public/metadata.h>
+#include <castus4-public/metadata_cache.h>
 
 #include <iostream>
 
@@ -63,42 +66,82 @@ std::list<Castus4publicSchedule::ScheduleItem>::iterator insert_ad_break(std::ve
 	return in;
 }
 
-void load_ad_breaks(std::vector<AdBreak> &breaks) {
-	std::string file_path,meta_path,metadata_file;
-	castus4public_metadata_list mlist;
-	struct dirent *d;
+/* Parsed ad metadata is cached between runs (see castus4public_metadata_cache) in the file named
+ * by $CASTUS4PUBLIC_METACACHE, or metacache_path if that is not set, or by default in
+ * $XDG_STATE_HOME/castus4-public/metacache (~/.local/state/...). An empty name means no cache.
+ * The default directory is made private to the user, and not used if it is anyone else's or
+ * others can write to it: never a shared directory like /tmp, where the name could be planted.
+ *
+ * Ads get their metadata once, when they are added to the break directory, so the cache trusts
+ * that directory's mtime and does not look into it while it is unchanged. Set
+ * $CASTUS4PUBLIC_METACACHE_RECHECK to check every ad's metadata file anyway. */
+const char *metacache_path = NULL;
+
+/* make dir (one level) private to us, or check that it already is */
+static bool metacache_private_dir(const std::string &dir,const mode_t mode) {
 	struct stat st;
-	DIR *dir;
 
-	breaks.clear();
+	if (mkdir(dir.c_str(),mode) && errno != EEXIST) return false;
+	if (lstat(dir.c_str(),&st) || !S_ISDIR(st.st_mode)) return false;
+	return st.st_uid == geteuid() && (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
 
-	dir = opendir(ads_path);
-	if (dir == NULL) return;
+static std::string default_metacache_path() {
+	const char *state = getenv("XDG_STATE_HOME");
+	std::string dir;
 
-	while ((d=readdir(dir)) != NULL) {
-		if (d->d_name[0] == '.') continue;
+	if (state != NULL && *state == '/') {
+		dir = state;
+	}
+	else {
+		const char *home = getenv("HOME");
+		if (home == NULL || *home != '/') {
+			struct passwd *pw = getpwuid(geteuid());
+			home = (pw != NULL) ? pw->pw_dir : NULL;
+		}
+		if (home == NULL || *home != '/') return std::string();
+
+		dir = std::string(home) + "/.local";
+		if (mkdir(dir.c_str(),0755) && errno != EEXIST) return std::string();
+		dir += "/state";
+		if (!metacache_private_dir(dir,0700)) return std::string();
+	}
 
-		file_path = std::string(ads_path) + "/" + d->d_name;
-		if (stat(file_path.c_str(),&st) || !S_ISREG(st.st_mode)) continue;
+	dir += "/castus4-public";
+	if (!metacache_private_dir(dir,0700)) return std::string();
+
+	return dir + "/metacache";
+}
+
+void load_ad_breaks(std::vector<AdBreak> &breaks) {
+	castus4public_metadata_cache::scan_result files;
+	castus4public_metadata_cache cache;
+	std::string cache_path;
+
+	breaks.clear();
 
-		meta_path = castus4public_file_to_metadata_dir(file_path);
-		if (meta_path.empty()) continue;
+	if (getenv("CASTUS4PUBLIC_METACACHE") != NULL)
+		cache_path = getenv("CASTUS4PUBLIC_METACACHE");
+	else if (metacache_path != NULL)
+		cache_path = metacache_path;
+	else
+		cache_path = default_metacache_path();
 
-		metadata_file = meta_path + "/metadata";
-		if (stat(metadata_file.c_str(),&st) || !S_ISREG(st.st_mode)) continue;
+	cache.trust_directory_mtime = getenv("CASTUS4PUBLIC_METACACHE_RECHECK") == NULL;
+	if (!cache_path.empty()) cache.load(cache_path.c_str());
 
-		if (!mlist.read_metadata(metadata_file.c_str())) continue;
+	if (!cache.scan(ads_path,files)) return;
 
+	for (size_t i=0;i < files.size();i++) {
 		AdBreak ad;
 
-		const char *duration = mlist.getValue("duration");
-		if (duration != NULL) ad.duration_us = (unsigned long long)(atof(duration) * 1000000);
-		ad.path = file_path;
+		ad.duration_us = files[i].second->fields().duration_us;
+		ad.path = files[i].first;
 
 		breaks.push_back(ad);
 	}
 
-	closedir(dir);
+	if (!cache_path.empty() && cache.dirty) cache.save(cache_path.c_str());
 }
 
 int main(int argc,char **argv) {
@@ -0,0 +1,395 @@
+#include <sys/types.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/c_schedule.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+
+/* Random edits through the C API (items, blocks and globals added, copied, retimed, changed and
+ * erased), on plain schedules and on ones kept in start order with time shifts pending, checked
+ * against plain lists: item by item in list order, or on an ordered schedule as a sorted whole
+ * with the list in start order. Every so often the text written out must load
+ * back the same. Run by "make check". */
+
+typedef Castus4publicSchedule::ideal_time_t ideal_time_t;
+
+static const ideal_time_t second = 1000000LL;
+
+class ModelRecord {
+public:
+	std::string			name;
+	long long			start;		// -1 if none
+	long long			end;
+	std::map<std::string,std::string> values;
+public:
+	bool operator<(const ModelRecord &a) const {
+		if (start != a.start) return start < a.start;
+		if (end != a.end) return end < a.end;
+		if (name != a.name) return name < a.name;
+		return values < a.values;
+	}
+	bool operator==(const ModelRecord &a) const {
+		return start == a.start && end == a.end && name == a.name && values == a.values;
+	}
+};
+
+static unsigned int rng_state = 12345;
+
+static unsigned int rnd(const unsigned int n) {
+	rng_state = (rng_state * 1103515245U) + 12345U;
+	return (rng_state >> 8U) % n;
+}
+
+static const char *keys[] = { "note", "advertisement", "in" };
+static const char *values[] = { "0", "1", "a b" };
+
+static int next_id = 0;
+
+/* C API position: negative or past the end appends */
+static int rnd_pos(const size_t size) {
+	const unsigned int k = rnd(8);
+
+	if (k == 0) return -1;
+	if (k == 1) return (int)size + 3;
+	return (int)rnd((unsigned int)size + 1);
+}
+
+static size_t clamp_pos(const int pos,const size_t size) {
+	return (pos < 0 || (size_t)pos > size) ? size : (size_t)pos;
+}
+
+/* the item's values through the C API, less its name and times */
+static void read_item(Castus4publicSchedule::ScheduleItem *item,ModelRecord &m) {
+	const char *name = item_get_value(item,"item");
+
+	m.name = name != NULL ? name : "";
+	m.start = item_start_time_us(item);
+	m.end = item_stop_time_us(item);
+	m.values.clear();
+	for (unsigned int k=0;k < 3;k++) {
+		const char *v = item_get_value(item,keys[k]);
+		if (v != NULL) m.values[keys[k]] = v;
+	}
+}
+
+static bool check(Castus4publicSchedule *schedule,const std::vector<ModelRecord> &items,const std::vector<ModelRecord> &blocks,
+	const std::map<std::string,std::string> &globals,const bool ordered,const unsigned int step,const char *what) {
+	std::vector<ModelRecord> got;
+	schedule_item_export ex[7];
+	int n;
+
+	if (schedule_item_count(schedule) != (int)items.size()) {
+		fprintf(stderr,"step %u (%s): %d items, expected %zu\n",step,what,schedule_item_count(schedule),items.size());
+		return false;
+	}
+
+	for (int first=0;(n=schedule_export_items(schedule,first,ex,7)) > 0;first += n) {
+		for (int k=0;k < n;k++) {
+			ModelRecord m;
+
+			read_item(ex[k].handle,m);
+			if (ex[k].start != m.start || ex[k].end != m.end || (ex[k].item != NULL ? std::string(ex[k].item) : std::string()) != m.name ||
+				schedule_item(schedule,first + k) != ex[k].handle) {
+				fprintf(stderr,"step %u (%s): export of item %d does not match the item\n",step,what,first + k);
+				return false;
+			}
+			got.push_back(m);
+		}
+	}
+
+	if (ordered) {
+		long long last = -1;
+
+		for (size_t k=0;k < got.size();k++) {
+			if (got[k].start < 0) continue;
+			if (got[k].start < last) {
+				fprintf(stderr,"step %u (%s): ordered schedule has item %zu at %lld after %lld\n",step,what,k,got[k].start,last);
+				return false;
+			}
+			last = got[k].start;
+		}
+
+		std::vector<ModelRecord> want(items);
+		std::sort(want.begin(),want.end());
+		std::sort(got.begin(),got.end());
+		if (!(got == want)) {
+			fprintf(stderr,"step %u (%s): ordered schedule does not hold the items expected\n",step,what);
+			return false;
+		}
+	}
+	else if (!(got == items)) {
+		fprintf(stderr,"step %u (%s): items differ from the model\n",step,what);
+		for (size_t k=0;k < got.size() && k < items.size();k++) {
+			if (!(got[k] == items[k])) {
+				fprintf(stderr,"  item %zu is %s %lld-%lld, expected %s %lld-%lld\n",k,got[k].name.c_str(),got[k].start,got[k].end,
+					items[k].name.c_str(),items[k].start,items[k].end);
+				break;
+			}
+		}
+		return false;
+	}
+
+	if (schedule_block_count(schedule) != (int)blocks.size()) {
+		fprintf(stderr,"step %u (%s): %d blocks, expected %zu\n",step,what,schedule_block_count(schedule),blocks.size());
+		return false;
+	}
+	for (size_t k=0;k < blocks.size();k++) {
+		Castus4publicSchedule::ScheduleBlock *b = schedule_block(schedule,(int)k);
+		const char *name = block_name(b);
+
+		if (name == NULL || blocks[k].name != name || block_start_time_us(b) != blocks[k].start || block_stop_time_us(b) != blocks[k].end) {
+			fprintf(stderr,"step %u (%s): block %zu differs from the model\n",step,what,k);
+			return false;
+		}
+	}
+
+	std::map<std::string,std::string> g;
+	for (int k=0;k < schedule_globals_count(schedule);k++)
+		g[schedule_global_item_key(schedule,(unsigned int)k)] = schedule_global_item_value(schedule,(unsigned int)k);
+	if (g != globals) {
+		fprintf(stderr,"step %u (%s): globals differ from the model\n",step,what);
+		return false;
+	}
+
+	return true;
+}
+
+static void rnd_times(long long &s,long long &e) {
+	s = (long long)rnd(3 * 24 * 60) * 60LL * second;
+	e = s + (long long)(1 + rnd(120)) * 60LL * second;
+}
+
+/* new times through the schedule, in the order that never has the end before the start */
+static bool retime(Castus4publicSchedule *schedule,Castus4publicSchedule::ScheduleItem *item,ModelRecord &m,const long long s,const long long e) {
+	bool ok;
+
+	if (m.end >= 0 && s >= m.end)
+		ok = schedule_set_item_stop_time_us(schedule,item,e) && schedule_set_item_start_time_us(schedule,item,s);
+	else
+		ok = schedule_set_item_start_time_us(schedule,item,s) && schedule_set_item_stop_time_us(schedule,item,e);
+
+	m.start = s;
+	m.end = e;
+	return ok;
+}
+
+int main() {
+	for (unsigned int mode=0;mode < 2;mode++) {
+		const bool ordered = mode == 1;
+		Castus4publicSchedule *schedule = schedule_alloc();
+		std::vector<ModelRecord> items,blocks;
+		std::map<std::string,std::string> globals;
+
+		schedule_init(schedule,C4_SCHED_TYPE_WEEKLY);
+		if (ordered) schedule->set_ordered_items(true);
+
+		for (unsigned int step=0;step < 6000;step++) {
+			const unsigned int op = rnd(100);
+			const char *what;
+
+			if ((op < 30 && items.size() < 300) || items.size() < 3) {
+				what = "add";
+				const int pos = rnd_pos(items.size());
+				Castus4publicSchedule::ScheduleItem *item = schedule_add_item(schedule,pos);
+				ModelRecord m;
+				char tmp[32];
+
+				sprintf(tmp,"%d",next_id++);
+				m.name = tmp;
+				m.start = m.end = -1;
+				schedule_set_item_value(schedule,item,"item",tmp);
+				if (rnd(2)) {
+					const unsigned int k = rnd(3),v = rnd(3);
+					schedule_set_item_value(schedule,item,keys[k],values[v]);
+					m.values[keys[k]] = values[v];
+				}
+
+				long long s,e;
+				rnd_times(s,e);
+				if (rnd(20) == 0) {
+					if (!schedule_set_item_stop_time_us(schedule,item,e)) return 1;
+					m.end = e; /* no start: stays where it was put */
+				}
+				else if (!retime(schedule,item,m,s,e)) {
+					fprintf(stderr,"step %u (%s): retime rejected\n",step,what);
+					return 1;
+				}
+
+				items.insert(items.begin() + clamp_pos(pos,items.size()),m);
+			}
+			else if (op < 40 && items.size() < 300) {
+				what = "copy";
+				const int from = (int)rnd((unsigned int)items.size());
+				Castus4publicSchedule::ScheduleItem *src = schedule_item(schedule,from);
+				const int pos = rnd_pos(items.size());
+				ModelRecord m;
+
+				read_item(src,m);
+				schedule_copy_item(schedule,src,pos);
+				items.insert(items.begin() + clamp_pos(pos,items.size()),m);
+			}
+			else if (op < 55) {
+				what = "erase";
+				const int first = (int)rnd((unsigned int)items.size() + 2) - 1;
+				const int count = (int)rnd(4);
+				const int size = (int)items.size();
+				int want = 0;
+
+				if (ordered) {
+					/* positions follow start order: find what is there through the API */
+					for (int k=0;first >= 0 && k < count && first + k < size;k++) {
+						ModelRecord m;
+						read_item(schedule_item(schedule,first + k),m);
+						items.erase(std::find(items.begin(),items.end(),m));
+						want++;
+					}
+				}
+				else if (first >= 0 && count > 0 && first < size) {
+					want = std::min(count,size - first);
+					items.erase(items.begin() + first,items.begin() + first + want);
+				}
+
+				if (schedule_erase_items(schedule,first,count) != want) {
+					fprintf(stderr,"step %u (%s): erased other than %d items\n",step,what,want);
+					return 1;
+				}
+			}
+			else if (op < 70) {
+				what = "retime";
+				const int pos = (int)rnd((unsigned int)items.size());
+				Castus4publicSchedule::ScheduleItem *item = schedule_item(schedule,pos);
+				ModelRecord old,m;
+				long long s,e;
+
+				read_item(item,old);
+				m = old;
+				rnd_times(s,e);
+				if (!retime(schedule,item,m,s,e)) {
+					fprintf(stderr,"step %u (%s): retime rejected\n",step,what);
+					return 1;
+				}
+				if (ordered) *std::find(items.begin(),items.end(),old) = m; /* copies are alike, any will do */
+				else items[(size_t)pos] = m;
+			}
+			else if (op < 80) {
+				what = "value";
+				const int pos = (int)rnd((unsigned int)items.size());
+				Castus4publicSchedule::ScheduleItem *item = schedule_item(schedule,pos);
+				const unsigned int k = rnd(3),v = rnd(4);
+				ModelRecord old,m;
+
+				read_item(item,old);
+				m = old;
+				if (v == 3) {
+					schedule_set_item_value(schedule,item,keys[k],NULL);
+					m.values.erase(keys[k]);
+				}
+				else {
+					schedule_set_item_value(schedule,item,keys[k],values[v]);
+					m.values[keys[k]] = values[v];
+				}
+				if (ordered) *std::find(items.begin(),items.end(),old) = m; /* copies are alike, any will do */
+				else items[(size_t)pos] = m;
+			}
+			else if (op < 85 && !ordered) {
+				what = "item_set_start_time_us";
+				const int pos = (int)rnd((unsigned int)items.size());
+				Castus4publicSchedule::ScheduleItem *item = schedule_item(schedule,pos);
+				long long s,e;
+
+				rnd_times(s,e);
+				item_set_stop_time_us(item,e);
+				item_set_start_time_us(item,s);
+				items[(size_t)pos].start = s;
+				items[(size_t)pos].end = e;
+			}
+			else if (op < 85) {
+				what = "shift_items"; /* left pending for the next C call to see */
+				const long long from = (long long)rnd(3 * 24) * 3600LL * second;
+				const long long delta = (long long)rnd(60) * 60LL * second;
+
+				schedule->shift_items(from,delta);
+				for (size_t k=0;k < items.size();k++) {
+					if (items[k].start >= from) {
+						items[k].start += delta;
+						items[k].end += delta;
+					}
+				}
+			}
+			else if (op < 92) {
+				what = "block";
+				if (rnd(3) != 0 || blocks.empty()) {
+					const int pos = rnd_pos(blocks.size());
+					Castus4publicSchedule::ScheduleBlock *b = schedule_add_block(schedule,pos);
+					ModelRecord m;
+					char tmp[32];
+
+					sprintf(tmp,"b%d",next_id++);
+					m.name = tmp;
+					rnd_times(m.start,m.end);
+					block_set_value(b,"block",tmp);
+					block_set_start_time_us(b,m.start);
+					block_set_stop_time_us(b,m.end);
+					blocks.insert(blocks.begin() + clamp_pos(pos,blocks.size()),m);
+				}
+				else {
+					const int first = (int)rnd((unsigned int)blocks.size());
+					const int count = 1 + (int)rnd(2);
+					const int want = std::min(count,(int)blocks.size() - first);
+
+					blocks.erase(blocks.begin() + first,blocks.begin() + first + want);
+					if (schedule_erase_blocks(schedule,first,count) != want) {
+						fprintf(stderr,"step %u (%s): erased other than %d blocks\n",step,what,want);
+						return 1;
+					}
+				}
+			}
+			else {
+				what = "global";
+				const char *k = keys[rnd(3)];
+
+				if (rnd(3) == 0) {
+					schedule_delete_global(schedule,k);
+					globals.erase(k);
+				}
+				else {
+					const char *v = values[rnd(3)];
+					schedule_set_global(schedule,k,v);
+					globals[k] = v;
+				}
+			}
+
+			/* the full comparison costs far more than the edit: every few steps, and the count always */
+			if (schedule_item_count(schedule) != (int)items.size()) {
+				fprintf(stderr,"step %u (%s): %d items, expected %zu\n",step,what,schedule_item_count(schedule),items.size());
+				return 1;
+			}
+			if ((step % 4) == 0 && !check(schedule,items,blocks,globals,ordered,step,what)) return 1;
+
+			if ((step % 500) == 499) {
+				Castus4publicSchedule *copy = schedule_alloc();
+				const char *text = schedule_write_out(schedule,NULL);
+
+				if (text == NULL || !schedule_load_from_string(copy,text)) {
+					fprintf(stderr,"step %u: written text did not load\n",step);
+					return 1;
+				}
+				if (!check(copy,items,blocks,globals,ordered,step,"write and load")) return 1;
+				schedule_free(copy);
+			}
+		}
+
+		printf("%s: %zu items, %zu blocks, the C API kept them as the model did\n",
+			ordered ? "ordered" : "unordered",items.size(),blocks.size());
+		schedule_free(schedule);
+	}
+
+	return 0;
+}
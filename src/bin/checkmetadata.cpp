@@ -0,0 +1,313 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+
+#include <castus4-public/metadata.h>
+#include <castus4-public/metadata_writer.h>
+#include <castus4-public/metadata_binary.h>
+
+#include <string>
+#include <vector>
+#include <map>
+
+/* Random metadata for a directory of media files, written in batches through the metadata writer
+ * and checked against the lists given: the text files as parsed from disk, the metadata.bin
+ * sidecars record by record and through to_fields(), and read_metadata(). A text file changed
+ * behind the sidecar must make it stale until update_at(), one changed between add() and
+ * commit() must fail with ESTALE and be left alone, and abort() must leave nothing behind. Run
+ * by "make check", in a temporary directory. */
+
+typedef std::map<std::string,std::string> model_t;
+
+static unsigned int rng_state = 12345;
+
+static unsigned int rnd(const unsigned int n) {
+	rng_state = (rng_state * 1103515245U) + 12345U;
+	return (rng_state >> 8U) % n;
+}
+
+static const char *keys[] = { "duration", "type", "width", "height", "frame rate", "title", "note", "two words" };
+static const char *values[] = { "12.5", "video", "1920", "1080", "30000/1001", "25", "two words", "x=y", "first\nsecond", "not a number" };
+
+static void rnd_model(model_t &m) {
+	m.clear();
+	for (unsigned int i=0,n=rnd(8);i < n;i++) m[keys[rnd(8)]] = values[rnd(10)];
+}
+
+static void remove_tree(const std::string &path) {
+	DIR *dir = opendir(path.c_str());
+	struct dirent *d;
+
+	if (dir != NULL) {
+		while ((d=readdir(dir)) != NULL) {
+			if (!strcmp(d->d_name,".") || !strcmp(d->d_name,"..")) continue;
+			remove_tree(path + "/" + d->d_name);
+		}
+		closedir(dir);
+		rmdir(path.c_str());
+	}
+	else {
+		unlink(path.c_str());
+	}
+}
+
+/* the text file as parsed from disk, whatever the sidecar says */
+static bool read_text(const std::string &path,model_t &out) {
+	castus4public_metadata_list meta;
+	std::string text;
+	char buf[4096];
+	size_t n;
+	FILE *fp;
+
+	if ((fp=fopen(path.c_str(),"r")) == NULL) return false;
+	while ((n=fread(buf,1,sizeof(buf),fp)) > 0) text.append(buf,n);
+	fclose(fp);
+
+	meta.parse_metadata(text);
+	out = meta.list;
+	return true;
+}
+
+/* replace the text file as something that knows nothing of sidecars would: new file, renamed over */
+static bool write_text(const std::string &media,const model_t &m) {
+	const std::string meta_path = castus4public_file_to_metadata_file(media);
+	const std::string tmp_path = meta_path + ".new";
+	castus4public_metadata_list meta;
+	std::string text;
+	FILE *fp;
+
+	mkdir(castus4public_file_to_metadata_dir(media).c_str(),0755);
+	meta.list = m;
+	meta.format_metadata(text);
+	if ((fp=fopen(tmp_path.c_str(),"w")) == NULL) return false;
+	fwrite(text.data(),1,text.size(),fp);
+	if (fclose(fp) != 0) return false;
+
+	return rename(tmp_path.c_str(),meta_path.c_str()) == 0;
+}
+
+static bool same_fields(const castus4public_metadata_fields &a,const castus4public_metadata_fields &b) {
+	return a.duration_us == b.duration_us && a.type == b.type && a.width == b.width && a.height == b.height && a.frame_rate == b.frame_rate;
+}
+
+static bool check(const std::string &media,const model_t &want,const bool sidecar,const char *what) {
+	const std::string meta_path = castus4public_file_to_metadata_file(media);
+	castus4public_metadata_fields want_fields,got_fields;
+	castus4public_metadata_binary bin;
+	castus4public_metadata_list meta;
+	struct stat st;
+	model_t got;
+
+	want_fields.parse(want);
+
+	if (!read_text(meta_path,got) || got != want) {
+		fprintf(stderr,"%s: %s does not hold what was written\n",what,meta_path.c_str());
+		return false;
+	}
+	if (!meta.read_metadata(meta_path.c_str()) || meta.list != want) {
+		fprintf(stderr,"%s: read_metadata() of %s differs\n",what,meta_path.c_str());
+		return false;
+	}
+	if (!castus4public_read_metadata_fields_at(AT_FDCWD,meta_path.c_str(),got_fields) || !same_fields(got_fields,want_fields)) {
+		fprintf(stderr,"%s: fields of %s differ\n",what,meta_path.c_str());
+		return false;
+	}
+
+	if (stat(meta_path.c_str(),&st) != 0) return false;
+	const bool current = bin.open_at(AT_FDCWD,castus4public_metadata_file_to_binary(meta_path).c_str()) && bin.matches(st);
+	if (current != sidecar) {
+		fprintf(stderr,"%s: sidecar of %s is %s, expected %s\n",what,meta_path.c_str(),current ? "current" : "stale",sidecar ? "current" : "stale");
+		return false;
+	}
+	if (!current) return true;
+
+	/* record by record, in key order */
+	if (bin.size() != want.size()) {
+		fprintf(stderr,"%s: sidecar of %s has %zu records, expected %zu\n",what,meta_path.c_str(),bin.size(),want.size());
+		return false;
+	}
+
+	size_t i = 0;
+	for (model_t::const_iterator k=want.begin();k!=want.end();k++,i++) {
+		size_t kl,vl,fl;
+		const char *key = bin.key(i,kl),*value = bin.value(i,vl),*found = bin.find(k->first.c_str(),fl);
+
+		if (std::string(key,kl) != k->first || std::string(value,vl) != k->second || found == NULL || std::string(found,fl) != k->second) {
+			fprintf(stderr,"%s: sidecar of %s record %zu differs\n",what,meta_path.c_str(),i);
+			return false;
+		}
+	}
+
+	size_t fl;
+	if (bin.find("no such key",fl) != NULL) {
+		fprintf(stderr,"%s: sidecar of %s finds a key it does not have\n",what,meta_path.c_str());
+		return false;
+	}
+
+	castus4public_metadata_list list;
+	bin.to_list(list);
+	bin.to_fields(got_fields);
+	if (list.list != want || !same_fields(got_fields,want_fields)) {
+		fprintf(stderr,"%s: sidecar of %s reads back differently\n",what,meta_path.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+int main() {
+	const char *tmpdir = getenv("TMPDIR");
+	std::string base = std::string(tmpdir != NULL && *tmpdir == '/' ? tmpdir : "/tmp") + "/checkmetadata.XXXXXX";
+	std::vector<char> tmpl(base.begin(),base.end());
+	std::vector<std::string> media;
+	std::vector<model_t> model;
+	std::vector<bool> sidecar;
+	size_t written = 0;
+	int ret = 1;
+
+	tmpl.push_back(0);
+	if (mkdtemp(&tmpl[0]) == NULL) {
+		fprintf(stderr,"cannot make a temporary directory: %s\n",strerror(errno));
+		return 1;
+	}
+	base = &tmpl[0];
+
+	for (unsigned int i=0;i < 40;i++) {
+		char tmp[64];
+		FILE *fp;
+
+		sprintf(tmp,"/media %u.mp4",i);
+		media.push_back(base + tmp);
+		if ((fp=fopen(media.back().c_str(),"w")) == NULL) goto out;
+		fclose(fp);
+	}
+	model.resize(media.size());
+	sidecar.resize(media.size(),false);
+
+	for (unsigned int round=0;round < 30;round++) {
+		castus4public_metadata_writer writer;
+		std::vector<size_t> batch;
+		const unsigned int kind = rnd(5);
+
+		for (size_t i=0;i < media.size();i++) {
+			if (rnd(3) == 0) batch.push_back(i);
+		}
+
+		if (kind == 0) {
+			/* one of the batch changed by someone else before the commit */
+			std::vector<model_t> given(batch.size());
+
+			for (size_t b=0;b < batch.size();b++) {
+				castus4public_metadata_list meta;
+				rnd_model(meta.list);
+				writer.add(media[batch[b]],meta);
+				given[b] = meta.list;
+			}
+			if (batch.empty()) continue;
+
+			const size_t victim = batch[rnd((unsigned int)batch.size())];
+			model_t other;
+			rnd_model(other);
+			other["changed by"] = "someone else";
+			if (!write_text(media[victim],other)) goto out;
+			model[victim] = other;
+			sidecar[victim] = false;
+
+			if (writer.commit() || writer.failed.size() != 1 || writer.failed[0].first != media[victim] || writer.failed[0].second != ESTALE) {
+				fprintf(stderr,"round %u: a file changed before commit() did not fail alone with ESTALE\n",round);
+				goto out;
+			}
+			for (size_t b=0;b < batch.size();b++) {
+				if (batch[b] == victim) continue;
+				model[batch[b]] = given[b]; /* the rest went in */
+				sidecar[batch[b]] = true;
+			}
+		}
+		else if (kind == 1) {
+			/* abort(): nothing changes, and no temporary files are left */
+			for (size_t b=0;b < batch.size();b++) {
+				castus4public_metadata_list meta;
+				rnd_model(meta.list);
+				writer.add(media[batch[b]],meta);
+			}
+			writer.abort();
+			if (writer.pending() != 0) goto out;
+		}
+		else if (kind == 2) {
+			/* rewritten without a sidecar, then the sidecar brought up to date */
+			for (size_t b=0;b < batch.size();b++) {
+				const std::string meta_path = castus4public_file_to_metadata_file(media[batch[b]]);
+				model_t m;
+
+				rnd_model(m);
+				if (!write_text(media[batch[b]],m)) goto out;
+				model[batch[b]] = m;
+				sidecar[batch[b]] = false;
+				if (!check(media[batch[b]],model[batch[b]],false,"rewritten")) goto out;
+
+				if (rnd(2)) {
+					if (!castus4public_metadata_binary::update_at(AT_FDCWD,meta_path.c_str())) {
+						fprintf(stderr,"round %u: update_at(%s) failed\n",round,meta_path.c_str());
+						goto out;
+					}
+					sidecar[batch[b]] = true;
+				}
+			}
+		}
+		else {
+			for (size_t b=0;b < batch.size();b++) {
+				castus4public_metadata_list meta;
+
+				rnd_model(meta.list);
+				if (!writer.add(media[batch[b]],meta)) {
+					fprintf(stderr,"round %u: add(%s) failed\n",round,media[batch[b]].c_str());
+					goto out;
+				}
+				model[batch[b]] = meta.list;
+				sidecar[batch[b]] = true;
+			}
+			if (!writer.commit() || !writer.failed.empty()) {
+				fprintf(stderr,"round %u: commit() failed\n",round);
+				goto out;
+			}
+			written += batch.size();
+		}
+
+		for (size_t i=0;i < media.size();i++) {
+			if (castus4public_file_to_metadata_dir(media[i]).empty()) goto out;
+			if (access(castus4public_file_to_metadata_file(media[i]).c_str(),F_OK) != 0) continue; /* not written yet */
+
+			char what[32];
+			sprintf(what,"round %u",round);
+			if (!check(media[i],model[i],sidecar[i],what)) goto out;
+
+			/* nothing but the metadata and its sidecar */
+			DIR *dir = opendir(castus4public_file_to_metadata_dir(media[i]).c_str());
+			struct dirent *d;
+			bool stray = false;
+
+			if (dir == NULL) goto out;
+			while ((d=readdir(dir)) != NULL) {
+				if (strcmp(d->d_name,".") && strcmp(d->d_name,"..") && strcmp(d->d_name,"metadata") && strcmp(d->d_name,"metadata.bin")) {
+					fprintf(stderr,"round %u: %s left in the metadata directory of %s\n",round,d->d_name,media[i].c_str());
+					stray = true;
+				}
+			}
+			closedir(dir);
+			if (stray) goto out;
+		}
+	}
+
+	printf("%zu metadata files written, text and sidecars read back as given\n",written);
+	ret = 0;
+out:
+	remove_tree(base);
+	return ret;
+}
@@ -0,0 +1,144 @@
+#include <sys/types.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/schedule_object.h>
+#include <castus4-public/schedule_aggregate.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <list>
+
+/* Random schedules of ad and programme items, aggregated over advertisement=1 and checked
+ * against a flag per second: window sums over random ranges, wrapping past the end of a daily
+ * schedule, and the worst window against every possible window start. Run by "make check". */
+
+typedef Castus4publicSchedule::ideal_time_t ideal_time_t;
+
+static const ideal_time_t second = 1000000LL;
+static const size_t day = 24 * 3600;	/* seconds */
+
+static unsigned int rng_state = 12345;
+
+static unsigned int rnd(const unsigned int n) {
+	rng_state = (rng_state * 1103515245U) + 12345U;
+	return (rng_state >> 8U) % n;
+}
+
+/* ad seconds in [a,b), past the end wrapping around if the schedule repeats */
+static size_t model_sum(const std::vector<size_t> &prefix,const size_t length,const bool wrap,size_t a,size_t b) {
+	size_t sum = 0;
+
+	if (b <= a) return 0;
+	if (!wrap) {
+		a = std::min(a,length);
+		b = std::min(b,length);
+		return prefix[b] - prefix[a];
+	}
+	if ((b - a) >= length) return prefix[length];
+
+	for (;a < b;) {
+		const size_t s = a % length,e = std::min(length,s + (b - a));
+
+		sum += prefix[e] - prefix[s];
+		a += e - s;
+	}
+
+	return sum;
+}
+
+int main() {
+	const ideal_time_t buckets[] = { second, 7 * second, 60 * second, 3600 * second };
+
+	for (unsigned int round=0;round < 16;round++) {
+		Castus4publicSchedule schedule;
+		Castus4publicScheduleAggregate agg;
+		const bool wrap = (round & 1) == 0;
+		const unsigned int n = 1 + rnd(400);
+		std::vector<unsigned char> ad(day,0);
+		std::vector<size_t> prefix(day + 1,0);
+		size_t length = day,last_end = 0;
+
+		schedule.begin_load();
+		schedule.schedule_type = wrap ? C4_SCHED_TYPE_DAILY : C4_SCHED_TYPE_INTERVAL;
+		schedule.end_load();
+
+		for (unsigned int i=0;i < n;i++) {
+			Castus4publicSchedule::ScheduleItem item(schedule.schedule_type);
+			const unsigned int kind = rnd(3);
+			/* a daily schedule writes 24:00 as 12:00 am, the start of the day, so end before it */
+			const size_t start = (round & 2) ? (size_t)rnd(day / 30 - 1) * 30 : rnd(day - 1);
+			const size_t end = std::min(day - 1,start + 1 + rnd(kind == 0 ? 240 : 1800));
+
+			item.setItem(kind == 0 ? "ad" : "show");
+			item.setStartTime((ideal_time_t)start * second);
+			item.setEndTime((ideal_time_t)end * second);
+			if (kind == 0) item.setValue("advertisement","1");
+			else if (kind == 1) item.setValue("advertisement","0");
+			schedule.schedule_items.push_back(item);
+
+			if (kind == 0) {
+				for (size_t s=start;s < end;s++) ad[s] = 1;
+				last_end = std::max(last_end,end);
+			}
+		}
+
+		for (size_t s=0;s < day;s++) prefix[s+1] = prefix[s] + ad[s];
+		if (!wrap) length = last_end; /* nothing past the last ad counts */
+
+		if (!agg.build(schedule,"advertisement","1",buckets[round % 4])) {
+			fprintf(stderr,"round %u: build failed\n",round);
+			return 1;
+		}
+
+		if (agg.total() != (ideal_time_t)prefix[day] * second) {
+			fprintf(stderr,"round %u: total %lld, expected %lld\n",round,(long long)(agg.total() / second),(long long)prefix[day]);
+			return 1;
+		}
+
+		for (unsigned int q=0;q < 2000;q++) {
+			size_t a = rnd(2 * day),b = a + rnd((q & 1) ? 600 : (unsigned int)day + 60);
+
+			if (!wrap) {
+				a = rnd(day);
+				b = std::min(day,a + rnd((unsigned int)day));
+			}
+
+			const ideal_time_t got = agg.window_sum((ideal_time_t)a * second,(ideal_time_t)b * second);
+			const size_t want = model_sum(prefix,wrap ? day : length,wrap,a,b);
+
+			if (got != (ideal_time_t)want * second) {
+				fprintf(stderr,"round %u: window [%zu,%zu) has %lld ad seconds, expected %zu\n",round,a,b,(long long)(got / second),want);
+				return 1;
+			}
+		}
+
+		for (unsigned int w=0;w < 6;w++) {
+			const size_t window = 1 + rnd(w < 3 ? 900 : 4 * 3600);
+			const size_t starts = wrap ? day : std::max(length,(size_t)1);
+			size_t best = 0;
+			ideal_time_t best_start = -1;
+
+			for (size_t s=0;s < starts;s++)
+				best = std::max(best,model_sum(prefix,wrap ? day : length,wrap,s,s + window));
+
+			const ideal_time_t got = agg.worst_window((ideal_time_t)window * second,&best_start);
+			if (got != (ideal_time_t)best * second) {
+				fprintf(stderr,"round %u: worst %zu second window has %lld ad seconds, expected %zu\n",round,window,(long long)(got / second),best);
+				return 1;
+			}
+			if (best != 0 && (best_start < 0 || (best_start % second) != 0 ||
+				model_sum(prefix,wrap ? day : length,wrap,(size_t)(best_start / second),(size_t)(best_start / second) + window) != best)) {
+				fprintf(stderr,"round %u: worst %zu second window said to start at %lld, which it does not\n",round,window,(long long)best_start);
+				return 1;
+			}
+		}
+	}
+
+	printf("window sums and worst windows match a flag per second\n");
+	return 0;
+}
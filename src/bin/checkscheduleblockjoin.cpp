@@ -0,0 +1,171 @@
+#include <sys/types.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/schedule_object.h>
+#include <castus4-public/schedule_blockjoin.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <list>
+
+/* Random items and blocks (long, short, nested and empty ones, some without times) joined and
+ * checked against every item tested against every block: which block contains it and which it
+ * only overlaps, and per block the item count and the fill and ad time as a flag per minute.
+ * Run by "make check". */
+
+typedef Castus4publicSchedule::ideal_time_t ideal_time_t;
+
+static const ideal_time_t minute = 60LL * 1000000LL;
+static const unsigned int span = 2 * 24 * 60;	/* minutes */
+
+class ModelRecord {
+public:
+	ideal_time_t			start;
+	ideal_time_t			end;
+	bool				ad;
+	const void*			rec;
+};
+
+static bool ModelRecord_start_less(const ModelRecord &a,const ModelRecord &b) {
+	return a.start < b.start;
+}
+
+static unsigned int rng_state = 12345;
+
+static unsigned int rnd(const unsigned int n) {
+	rng_state = (rng_state * 1103515245U) + 12345U;
+	return (rng_state >> 8U) % n;
+}
+
+/* the item has time inside the block, or is an instant inside it */
+static bool overlaps(const ModelRecord &item,const ModelRecord &block) {
+	if (block.start <= item.start) return block.end > item.start;
+	return block.start < item.end;
+}
+
+template <class T> static void collect(const std::list<T> &l,std::vector<ModelRecord> &out) {
+	for (typename std::list<T>::const_iterator i=l.begin();i!=l.end();i++) {
+		const char *v = i->getValue("advertisement");
+		ModelRecord m;
+
+		m.start = i->getStartTime();
+		m.end = i->getEndTime();
+		m.ad = v != NULL && atoi(v) > 0;
+		m.rec = &(*i);
+		if (m.start == Castus4publicSchedule::ideal_time_t_invalid || m.end == Castus4publicSchedule::ideal_time_t_invalid || m.end < m.start)
+			continue;
+		out.push_back(m);
+	}
+	std::stable_sort(out.begin(),out.end(),ModelRecord_start_less);
+}
+
+template <class T> static void randomize(T &rec,const unsigned int shape) {
+	const unsigned int s = rnd(span);
+	unsigned int len;
+
+	if (shape == 0) len = 0;
+	else if (shape == 1) len = 1 + rnd(30);
+	else if (shape == 2) len = 1 + rnd(6 * 60);
+	else len = 1 + rnd(span);	/* long enough to hold most of the rest */
+
+	rec.setStartTime((ideal_time_t)s * minute);
+	rec.setEndTime((ideal_time_t)std::min(span,s + len) * minute);
+}
+
+int main() {
+	size_t pairs = 0;
+
+	for (unsigned int round=0;round < 200;round++) {
+		Castus4publicSchedule schedule;
+		Castus4publicScheduleBlockJoin join;
+		std::vector<ModelRecord> items,blocks;
+
+		schedule.begin_load();
+		schedule.end_load();
+
+		for (unsigned int i=0,n=rnd(300);i < n;i++) {
+			Castus4publicSchedule::ScheduleItem item(schedule.schedule_type);
+
+			item.setItem("x");
+			if (rnd(30) != 0) randomize(item,rnd(10) == 0 ? 0 : 1 + rnd(2));
+			if (rnd(3) == 0) item.setValue("advertisement",rnd(4) ? "1" : "0");
+			schedule.schedule_items.push_back(item);
+		}
+		for (unsigned int i=0,n=rnd(40);i < n;i++) {
+			Castus4publicSchedule::ScheduleBlock block(schedule.schedule_type);
+
+			block.setBlockName("b");
+			if (rnd(30) != 0) randomize(block,rnd(10) == 0 ? 0 : 1 + rnd(3));
+			schedule.schedule_blocks.push_back(block);
+		}
+
+		join.join(schedule);
+		collect(schedule.schedule_items,items);
+		collect(schedule.schedule_blocks,blocks);
+
+		if (join.items.size() != items.size() || join.blocks.size() != blocks.size()) {
+			fprintf(stderr,"round %u: %zu items and %zu blocks joined, expected %zu and %zu\n",
+				round,join.items.size(),join.blocks.size(),items.size(),blocks.size());
+			return 1;
+		}
+
+		std::vector<size_t> count(blocks.size(),0);
+		std::vector<std::vector<unsigned char> > fill(blocks.size(),std::vector<unsigned char>(span,0));
+		std::vector<std::vector<unsigned char> > ad(blocks.size(),std::vector<unsigned char>(span,0));
+
+		for (size_t i=0;i < items.size();i++) {
+			const Castus4publicScheduleBlockJoin::ItemResult &r = join.items[i];
+			std::vector<size_t> partial;
+			long block = -1;
+
+			if (r.item != items[i].rec || r.start != items[i].start || r.end != items[i].end) {
+				fprintf(stderr,"round %u: item %zu is not the one expected in start order\n",round,i);
+				return 1;
+			}
+
+			for (size_t b=0;b < blocks.size();b++) {
+				if (!overlaps(items[i],blocks[b])) continue;
+
+				if (blocks[b].start <= items[i].start && items[i].end <= blocks[b].end && block < 0) block = (long)b;
+				else partial.push_back(b);
+
+				count[b]++;
+				for (ideal_time_t t=std::max(items[i].start,blocks[b].start);t < std::min(items[i].end,blocks[b].end);t += minute) {
+					fill[b][(size_t)(t / minute)] = 1;
+					if (items[i].ad) ad[b][(size_t)(t / minute)] = 1;
+				}
+				pairs++;
+			}
+
+			if (r.block != block || r.partial != partial) {
+				fprintf(stderr,"round %u: item %zu at %lld-%lld in block %ld with %zu partial, expected %ld with %zu\n",
+					round,i,(long long)items[i].start,(long long)items[i].end,r.block,r.partial.size(),block,partial.size());
+				return 1;
+			}
+		}
+
+		for (size_t b=0;b < blocks.size();b++) {
+			const Castus4publicScheduleBlockJoin::BlockResult &br = join.blocks[b];
+			ideal_time_t f = 0,a = 0;
+
+			for (unsigned int m=0;m < span;m++) {
+				if (fill[b][m]) f += minute;
+				if (ad[b][m]) a += minute;
+			}
+
+			if (br.block != blocks[b].rec || br.item_count != count[b] || br.fill != f || br.ad_time != a) {
+				fprintf(stderr,"round %u: block %zu has %zu items, fill %lld, ads %lld, expected %zu, %lld, %lld\n",
+					round,b,br.item_count,(long long)br.fill,(long long)br.ad_time,count[b],(long long)f,(long long)a);
+				return 1;
+			}
+		}
+	}
+
+	printf("%zu item-block overlaps match a test of every pair\n",pairs);
+	return 0;
+}
@@ -0,0 +1,218 @@
+#include <sys/types.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/schedule_object.h>
+#include <castus4-public/schedule_diff.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+
+/* Random schedules and random edits of them (removes, retimes, value changes, adds and
+ * duplicates, with the lists shuffled), diffed and the script applied to a copy of the first,
+ * directly and after a write()/read() round trip. The result must hold the same records as the
+ * edited schedule, compared record by record in a canonical form, and its items must come out in
+ * start order. Run by "make check". */
+
+typedef Castus4publicSchedule::ideal_time_t ideal_time_t;
+
+static const ideal_time_t second = 1000000LL;
+
+static unsigned int rng_state = 12345;
+
+static unsigned int rnd(const unsigned int n) {
+	rng_state = (rng_state * 1103515245U) + 12345U;
+	return (rng_state >> 8U) % n;
+}
+
+/* small alphabets, so equal records and equal start times are common */
+static const char *names[] = { "a", "b", "c", "d" };
+static const char *keys[] = { "note", "advertisement", "in", "out" };
+static const char *values[] = { "0", "1", "2", "x\ny" };
+
+static int next_id = 0;
+
+template <class T> static void randomize(T &rec,const char *name_key) {
+	const ideal_time_t s = (ideal_time_t)rnd(2 * 24 * 60) * 60LL * second;
+
+	rec.setValue(name_key,names[rnd(4)]);
+	rec.setStartTime(s);
+	rec.setEndTime(s + (ideal_time_t)(1 + rnd(180)) * 60LL * second);
+	for (unsigned int k=0,n=rnd(3);k < n;k++) rec.setValue(keys[rnd(4)],values[rnd(4)]);
+	if (rnd(4) == 0) {
+		char tmp[32];
+		sprintf(tmp,"%d",next_id++);
+		rec.setValue("id",tmp);
+	}
+}
+
+template <class T> static void edit(std::list<T> &l,const int schedule_type,const char *name_key) {
+	typename std::list<T>::iterator i = l.begin();
+
+	if (l.empty() || rnd(6) == 0) {
+		T rec(schedule_type);
+		randomize(rec,name_key);
+		l.push_back(rec);
+		return;
+	}
+
+	std::advance(i,rnd((unsigned int)l.size()));
+	switch (rnd(5)) {
+		case 0:
+			l.erase(i);
+			break;
+		case 1: {
+			const ideal_time_t s = (ideal_time_t)rnd(2 * 24 * 60) * 60LL * second;
+			i->setStartTime(s);
+			i->setEndTime(s + (ideal_time_t)(1 + rnd(180)) * 60LL * second);
+			break; }
+		case 2:
+			i->setValue(keys[rnd(4)],values[rnd(4)]);
+			break;
+		case 3:
+			i->deleteValue(keys[rnd(4)]);
+			break;
+		default:
+			l.push_back(*i);
+			break;
+	}
+}
+
+template <class T> static void shuffle(std::list<T> &l) {
+	std::vector<T> v(l.begin(),l.end());
+
+	for (size_t i=v.size();i > 1;i--) std::swap(v[i-1],v[rnd((unsigned int)i)]);
+	l.assign(v.begin(),v.end());
+}
+
+/* a record as start and end in ideal time, then its other values in key order */
+template <class T> static void canonical(const std::list<T> &l,std::vector<std::string> &out) {
+	out.clear();
+	for (typename std::list<T>::const_iterator i=l.begin();i!=l.end();i++) {
+		std::string r;
+		char tmp[64];
+
+		sprintf(tmp,"%lld-%lld",(long long)i->getStartTime(),(long long)i->getEndTime());
+		r = tmp;
+		for (std::map<std::string,std::string>::const_iterator k=i->entry.begin();k!=i->entry.end();k++) {
+			if (k->first == "start" || k->first == "end") continue;
+			r += '|' + k->first + '=' + k->second;
+		}
+		out.push_back(r);
+	}
+	std::sort(out.begin(),out.end());
+}
+
+static bool same_records(const Castus4publicSchedule &a,const Castus4publicSchedule &b) {
+	std::vector<std::string> ca,cb;
+
+	canonical(a.schedule_items,ca);
+	canonical(b.schedule_items,cb);
+	if (ca != cb) return false;
+
+	canonical(a.schedule_blocks,ca);
+	canonical(b.schedule_blocks,cb);
+	return ca == cb;
+}
+
+static bool in_start_order(const Castus4publicSchedule &s) {
+	ideal_time_t last = 0;
+
+	for (std::list<Castus4publicSchedule::ScheduleItem>::const_iterator i=s.schedule_items.begin();i!=s.schedule_items.end();i++) {
+		if (i->getStartTime() < last) return false;
+		last = i->getStartTime();
+	}
+
+	return true;
+}
+
+int main() {
+	size_t ops = 0;
+
+	for (unsigned int round=0;round < 300;round++) {
+		Castus4publicSchedule from;
+		Castus4publicScheduleDiff diff,reread;
+		std::string text;
+
+		from.begin_load();
+		from.end_load();
+		for (unsigned int i=0,n=rnd(120);i < n;i++) {
+			Castus4publicSchedule::ScheduleItem item(from.schedule_type);
+			randomize(item,"item");
+			from.schedule_items.push_back(item);
+		}
+		for (unsigned int i=0,n=rnd(12);i < n;i++) {
+			Castus4publicSchedule::ScheduleBlock block(from.schedule_type);
+			randomize(block,"block");
+			from.schedule_blocks.push_back(block);
+		}
+		from.sort_schedule_items(); /* in start order, as Castus writes them */
+		from.sort_schedule_blocks();
+
+		Castus4publicSchedule to(from);
+		for (unsigned int e=0,n=rnd(40);e < n;e++) {
+			if (rnd(4) == 0) edit(to.schedule_blocks,to.schedule_type,"block");
+			else edit(to.schedule_items,to.schedule_type,"item");
+		}
+		shuffle(to.schedule_items);
+		shuffle(to.schedule_blocks);
+		to.changed();
+
+		if (!diff.compute(from,to)) {
+			fprintf(stderr,"round %u: compute failed\n",round);
+			return 1;
+		}
+		ops += diff.ops.size();
+
+		{
+			Castus4publicSchedule result(from);
+
+			if (!diff.apply(result)) {
+				fprintf(stderr,"round %u: apply failed\n",round);
+				return 1;
+			}
+			if (!same_records(result,to) || !in_start_order(result)) {
+				fprintf(stderr,"round %u: applying %zu ops does not give the edited schedule\n",round,diff.ops.size());
+				return 1;
+			}
+		}
+
+		diff.write(text);
+		if (!reread.read(text)) {
+			fprintf(stderr,"round %u: read back failed:\n%s",round,text.c_str());
+			return 1;
+		}
+
+		{
+			Castus4publicSchedule result(from);
+
+			if (!reread.apply(result) || !same_records(result,to)) {
+				fprintf(stderr,"round %u: script read back does not give the edited schedule:\n%s",round,text.c_str());
+				return 1;
+			}
+		}
+
+		/* no edits, no ops, whatever the order */
+		{
+			Castus4publicSchedule same(from);
+
+			shuffle(same.schedule_items);
+			shuffle(same.schedule_blocks);
+			same.changed();
+			diff.compute(from,same);
+			if (!diff.empty()) {
+				fprintf(stderr,"round %u: %zu ops between a schedule and itself reordered\n",round,diff.ops.size());
+				return 1;
+			}
+		}
+	}
+
+	printf("%zu ops applied, each giving back the edited schedule\n",ops);
+	return 0;
+}
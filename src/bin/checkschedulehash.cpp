@@ -0,0 +1,217 @@
+#include <sys/types.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/schedule_object.h>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+
+/* Schedule content hashes against a direct comparison of the records.
+ *
+ * A random schedule is written out and loaded back twice, once as written and once with its
+ * records and their values shuffled and its times spelled another way: both must hash alike.
+ * Then pairs of small schedules drawn from a tiny alphabet, so that many are equal, must hash
+ * alike exactly when their records (sorted, in a canonical form) and globals are the same. Run
+ * by "make check". */
+
+typedef Castus4publicSchedule::ideal_time_t ideal_time_t;
+
+static const ideal_time_t second = 1000000LL;
+
+static unsigned int rng_state = 12345;
+
+static unsigned int rnd(const unsigned int n) {
+	rng_state = (rng_state * 1103515245U) + 12345U;
+	return (rng_state >> 8U) % n;
+}
+
+template <class T> static void shuffle(std::vector<T> &v) {
+	for (size_t i=v.size();i > 1;i--) std::swap(v[i-1],v[rnd((unsigned int)i)]);
+}
+
+/* "sun 1:00 am" as "sun 1:00:00 am", which reads as the same time */
+static std::string respell(const std::string &line) {
+	const size_t colon = line.find(':'),space = line.rfind(' ');
+
+	if (colon == std::string::npos || line.find(':',colon + 1) != std::string::npos || space == std::string::npos || space < colon)
+		return line;
+
+	return line.substr(0,space) + ":00" + line.substr(space);
+}
+
+/* the text with its records in another order, and each record's values too (the lines of one
+ * multi-line value stay together and in order) */
+static void reorder(const std::string &text,std::vector<std::string> &out) {
+	std::vector<std::vector<std::string> > records;
+	std::vector<std::string> head;
+	std::istringstream in(text);
+	std::string line;
+
+	while (std::getline(in,line)) {
+		if (line == "{" || line == "schedule block {") {
+			std::vector<std::vector<std::string> > values;
+			std::vector<std::string> r;
+
+			r.push_back(line);
+			while (std::getline(in,line) && line != "}") {
+				const std::string key = line.substr(0,line.find('='));
+
+				if (!key.compare(0,6,"\tstart") || !key.compare(0,4,"\tend")) line = respell(line);
+				if (!values.empty() && values.back()[0].substr(0,values.back()[0].find('=')) == key)
+					values.back().push_back(line);
+				else
+					values.push_back(std::vector<std::string>(1,line));
+			}
+
+			shuffle(values);
+			for (size_t i=0;i < values.size();i++) r.insert(r.end(),values[i].begin(),values[i].end());
+			r.push_back("}");
+			records.push_back(r);
+		}
+		else if (records.empty()) {
+			head.push_back(line);
+		}
+	}
+
+	shuffle(records);
+	out = head;
+	for (size_t i=0;i < records.size();i++) out.insert(out.end(),records[i].begin(),records[i].end());
+}
+
+template <class T> static void canonical(const std::list<T> &l,std::vector<std::string> &out) {
+	for (typename std::list<T>::const_iterator i=l.begin();i!=l.end();i++) {
+		std::string r;
+		char tmp[64];
+
+		sprintf(tmp,"%lld-%lld",(long long)i->getStartTime(),(long long)i->getEndTime());
+		r = tmp;
+		for (std::map<std::string,std::string>::const_iterator k=i->entry.begin();k!=i->entry.end();k++) {
+			if (k->first == "start" || k->first == "end") continue;
+			r += '|' + k->first + '=' + k->second;
+		}
+		out.push_back(r);
+	}
+	std::sort(out.begin(),out.end());
+}
+
+static bool same_content(const Castus4publicSchedule &a,const Castus4publicSchedule &b) {
+	std::vector<std::string> ca,cb;
+
+	if (a.schedule_type != b.schedule_type || a.global_values != b.global_values ||
+		a.defaults_type != b.defaults_type || a.defaults_values != b.defaults_values) return false;
+	canonical(a.schedule_items,ca);
+	canonical(b.schedule_items,cb);
+	if (ca != cb) return false;
+
+	ca.clear();
+	cb.clear();
+	canonical(a.schedule_blocks,ca);
+	canonical(b.schedule_blocks,cb);
+	return ca == cb;
+}
+
+template <class T> static void randomize(T &rec,const char *name_key,const unsigned int names,const unsigned int times) {
+	const char *values[] = { "a", "b", "c", "1\n2" };
+	const ideal_time_t s = (ideal_time_t)rnd(times) * 3600LL * second;
+
+	rec.setValue(name_key,values[rnd(names)]);
+	rec.setStartTime(s);
+	rec.setEndTime(s + 1800LL * second);
+}
+
+int main() {
+	for (unsigned int round=0;round < 100;round++) {
+		Castus4publicSchedule schedule,loaded,reloaded;
+		std::vector<std::string> lines;
+		std::ostringstream text;
+
+		schedule.begin_load();
+		schedule.end_load();
+		for (unsigned int i=0,n=rnd(200);i < n;i++) {
+			Castus4publicSchedule::ScheduleItem item(schedule.schedule_type);
+			randomize(item,"item",4,6 * 24);
+			if (rnd(2)) item.setValue("note",rnd(2) ? "x" : "one\ntwo\nthree");
+			schedule.schedule_items.push_back(item);
+		}
+		for (unsigned int i=0,n=rnd(20);i < n;i++) {
+			Castus4publicSchedule::ScheduleBlock block(schedule.schedule_type);
+			randomize(block,"block",4,6 * 24);
+			schedule.schedule_blocks.push_back(block);
+		}
+		if (rnd(2)) schedule.global_values["channel"] = "one";
+
+		schedule.write_out(text);
+		{
+			std::istringstream in(text.str());
+			std::string line;
+
+			loaded.begin_load();
+			while (std::getline(in,line)) loaded.load_take_line(line.c_str());
+			loaded.end_load();
+		}
+
+		reorder(text.str(),lines);
+
+		reloaded.begin_load();
+		for (size_t i=0;i < lines.size();i++) reloaded.load_take_line(lines[i].c_str());
+		reloaded.end_load();
+
+		if (!same_content(loaded,reloaded)) {
+			fprintf(stderr,"round %u: the reordered text does not load back the same records\n",round);
+			return 1;
+		}
+		if (reloaded.content_hash() != loaded.content_hash()) {
+			fprintf(stderr,"round %u: reordered schedule hashes as %016llx, not %016llx\n",round,reloaded.content_hash(),loaded.content_hash());
+			return 1;
+		}
+	}
+
+	/* hash equality is content equality */
+	{
+		std::vector<Castus4publicSchedule> all(300);
+		size_t equal = 0;
+
+		for (size_t s=0;s < all.size();s++) {
+			Castus4publicSchedule &schedule = all[s];
+
+			schedule.begin_load();
+			schedule.end_load();
+			for (unsigned int i=0,n=rnd(4);i < n;i++) {
+				Castus4publicSchedule::ScheduleItem item(schedule.schedule_type);
+				randomize(item,"item",2,2);
+				schedule.schedule_items.push_back(item);
+			}
+			if (rnd(3) == 0) {
+				Castus4publicSchedule::ScheduleBlock block(schedule.schedule_type);
+				randomize(block,"block",2,2);
+				schedule.schedule_blocks.push_back(block);
+			}
+			if (rnd(4) == 0) schedule.global_values["channel"] = "one";
+		}
+
+		for (size_t a=0;a < all.size();a++) {
+			for (size_t b=a+1;b < all.size();b++) {
+				const bool same = same_content(all[a],all[b]);
+
+				if (same != (all[a].content_hash() == all[b].content_hash())) {
+					fprintf(stderr,"schedules %zu and %zu are %s but hash %s\n",a,b,
+						same ? "the same" : "different",same ? "differently" : "alike");
+					return 1;
+				}
+				if (same) equal++;
+			}
+		}
+
+		printf("%zu equal pairs, hashes alike exactly for those\n",equal);
+	}
+
+	return 0;
+}
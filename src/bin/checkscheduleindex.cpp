@@ -0,0 +1,240 @@
+#include <sys/types.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/schedule_object.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <list>
+
+/* Random insert/erase/retime/shift against an ordered schedule, checked after every step
+ * against a plain list of the same items sorted from scratch. Run by "make check". */
+
+typedef Castus4publicSchedule::ideal_time_t ideal_time_t;
+
+static const ideal_time_t second = 1000000LL;
+static const ideal_time_t horizon = 6LL * 24LL * 3600LL * second; /* stay inside one week */
+
+class ModelItem {
+public:
+	ideal_time_t			start;
+	ideal_time_t			end;
+	unsigned long long		seq;		// same start time: first added (or retimed) first
+	int				id;
+};
+
+static bool ModelItem_less(const ModelItem &a,const ModelItem &b) {
+	return a.start < b.start || (a.start == b.start && a.seq < b.seq);
+}
+
+static bool ModelItem_start_less(const ModelItem &a,const ModelItem &b) {
+	return a.start < b.start;
+}
+
+static unsigned int rng_state = 12345;
+
+static unsigned int rnd(const unsigned int n) {
+	rng_state = (rng_state * 1103515245U) + 12345U;
+	return (rng_state >> 8U) % n;
+}
+
+static Castus4publicSchedule::item_iterator find_id(Castus4publicSchedule &schedule,const int id) {
+	char tmp[32];
+
+	sprintf(tmp,"%d",id);
+	for (Castus4publicSchedule::item_iterator i=schedule.schedule_items.begin();i!=schedule.schedule_items.end();i++) {
+		if (!strcmp(i->getItem(),tmp)) return i;
+	}
+
+	return schedule.schedule_items.end();
+}
+
+static bool check(Castus4publicSchedule &schedule,std::vector<ModelItem> &model,const unsigned int step,const char *what,const bool strings) {
+	std::stable_sort(model.begin(),model.end(),ModelItem_less);
+
+	if (schedule.schedule_items.size() != model.size()) {
+		fprintf(stderr,"step %u (%s): %zu items, expected %zu\n",step,what,schedule.schedule_items.size(),model.size());
+		return false;
+	}
+
+	size_t k = 0;
+	for (Castus4publicSchedule::item_iterator i=schedule.schedule_items.begin();i!=schedule.schedule_items.end();i++,k++) {
+		const ideal_time_t s = strings ? i->getStartTime() : schedule.item_start_time(i);
+		const ideal_time_t e = strings ? i->getEndTime() : schedule.item_end_time(i);
+
+		if (atoi(i->getItem()) != model[k].id || s != model[k].start || e != model[k].end) {
+			fprintf(stderr,"step %u (%s): item %zu is %s at %lld-%lld, expected %d at %lld-%lld\n",
+				step,what,k,i->getItem(),(long long)s,(long long)e,
+				model[k].id,(long long)model[k].start,(long long)model[k].end);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main() {
+	Castus4publicSchedule schedule;
+	std::vector<ModelItem> model;
+	unsigned long long next_seq = 0;
+	int next_id = 0;
+
+	schedule.begin_load();
+	schedule.end_load();
+	schedule.set_ordered_items(true);
+
+	for (unsigned int step=0;step < 20000;step++) {
+		const unsigned int op = rnd(100);
+		const char *what;
+		bool strings = false;
+
+		if ((op < 35 && model.size() < 500) || model.size() < 4) {
+			Castus4publicSchedule::ScheduleItem item(schedule.schedule_type);
+			ModelItem m;
+			char tmp[32];
+
+			what = "insert";
+			m.start = (ideal_time_t)rnd(3 * 24 * 60) * 60LL * second; /* whole minutes, so ties are common */
+			m.end = m.start + ((ideal_time_t)(1 + rnd(120)) * 60LL * second);
+			m.seq = next_seq++;
+			m.id = next_id++;
+			sprintf(tmp,"%d",m.id);
+			item.setItem(tmp);
+			item.setStartTime(m.start);
+			item.setEndTime(m.end);
+			schedule.insert_item(item);
+			model.push_back(m);
+		}
+		else if (op < 55) {
+			const size_t k = rnd((unsigned int)model.size());
+
+			what = "erase";
+			schedule.erase_item(find_id(schedule,model[k].id));
+			model.erase(model.begin() + k);
+		}
+		else if (op < 80) {
+			const size_t k = rnd((unsigned int)model.size());
+			const ideal_time_t start = (ideal_time_t)rnd(3 * 24 * 60) * 60LL * second;
+			Castus4publicSchedule::item_iterator i = find_id(schedule,model[k].id);
+			bool ok;
+
+			what = "retime";
+			if (schedule.retime_item(i,-second,Castus4publicSchedule::ideal_time_t_invalid)) {
+				fprintf(stderr,"step %u: retime before the start of the schedule did not fail\n",step);
+				return 1;
+			}
+			if (rnd(2) == 0 && model[k].end >= start) {
+				ok = schedule.retime_item(i,start,Castus4publicSchedule::ideal_time_t_invalid); /* end left alone */
+			}
+			else {
+				model[k].end = start + (model[k].end - model[k].start);
+				ok = schedule.retime_item(i,start,model[k].end);
+			}
+			if (!ok) {
+				fprintf(stderr,"step %u: retime failed\n",step);
+				return 1;
+			}
+			model[k].start = start;
+			model[k].seq = next_seq++;
+		}
+		else if (op < 95) {
+			const ideal_time_t from = (ideal_time_t)rnd(3 * 24 * 60) * 60LL * second;
+			const ideal_time_t delta = ((ideal_time_t)rnd(241) - 120LL) * 60LL * second;
+			bool ok = true;
+
+			what = "shift";
+			for (size_t k=0;k < model.size();k++) {
+				if (model[k].start >= from && (model[k].start + delta < 0 || model[k].end + delta > horizon)) ok = false;
+			}
+			if (!ok) continue;
+
+			if (!schedule.shift_items(from,delta)) {
+				fprintf(stderr,"step %u: shift failed\n",step);
+				return 1;
+			}
+			for (size_t k=0;k < model.size();k++) {
+				if (model[k].start >= from) {
+					model[k].start += delta;
+					model[k].end += delta;
+				}
+			}
+		}
+		else if (op < 97) {
+			/* retimed behind the index's back: only sort_schedule_items() can notice */
+			const size_t k = rnd((unsigned int)model.size());
+			const ideal_time_t start = (ideal_time_t)rnd(3 * 24 * 60) * 60LL * second;
+			Castus4publicSchedule::item_iterator i = find_id(schedule,model[k].id);
+
+			what = "setStartTime";
+			schedule.apply_time_shifts();
+			i->setStartTime(start);
+			i->setEndTime(start + (model[k].end - model[k].start));
+			schedule.sort_schedule_items();
+
+			/* unless the time is the same, a stable sort by start time of the order the list
+			 * was in, and an index rebuilt from it */
+			if (start != model[k].start) {
+				std::stable_sort(model.begin(),model.end(),ModelItem_less);
+				for (size_t q=0;q < model.size();q++) {
+					if (model[q].id == atoi(i->getItem())) {
+						model[q].end = start + (model[q].end - model[q].start);
+						model[q].start = start;
+					}
+				}
+				std::stable_sort(model.begin(),model.end(),ModelItem_start_less);
+				for (size_t q=0;q < model.size();q++) model[q].seq = next_seq++;
+			}
+			strings = true;
+		}
+		else {
+			/* the list edited directly, with the item count unchanged */
+			const size_t k = rnd((unsigned int)model.size());
+			Castus4publicSchedule::ScheduleItem item(schedule.schedule_type);
+			ModelItem m;
+			char tmp[32];
+
+			what = "erase+push_back"; /* with shifts still pending */
+			schedule.schedule_items.erase(find_id(schedule,model[k].id));
+			model.erase(model.begin() + k);
+
+			m.start = (ideal_time_t)rnd(3 * 24 * 60) * 60LL * second;
+			m.end = m.start + (60LL * second);
+			m.seq = next_seq++;
+			m.id = next_id++;
+			sprintf(tmp,"%d",m.id);
+			item.setItem(tmp);
+			item.setStartTime(m.start);
+			item.setEndTime(m.end);
+			schedule.schedule_items.push_back(item);
+			schedule.changed(); /* as code editing the list directly must */
+			model.push_back(m);
+
+			/* the next index operation has to notice, and not follow the erased item's node.
+			 * It rebuilds the index from the list, which numbers the items afresh. */
+			std::stable_sort(model.begin(),model.end(),ModelItem_less);
+			for (size_t q=0;q < model.size();q++) model[q].seq = next_seq++;
+
+			m.seq = next_seq++;
+			m.id = next_id++;
+			sprintf(tmp,"%d",m.id);
+			item.setItem(tmp);
+			schedule.insert_item(item);
+			model.push_back(m);
+		}
+
+		if (!check(schedule,model,step,what,strings)) return 1;
+
+		if ((step % 1000) == 999) {
+			schedule.apply_time_shifts();
+			if (!check(schedule,model,step,"apply_time_shifts",true)) return 1;
+		}
+	}
+
+	printf("%zu items, ordered index matches a full sort\n",model.size());
+	return 0;
+}
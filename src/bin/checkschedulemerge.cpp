@@ -0,0 +1,178 @@
+#include <sys/types.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/schedule_object.h>
+#include <castus4-public/schedule_merge.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <list>
+
+/* Random sets of schedules, some kept ordered and shifted after being added, merged and checked
+ * against one stable sort of every source's items by (start, source, list position), with each
+ * item's start against the time it was given plus the shifts it should have had. materialize()
+ * must copy that order and tag each item with its source. Run by "make check". */
+
+typedef Castus4publicSchedule::ideal_time_t ideal_time_t;
+
+static const ideal_time_t second = 1000000LL;
+
+class ModelItem {
+public:
+	ideal_time_t			start;
+	size_t				source;
+	size_t				pos;
+	const Castus4publicSchedule::ScheduleItem*	item;
+};
+
+static bool ModelItem_less(const ModelItem &a,const ModelItem &b) {
+	if (a.start != b.start) return a.start < b.start;
+	if (a.source != b.source) return a.source < b.source;
+	return a.pos < b.pos;
+}
+
+static unsigned int rng_state = 12345;
+
+static unsigned int rnd(const unsigned int n) {
+	rng_state = (rng_state * 1103515245U) + 12345U;
+	return (rng_state >> 8U) % n;
+}
+
+int main() {
+	size_t total = 0;
+
+	for (unsigned int round=0;round < 200;round++) {
+		const size_t count = 1 + rnd(6);
+		std::vector<Castus4publicSchedule> sources(count);
+		std::vector<std::vector<ideal_time_t> > expect(count);	/* by item id, -1 for no start */
+		Castus4publicScheduleMerge merge;
+		std::vector<Castus4publicScheduleMerge::Entry> out;
+		std::vector<ModelItem> model;
+
+		for (size_t s=0;s < count;s++) {
+			Castus4publicSchedule &schedule = sources[s];
+			char name[32];
+
+			schedule.begin_load();
+			schedule.end_load();
+			if (rnd(2)) schedule.set_ordered_items(true);
+
+			for (unsigned int i=0,n=rnd(150);i < n;i++) {
+				Castus4publicSchedule::ScheduleItem item(schedule.schedule_type);
+				ideal_time_t start = (ideal_time_t)rnd(3 * 24 * 4) * 15LL * 60LL * second; /* quarter hours, ties are common */
+				char tmp[32];
+
+				sprintf(tmp,"%u",i);
+				item.setItem(tmp);
+				if (rnd(20) == 0) {
+					start = Castus4publicSchedule::ideal_time_t_invalid;
+				}
+				else {
+					item.setStartTime(start);
+					item.setEndTime(start + 15LL * 60LL * second);
+				}
+				schedule.insert_item(item);
+				expect[s].push_back(start);
+			}
+
+			sprintf(name,"src%zu",s);
+			merge.add(schedule,(s & 1) ? std::string(name) : std::string());
+		}
+
+		/* shifts after add(), left pending on ordered sources */
+		for (size_t s=0;s < count;s++) {
+			if (!sources[s].ordered_items() || rnd(2) == 0) continue;
+
+			const ideal_time_t from = (ideal_time_t)rnd(3 * 24) * 3600LL * second;
+			const ideal_time_t delta = (ideal_time_t)rnd(120) * 60LL * second;
+
+			sources[s].shift_items(from,delta);
+			for (size_t i=0;i < expect[s].size();i++) {
+				if (expect[s][i] != Castus4publicSchedule::ideal_time_t_invalid && expect[s][i] >= from) expect[s][i] += delta;
+			}
+		}
+
+		merge.merge(out);
+
+		for (size_t s=0;s < count;s++) {
+			size_t pos = 0;
+
+			for (std::list<Castus4publicSchedule::ScheduleItem>::const_iterator i=sources[s].schedule_items.begin();i!=sources[s].schedule_items.end();i++,pos++) {
+				ModelItem m;
+
+				m.start = expect[s][(size_t)atoi(i->getItem())];
+				m.source = s;
+				m.pos = pos;
+				m.item = &(*i);
+				if (m.start != i->getStartTime()) {
+					fprintf(stderr,"round %u: source %zu item %s starts at %lld, expected %lld\n",
+						round,s,i->getItem(),(long long)i->getStartTime(),(long long)m.start);
+					return 1;
+				}
+				model.push_back(m);
+			}
+		}
+		std::stable_sort(model.begin(),model.end(),ModelItem_less);
+
+		if (out.size() != model.size()) {
+			fprintf(stderr,"round %u: %zu items merged, expected %zu\n",round,out.size(),model.size());
+			return 1;
+		}
+		for (size_t k=0;k < out.size();k++) {
+			if (out[k].item != model[k].item || out[k].source != model[k].source || out[k].start != model[k].start ||
+				out[k].end != model[k].item->getEndTime()) {
+				fprintf(stderr,"round %u: entry %zu is source %zu item %s at %lld, expected source %zu item %s at %lld\n",
+					round,k,out[k].source,out[k].item->getItem(),(long long)out[k].start,
+					model[k].source,model[k].item->getItem(),(long long)model[k].start);
+				return 1;
+			}
+		}
+		total += out.size();
+
+		{
+			Castus4publicSchedule m;
+
+			if (!merge.materialize(m)) {
+				fprintf(stderr,"round %u: materialize failed\n",round);
+				return 1;
+			}
+
+			size_t k = 0;
+			for (std::list<Castus4publicSchedule::ScheduleItem>::const_iterator i=m.schedule_items.begin();i!=m.schedule_items.end();i++,k++) {
+				const char *tag = i->getValue("source");
+
+				if (k >= model.size() || strcmp(i->getItem(),model[k].item->getItem()) != 0 || i->getStartTime() != model[k].start ||
+					tag == NULL || merge.names[model[k].source] != tag) {
+					fprintf(stderr,"round %u: materialized item %zu does not match the merge\n",round,k);
+					return 1;
+				}
+			}
+			if (k != model.size()) {
+				fprintf(stderr,"round %u: %zu items materialized, expected %zu\n",round,k,model.size());
+				return 1;
+			}
+		}
+
+		/* only like with like */
+		if (count > 1) {
+			Castus4publicSchedule daily,m;
+
+			daily.begin_load();
+			daily.schedule_type = C4_SCHED_TYPE_DAILY;
+			daily.end_load();
+			merge.add(daily);
+			if (merge.materialize(m)) {
+				fprintf(stderr,"round %u: weekly and daily schedules materialized together\n",round);
+				return 1;
+			}
+		}
+	}
+
+	printf("%zu items merged in the order of one stable sort\n",total);
+	return 0;
+}
@@ -0,0 +1,144 @@
+#include <sys/types.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/schedule_object.h>
+#include <castus4-public/schedule_occupancy.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <list>
+
+/* Random schedules, and random retimes applied through update(), checked against a plain count
+ * per second: every slot's count, and coverage queries over random ranges. Run by "make check". */
+
+typedef Castus4publicSchedule::ideal_time_t ideal_time_t;
+
+static const ideal_time_t second = 1000000LL;
+static const size_t timeline = 2 * 24 * 3600;	/* seconds */
+
+class ModelItem {
+public:
+	size_t				start;		/* seconds */
+	size_t				end;
+};
+
+static unsigned int rng_state = 12345;
+
+static unsigned int rnd(const unsigned int n) {
+	rng_state = (rng_state * 1103515245U) + 12345U;
+	return (rng_state >> 8U) % n;
+}
+
+static void model_count(const std::vector<ModelItem> &items,std::vector<unsigned int> &count) {
+	count.assign(timeline,0);
+	for (size_t i=0;i < items.size();i++)
+		for (size_t s=items[i].start;s < items[i].end;s++) count[s]++;
+}
+
+static bool check(const Castus4publicScheduleOccupancy &occ,const std::vector<ModelItem> &items,const unsigned int round,const char *what) {
+	std::vector<unsigned int> count;
+	size_t total = 0;
+
+	model_count(items,count);
+
+	if (occ.slots != timeline) {
+		fprintf(stderr,"round %u (%s): %zu slots, expected %zu\n",round,what,occ.slots,timeline);
+		return false;
+	}
+	for (size_t s=0;s < timeline;s++) {
+		if (occ.count[s] != count[s]) {
+			fprintf(stderr,"round %u (%s): slot %zu counted %u, expected %u\n",round,what,s,(unsigned int)occ.count[s],count[s]);
+			return false;
+		}
+		if (count[s] != 0) total++;
+	}
+	if (occ.covered_time() != (ideal_time_t)total * second) {
+		fprintf(stderr,"round %u (%s): covered %lld, expected %lld\n",round,what,(long long)occ.covered_time(),(long long)total * second);
+		return false;
+	}
+
+	for (unsigned int q=0;q < 200;q++) {
+		size_t a = rnd(timeline),b = rnd(timeline + 1);
+		size_t covered = 0,doubled = 0;
+
+		if (a > b) std::swap(a,b);
+		if (q & 1) b = std::min(timeline,a + rnd(200)); /* short ranges, within one or two words */
+		for (size_t s=a;s < b;s++) {
+			if (count[s] >= 1) covered++;
+			if (count[s] >= 2) doubled++;
+		}
+
+		const ideal_time_t ta = (ideal_time_t)a * second,tb = (ideal_time_t)b * second;
+		const ideal_time_t c = occ.covered_time(ta,tb),d = occ.double_booked_time(ta,tb);
+		const bool u = occ.any_uncovered(ta,tb),o = occ.any_double_booked(ta,tb);
+
+		if (c != (ideal_time_t)covered * second || d != (ideal_time_t)doubled * second ||
+			u != (covered != (b - a)) || o != (doubled != 0)) {
+			fprintf(stderr,"round %u (%s): [%zu,%zu) covered %lld doubled %lld uncovered %d double booked %d, expected %zu %zu %d %d\n",
+				round,what,a,b,(long long)(c / second),(long long)(d / second),u,o,
+				covered,doubled,covered != (b - a),doubled != 0);
+			return false;
+		}
+	}
+
+	/* past the end of the timeline nothing is covered */
+	if (!occ.any_uncovered(0,(ideal_time_t)(timeline + 1) * second)) {
+		fprintf(stderr,"round %u (%s): range past the end reported covered\n",round,what);
+		return false;
+	}
+
+	return true;
+}
+
+int main() {
+	for (unsigned int round=0;round < 20;round++) {
+		Castus4publicSchedule schedule;
+		Castus4publicScheduleOccupancy occ;
+		std::vector<ModelItem> items;
+		const unsigned int n = 1 + rnd(300);
+
+		schedule.begin_load();
+		schedule.end_load();
+
+		for (unsigned int i=0;i < n;i++) {
+			Castus4publicSchedule::ScheduleItem item(schedule.schedule_type);
+			ModelItem m;
+
+			/* whole minutes in some rounds, so ends meet starts exactly */
+			if (round & 1) m.start = (size_t)rnd((unsigned int)(timeline / 60)) * 60;
+			else m.start = rnd((unsigned int)timeline);
+			m.end = std::min(timeline,m.start + 1 + rnd(2 * 3600));
+
+			item.setItem("x");
+			item.setStartTime((ideal_time_t)m.start * second);
+			item.setEndTime((ideal_time_t)m.end * second);
+			schedule.schedule_items.push_back(item);
+			items.push_back(m);
+		}
+
+		if (!occ.build(schedule,Castus4publicScheduleOccupancy::Items,second,(ideal_time_t)timeline * second)) {
+			fprintf(stderr,"round %u: build failed\n",round);
+			return 1;
+		}
+		if (!check(occ,items,round,"build")) return 1;
+
+		for (unsigned int step=0;step < 50;step++) {
+			ModelItem &m = items[rnd((unsigned int)items.size())];
+			const ModelItem old = m;
+
+			m.start = rnd((unsigned int)timeline);
+			m.end = std::min(timeline,m.start + 1 + rnd(2 * 3600));
+			occ.update((ideal_time_t)old.start * second,(ideal_time_t)old.end * second,
+				(ideal_time_t)m.start * second,(ideal_time_t)m.end * second);
+		}
+		if (!check(occ,items,round,"update")) return 1;
+	}
+
+	printf("occupancy counts and coverage queries match a count per second\n");
+	return 0;
+}
@@ -0,0 +1,350 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/schedule_object.h>
+#include <castus4-public/schedule_refindex.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+
+/* Random schedules of every type, written to a temporary directory and naming their media in
+ * several spellings (symlinks, "./", doubled slashes, files that are gone), indexed and checked
+ * against every schedule's items searched at lookup time: which schedules play each file, how
+ * often, and the time to the next airing worked out from the clock for daily, weekly and
+ * monthly schedules, at times that include month ends and a leap day. The schedules are then
+ * rewritten and dropped, and the index saved and loaded back, checking again each time. Run by
+ * "make check", in UTC. */
+
+typedef Castus4publicSchedule::ideal_time_t ideal_time_t;
+
+static const ideal_time_t second = 1000000LL;
+static const ideal_time_t day = 24LL * 3600LL * second;
+
+class ModelItem {
+public:
+	std::string			media;		/* canonical */
+	ideal_time_t			start;
+};
+
+class ModelSchedule {
+public:
+	std::string			path;		/* canonical */
+	int				type;
+	std::vector<ModelItem>		items;
+};
+
+static unsigned int rng_state = 12345;
+
+static unsigned int rnd(const unsigned int n) {
+	rng_state = (rng_state * 1103515245U) + 12345U;
+	return (rng_state >> 8U) % n;
+}
+
+static std::string base;
+static std::string real_base;
+static std::vector<std::string> media;		/* canonical */
+static std::vector<std::vector<std::string> > spellings;	/* per media file, as items may name it */
+
+static void remove_tree(const std::string &path) {
+	DIR *dir = opendir(path.c_str());
+	struct dirent *d;
+
+	if (dir != NULL) {
+		while ((d=readdir(dir)) != NULL) {
+			if (!strcmp(d->d_name,".") || !strcmp(d->d_name,"..")) continue;
+			remove_tree(path + "/" + d->d_name);
+		}
+		closedir(dir);
+		rmdir(path.c_str());
+	}
+	else {
+		unlink(path.c_str());
+	}
+}
+
+static int days_in_month(const struct tm &tm) {
+	static const int days[12] = { 31,28,31,30,31,30,31,31,30,31,30,31 };
+	const int year = tm.tm_year + 1900;
+
+	if (tm.tm_mon == 1 && (year % 4) == 0 && ((year % 100) != 0 || (year % 400) == 0)) return 29;
+	return days[tm.tm_mon];
+}
+
+/* written to a new file renamed over the old, so the index sees a new file every time */
+static bool write_schedule(ModelSchedule &s,const std::string &path) {
+	Castus4publicSchedule schedule;
+	const std::string tmp = path + ".new";
+	FILE *fp;
+
+	schedule.begin_load();
+	schedule.schedule_type = s.type;
+	schedule.end_load();
+
+	s.items.clear();
+	for (unsigned int i=0,n=rnd(60);i < n;i++) {
+		Castus4publicSchedule::ScheduleItem item(schedule.schedule_type);
+		const size_t m = rnd((unsigned int)media.size());
+		const std::vector<std::string> &sp = spellings[m];
+		ModelItem mi;
+
+		if (s.type == C4_SCHED_TYPE_DAILY) mi.start = (ideal_time_t)rnd(24 * 60) * 60LL * second;
+		else if (s.type == C4_SCHED_TYPE_WEEKLY) mi.start = (ideal_time_t)rnd(7 * 24 * 60) * 60LL * second;
+		else if (s.type == C4_SCHED_TYPE_MONTHLY) mi.start = (ideal_time_t)rnd(31) * day + (ideal_time_t)rnd(24 * 60) * 60LL * second;
+		else mi.start = (ideal_time_t)rnd(28) * day;
+
+		item.setItem(sp[rnd((unsigned int)sp.size())]);
+		if (rnd(15) == 0) {
+			mi.start = Castus4publicSchedule::ideal_time_t_invalid;
+		}
+		else {
+			item.setStartTime(mi.start);
+			item.setEndTime(mi.start + 60LL * second);
+		}
+		mi.media = media[m];
+		schedule.schedule_items.push_back(item);
+		s.items.push_back(mi);
+	}
+
+	if ((fp=fopen(tmp.c_str(),"w")) == NULL) return false;
+	schedule.write_out(fp);
+	if (fclose(fp) != 0) return false;
+	return rename(tmp.c_str(),path.c_str()) == 0;
+}
+
+/* the expected answer from the schedules themselves */
+static void model_lookup(const std::map<std::string,ModelSchedule> &schedules,const std::string &m,const time_t now,
+	std::vector<Castus4publicScheduleRefIndex::Reference> &out) {
+	struct tm tm;
+
+	gmtime_r(&now,&tm);
+	out.clear();
+
+	for (std::map<std::string,ModelSchedule>::const_iterator s=schedules.begin();s!=schedules.end();s++) {
+		Castus4publicScheduleRefIndex::Reference ref;
+		const ideal_time_t clock = ((ideal_time_t)tm.tm_hour * 3600LL + (ideal_time_t)tm.tm_min * 60LL + (ideal_time_t)tm.tm_sec) * second;
+		ideal_time_t t = 0,length = 0;
+
+		ref.schedule = s->second.path;
+		ref.count = 0;
+		ref.until = Castus4publicSchedule::ideal_time_t_invalid;
+
+		if (s->second.type == C4_SCHED_TYPE_DAILY) { t = clock; length = day; }
+		else if (s->second.type == C4_SCHED_TYPE_WEEKLY) { t = (ideal_time_t)tm.tm_wday * day + clock; length = 7 * day; }
+		else if (s->second.type == C4_SCHED_TYPE_MONTHLY) t = (ideal_time_t)(tm.tm_mday - 1) * day + clock;
+
+		for (size_t i=0;i < s->second.items.size();i++) {
+			const ModelItem &it = s->second.items[i];
+			ideal_time_t until = Castus4publicSchedule::ideal_time_t_invalid;
+
+			if (it.media != m) continue;
+			ref.count++;
+			if (it.start == Castus4publicSchedule::ideal_time_t_invalid) continue;
+
+			if (length > 0)
+				until = (it.start >= t) ? it.start - t : it.start + length - t;
+			else if (s->second.type == C4_SCHED_TYPE_MONTHLY && it.start >= t && it.start / day < days_in_month(tm))
+				until = it.start - t;
+
+			if (until != Castus4publicSchedule::ideal_time_t_invalid && (ref.until == Castus4publicSchedule::ideal_time_t_invalid || until < ref.until))
+				ref.until = until;
+		}
+
+		if (ref.count != 0) out.push_back(ref);
+	}
+}
+
+static bool check(const Castus4publicScheduleRefIndex &index,const std::map<std::string,ModelSchedule> &schedules,
+	const std::vector<time_t> &nows,const char *what) {
+	std::vector<Castus4publicScheduleRefIndex::Reference> got,want;
+	size_t referenced = 0;
+
+	if (index.schedule_count() != schedules.size()) {
+		fprintf(stderr,"%s: %zu schedules indexed, expected %zu\n",what,index.schedule_count(),schedules.size());
+		return false;
+	}
+
+	for (size_t m=0;m < media.size();m++) {
+		for (size_t n=0;n < nows.size();n++) {
+			const std::vector<std::string> &sp = spellings[m];
+			const std::string &asked = sp[rnd((unsigned int)sp.size())];
+
+			index.lookup(asked,got,nows[n]);
+			model_lookup(schedules,media[m],nows[n],want);
+
+			bool same = got.size() == want.size();
+			for (size_t i=0;same && i < got.size();i++) {
+				same = got[i].schedule == want[i].schedule && got[i].count == want[i].count && got[i].until == want[i].until;
+			}
+			if (!same) {
+				fprintf(stderr,"%s: lookup of %s at %lld found %zu schedules, expected %zu\n",what,asked.c_str(),(long long)nows[n],got.size(),want.size());
+				for (size_t i=0;i < got.size() || i < want.size();i++) {
+					if (i < got.size()) fprintf(stderr,"  got %s x%zu in %lld\n",got[i].schedule.c_str(),got[i].count,(long long)got[i].until);
+					if (i < want.size()) fprintf(stderr,"  want %s x%zu in %lld\n",want[i].schedule.c_str(),want[i].count,(long long)want[i].until);
+				}
+				return false;
+			}
+
+			if (index.referenced(asked) != !want.empty() || (!want.empty() && !index.maybe_referenced(asked))) {
+				fprintf(stderr,"%s: %s said to be %sreferenced\n",what,asked.c_str(),want.empty() ? "" : "not ");
+				return false;
+			}
+			if (n == 0 && !want.empty()) referenced++;
+		}
+	}
+
+	if (index.media_count() != referenced) {
+		fprintf(stderr,"%s: %zu media indexed, expected %zu\n",what,index.media_count(),referenced);
+		return false;
+	}
+
+	return true;
+}
+
+int main() {
+	const char *tmpdir = getenv("TMPDIR");
+	std::vector<char> tmpl;
+	std::map<std::string,ModelSchedule> schedules;	/* by canonical path */
+	std::vector<std::string> paths;			/* as given to the index */
+	std::vector<time_t> nows;
+	Castus4publicScheduleRefIndex index;
+	int ret = 1;
+	char *r;
+
+	setenv("TZ","UTC",1);
+	tzset();
+
+	base = std::string(tmpdir != NULL && *tmpdir == '/' ? tmpdir : "/tmp") + "/checkschedulerefindex.XXXXXX";
+	tmpl.assign(base.begin(),base.end());
+	tmpl.push_back(0);
+	if (mkdtemp(&tmpl[0]) == NULL) {
+		fprintf(stderr,"cannot make a temporary directory: %s\n",strerror(errno));
+		return 1;
+	}
+	base = &tmpl[0];
+	if ((r=realpath(base.c_str(),NULL)) == NULL) goto out;
+	real_base = r;
+	free(r);
+
+	if (mkdir((base + "/media").c_str(),0700) || symlink("media",(base + "/link").c_str())) goto out;
+	for (unsigned int i=0;i < 24;i++) {
+		std::vector<std::string> sp;
+		char name[32];
+		FILE *fp;
+
+		sprintf(name,"clip %u.mp4",i);
+		if (i < 20) {
+			if ((fp=fopen((base + "/media/" + name).c_str(),"w")) == NULL) goto out;
+			fclose(fp);
+		}
+		/* the last few are gone: still one file however they are named */
+		media.push_back(real_base + "/media/" + name);
+		sp.push_back(base + "/media/" + name);
+		sp.push_back(base + "/link/" + name);
+		sp.push_back(base + "/media/./" + name);
+		sp.push_back(base + "//media/" + name);
+		spellings.push_back(sp);
+	}
+
+	{
+		const int types[] = { C4_SCHED_TYPE_DAILY, C4_SCHED_TYPE_WEEKLY, C4_SCHED_TYPE_MONTHLY, C4_SCHED_TYPE_YEARLY };
+
+		for (unsigned int i=0;i < 10;i++) {
+			char name[32];
+			ModelSchedule s;
+
+			sprintf(name,"/channel%u.schedule",i);
+			s.path = real_base + name;
+			s.type = types[i % 4];
+			if (!write_schedule(s,base + name)) goto out;
+			schedules[s.path] = s;
+			paths.push_back((i & 1) ? base + "/." + name : base + name);
+		}
+	}
+
+	{
+		/* month ends (a 30 and a 31 day month), a leap day, a year end, and random times */
+		const time_t fixed[] = { 1777593599, 1777593600, 1780228800, 1709164800, 1709251199, 1798761599 };
+
+		nows.assign(fixed,fixed + sizeof(fixed) / sizeof(fixed[0]));
+		for (unsigned int i=0;i < 6;i++) nows.push_back(1767225600 + (time_t)rnd(365 * 24 * 60) * 60 + (time_t)rnd(60));
+	}
+
+	if (!index.update_all(paths)) {
+		fprintf(stderr,"update_all() failed\n");
+		goto out;
+	}
+	if (!check(index,schedules,nows,"first index")) goto out;
+
+	for (unsigned int round=0;round < 10;round++) {
+		char what[32];
+
+		/* rewrite some schedules, now and then drop one */
+		for (size_t i=0;i < paths.size();i++) {
+			if (rnd(3) != 0) continue;
+
+			char *c = realpath(paths[i].c_str(),NULL);
+			if (c == NULL) continue;
+			ModelSchedule &s = schedules[c];
+			free(c);
+			if (!write_schedule(s,paths[i])) goto out;
+		}
+
+		if (rnd(4) == 0 && paths.size() > 1) {
+			const size_t drop = rnd((unsigned int)paths.size());
+			char *c = realpath(paths[drop].c_str(),NULL);
+
+			if (c == NULL) goto out;
+			schedules.erase(c);
+			free(c);
+			if (rnd(2)) {
+				paths.erase(paths.begin() + drop);	/* no longer listed */
+			}
+			else {
+				unlink(paths[drop].c_str());		/* gone from disk */
+				paths.erase(paths.begin() + drop);
+			}
+		}
+
+		if (!index.update_all(paths)) {
+			fprintf(stderr,"round %u: update_all() failed\n",round);
+			goto out;
+		}
+		sprintf(what,"round %u",round);
+		if (!check(index,schedules,nows,what)) goto out;
+	}
+
+	{
+		Castus4publicScheduleRefIndex loaded;
+		const std::string saved = base + "/refindex";
+
+		if (!index.save(saved.c_str()) || !loaded.load(saved.c_str())) {
+			fprintf(stderr,"save() and load() failed\n");
+			goto out;
+		}
+		if (!check(loaded,schedules,nows,"saved and loaded")) goto out;
+
+		/* nothing changed on disk: nothing to reload */
+		if (!loaded.update_all(paths) || loaded.dirty) {
+			fprintf(stderr,"loaded index reloaded unchanged schedules\n");
+			goto out;
+		}
+	}
+
+	printf("%zu schedules, lookups match a search of every item\n",schedules.size());
+	ret = 0;
+out:
+	remove_tree(base);
+	return ret;
+}
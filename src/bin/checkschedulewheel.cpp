@@ -0,0 +1,223 @@
+#include <sys/types.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/schedule_object.h>
+#include <castus4-public/schedule_wheel.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <list>
+
+/* Random schedules dispatched from the timing wheel in random steps, with the schedule edited
+ * and reloaded in between, checked against a sorted list of every start and end still to come:
+ * each advance() must dispatch exactly the events due, in time order with ends first, and
+ * next_time() must name the earliest left. Resolutions from a microsecond to a second and a far
+ * origin put events on every level and the overflow list. Run by "make check". */
+
+typedef Castus4publicSchedule::ideal_time_t ideal_time_t;
+typedef Castus4publicScheduleTimingWheel Wheel;
+
+static const ideal_time_t second = 1000000LL;
+static const ideal_time_t horizon = 6LL * 24LL * 3600LL * second; /* stay inside one week */
+
+class ModelEvent {
+public:
+	ideal_time_t			time;
+	int				type;
+	std::string			name;
+};
+
+static bool ModelEvent_less(const ModelEvent &a,const ModelEvent &b) {
+	if (a.time != b.time) return a.time < b.time;
+	if (a.type != b.type) return a.type < b.type;
+	return a.name < b.name;
+}
+
+static unsigned int rng_state = 12345;
+
+static unsigned int rnd(const unsigned int n) {
+	rng_state = (rng_state * 1103515245U) + 12345U;
+	return (rng_state >> 8U) % n;
+}
+
+static ideal_time_t rnd_time() {
+	const ideal_time_t coarse = (ideal_time_t)rnd(6 * 24 * 60) * 60LL * second;	/* whole minutes, ties are common */
+	return (rnd(2) == 0) ? coarse : coarse + (ideal_time_t)rnd(60000) * 1000LL;
+}
+
+static int next_id = 0;
+
+template <class T> static void fill(T &rec,const char *prefix) {
+	char tmp[32];
+	ideal_time_t s = rnd_time(),e = s + (ideal_time_t)rnd(4 * 3600) * second;
+
+	if (e > horizon) e = horizon;
+	sprintf(tmp,"%s%d",prefix,next_id++);
+	rec.setValue(prefix[0] == 'i' ? "item" : "block",tmp);
+	rec.setStartTime(s);
+	rec.setEndTime(e);
+}
+
+/* every event of the schedule, as the wheel should see it */
+static void model_events(const Castus4publicSchedule &schedule,const ideal_time_t origin,std::vector<ModelEvent> &out) {
+	ModelEvent ev;
+
+	out.clear();
+	for (std::list<Castus4publicSchedule::ScheduleItem>::const_iterator i=schedule.schedule_items.begin();i!=schedule.schedule_items.end();i++) {
+		ev.name = i->getItem();
+		ev.time = i->getStartTime() + origin; ev.type = Wheel::Start; out.push_back(ev);
+		ev.time = i->getEndTime() + origin; ev.type = Wheel::End; out.push_back(ev);
+	}
+	for (std::list<Castus4publicSchedule::ScheduleBlock>::const_iterator i=schedule.schedule_blocks.begin();i!=schedule.schedule_blocks.end();i++) {
+		ev.name = i->getValue("block");
+		ev.time = i->getStartTime() + origin; ev.type = Wheel::Start; out.push_back(ev);
+		ev.time = i->getEndTime() + origin; ev.type = Wheel::End; out.push_back(ev);
+	}
+
+	std::sort(out.begin(),out.end(),ModelEvent_less);
+}
+
+static void collect(const Wheel::Event &ev,void *opaque) {
+	std::vector<ModelEvent> *out = (std::vector<ModelEvent>*)opaque;
+	ModelEvent m;
+
+	m.time = ev.time;
+	m.type = ev.type;
+	m.name = ev.item != NULL ? ev.item->getItem() : ev.block->getValue("block");
+	out->push_back(m);
+}
+
+/* in time order with ends first; records due at the same moment in any order */
+static bool same_dispatch(std::vector<ModelEvent> got,const std::vector<ModelEvent> &want) {
+	for (size_t i=1;i < got.size();i++) {
+		if (got[i].time < got[i-1].time || (got[i].time == got[i-1].time && got[i].type < got[i-1].type))
+			return false;
+	}
+
+	std::sort(got.begin(),got.end(),ModelEvent_less);
+	if (got.size() != want.size()) return false;
+	for (size_t i=0;i < got.size();i++) {
+		if (got[i].time != want[i].time || got[i].type != want[i].type || got[i].name != want[i].name)
+			return false;
+	}
+
+	return true;
+}
+
+int main() {
+	const ideal_time_t resolutions[] = { 1, 1000, 1000000 };
+	size_t total = 0;
+
+	for (unsigned int round=0;round < 12;round++) {
+		Castus4publicSchedule schedule;
+		const ideal_time_t res = resolutions[round % 3];
+		const ideal_time_t origin = (round & 4) ? (1LL << 34) * res : 0; /* past the top level */
+		Wheel wheel(res);
+		std::vector<ModelEvent> all,pending,got,want;
+		ideal_time_t now = origin;
+		unsigned long long done_tick = 0;	/* events at ticks before this are past */
+		bool started = false;
+
+		schedule.begin_load();
+		schedule.end_load();
+		for (unsigned int i=0,n=1+rnd(300);i < n;i++) {
+			Castus4publicSchedule::ScheduleItem item(schedule.schedule_type);
+			fill(item,"i");
+			schedule.schedule_items.push_back(item);
+		}
+		for (unsigned int i=0,n=rnd(40);i < n;i++) {
+			Castus4publicSchedule::ScheduleBlock block(schedule.schedule_type);
+			fill(block,"b");
+			schedule.schedule_blocks.push_back(block);
+		}
+
+		wheel.reset(origin);
+		while (now < origin + horizon + second) {
+			/* reload now and then, after moving, dropping and adding records */
+			if (!started || rnd(4) == 0) {
+				for (unsigned int e=0,n=started ? rnd(20) : 0;e < n;e++) {
+					const unsigned int op = rnd(3);
+
+					if (op == 0 && !schedule.schedule_items.empty()) {
+						std::list<Castus4publicSchedule::ScheduleItem>::iterator i = schedule.schedule_items.begin();
+						std::advance(i,rnd((unsigned int)schedule.schedule_items.size()));
+						schedule.schedule_items.erase(i);
+					}
+					else if (op == 1 && !schedule.schedule_items.empty()) {
+						std::list<Castus4publicSchedule::ScheduleItem>::iterator i = schedule.schedule_items.begin();
+						std::advance(i,rnd((unsigned int)schedule.schedule_items.size()));
+						const ideal_time_t s = rnd_time();
+						i->setStartTime(s);
+						i->setEndTime(std::min(horizon,s + (ideal_time_t)rnd(3600) * second));
+					}
+					else {
+						Castus4publicSchedule::ScheduleItem item(schedule.schedule_type);
+						fill(item,"i");
+						schedule.schedule_items.push_back(item);
+					}
+				}
+				if (started) schedule.changed();
+
+				wheel.load(schedule,Wheel::Items|Wheel::Blocks,origin);
+				started = true;
+
+				model_events(schedule,origin,all);
+				pending.clear();
+				for (size_t i=0;i < all.size();i++) {
+					if ((unsigned long long)(all[i].time / res) >= done_tick) pending.push_back(all[i]);
+				}
+			}
+
+			if (wheel.size() != pending.size()) {
+				fprintf(stderr,"round %u: %zu events in the wheel, expected %zu\n",round,wheel.size(),pending.size());
+				return 1;
+			}
+
+			const ideal_time_t next = wheel.next_time();
+			const ideal_time_t want_next = pending.empty() ? Castus4publicSchedule::ideal_time_t_invalid : pending[0].time;
+			if (next != want_next) {
+				fprintf(stderr,"round %u: next event at %lld, expected %lld\n",round,(long long)next,(long long)want_next);
+				return 1;
+			}
+
+			/* steps of a tick, a minute or an hour or more */
+			const unsigned int kind = rnd(3);
+			if (kind == 0) now += res;
+			else if (kind == 1) now += (ideal_time_t)rnd(60) * second;
+			else now += (ideal_time_t)rnd(6 * 3600) * second;
+
+			const unsigned long long now_tick = (unsigned long long)(now / res);
+			size_t k = 0;
+
+			want.clear();
+			while (k < pending.size() && (unsigned long long)(pending[k].time / res) <= now_tick) want.push_back(pending[k++]);
+			pending.erase(pending.begin(),pending.begin() + k);
+			done_tick = now_tick + 1ULL;
+
+			got.clear();
+			const size_t n = wheel.advance(now,collect,&got);
+			if (n != want.size() || !same_dispatch(got,want)) {
+				fprintf(stderr,"round %u: advance to %lld dispatched %zu events, expected %zu\n",round,(long long)now,got.size(),want.size());
+				for (size_t i=0;i < got.size();i++)
+					fprintf(stderr,"  got %lld %d %s\n",(long long)got[i].time,got[i].type,got[i].name.c_str());
+				for (size_t i=0;i < want.size();i++)
+					fprintf(stderr,"  want %lld %d %s\n",(long long)want[i].time,want[i].type,want[i].name.c_str());
+				return 1;
+			}
+			total += n;
+		}
+
+		if (wheel.size() != 0) {
+			fprintf(stderr,"round %u: %zu events left past the end\n",round,wheel.size());
+			return 1;
+		}
+	}
+
+	printf("%zu events dispatched in the order of a full sort\n",total);
+	return 0;
+}
@@ -0,0 +1,92 @@
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+
+#include <castus4-public/metadata.h>
+#include <castus4-public/metadata_binary.h>
+
+#include <string>
+
+using namespace std;
+
+/* Makes the metadata.bin sidecar (see castus4public_metadata_binary) current for media files
+ * that have metadata: each file named, and every media file in each directory named. Sidecars
+ * already current are left alone, so running it again only costs a stat() per file.
+ *
+ * Prints a line for each file whose sidecar could not be made. Exits 0 if there were none,
+ * 2 if there were, 1 on bad arguments. */
+
+static bool metabin_dir(const char *dir_path,size_t &done,size_t &failed) {
+	struct dirent *d;
+	DIR *dp;
+
+	if ((dp=opendir(dir_path)) == NULL) return false;
+
+	/* relative to the directory, so the kernel does not walk the full path for every file */
+	const int dfd = dirfd(dp);
+	while ((d=readdir(dp)) != NULL) {
+		if (!castus4public_is_metadata_dir(d->d_name)) continue;
+
+		const std::string meta_path = std::string(d->d_name) + "/metadata";
+		struct stat st;
+
+		/* a .castusmeta.* directory without a metadata file has nothing to make one from */
+		if (fstatat(dfd,meta_path.c_str(),&st,0) || !S_ISREG(st.st_mode)) continue;
+
+		if (castus4public_metadata_binary::update_at(dfd,meta_path.c_str())) {
+			done++;
+		}
+		else {
+			printf("%s/%s: %s\n",dir_path,meta_path.c_str(),strerror(errno));
+			failed++;
+		}
+	}
+
+	closedir(dp);
+	return true;
+}
+
+int main(int argc,char **argv) {
+	size_t done = 0,failed = 0;
+	struct stat st;
+
+	if (argc < 2) {
+		fprintf(stderr,"metabin <media file or directory>...\n");
+		return 1;
+	}
+
+	for (int i=1;i < argc;i++) {
+		if (stat(argv[i],&st)) {
+			printf("%s: %s\n",argv[i],strerror(errno));
+			failed++;
+			continue;
+		}
+
+		if (S_ISDIR(st.st_mode)) {
+			if (!metabin_dir(argv[i],done,failed)) {
+				printf("%s: %s\n",argv[i],strerror(errno));
+				failed++;
+			}
+			continue;
+		}
+
+		const std::string meta_path = castus4public_file_to_metadata_file(argv[i]);
+		if (!meta_path.empty() && castus4public_metadata_binary::update_at(AT_FDCWD,meta_path.c_str())) {
+			done++;
+		}
+		else {
+			printf("%s: %s\n",argv[i],strerror(errno));
+			failed++;
+		}
+	}
+
+	fprintf(stderr,"%zu sidecars current, %zu failed\n",done,failed);
+	return failed != 0 ? 2 : 0;
+}
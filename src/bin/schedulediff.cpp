@@ -0,0 +1,91 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <math.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/schedule_object.h>
+#include <castus4-public/schedule_helpers.h>
+#include <castus4-public/schedule_diff.h>
+
+#include <string>
+
+using namespace std;
+using namespace Castus4publicScheduleHelpers;
+
+/* schedulediff <old> <new>
+ *   writes the edit script from old to new to stdout. Exits 0 if they match, 2 if not.
+ * schedulediff -p <schedule> <script>
+ *   applies a script to a schedule and writes the result to stdout. */
+
+static bool read_file(const char *path,std::string &out) {
+	char tmp[4096];
+	size_t rd;
+	FILE *fp;
+
+	if ((fp=fopen(path,"r")) == NULL) return false;
+	out.clear();
+	while ((rd=fread(tmp,1,sizeof(tmp),fp)) > 0) out.append(tmp,rd);
+	fclose(fp);
+	return true;
+}
+
+int main(int argc,char **argv) {
+	Castus4publicScheduleDiff diff;
+	bool patch = false;
+	int i = 1;
+
+	if (i < argc && !strcmp(argv[i],"-p")) {
+		patch = true;
+		i++;
+	}
+
+	if ((argc - i) != 2) {
+		fprintf(stderr,"schedulediff <old schedule> <new schedule>\n");
+		fprintf(stderr,"schedulediff -p <schedule> <script>\n");
+		return 1;
+	}
+
+	if (patch) {
+		Castus4publicSchedule schedule;
+		std::string script;
+
+		if (!load(schedule,argv[i])) {
+			fprintf(stderr,"Problem loading file %s\n",argv[i]);
+			return 1;
+		}
+		if (!read_file(argv[i+1],script) || !diff.read(script)) {
+			fprintf(stderr,"Problem reading script %s\n",argv[i+1]);
+			return 1;
+		}
+		if (!diff.apply(schedule)) {
+			fprintf(stderr,"Script does not apply to %s\n",argv[i]);
+			return 1;
+		}
+
+		schedule.write_out(stdout);
+		return 0;
+	}
+
+	Castus4publicSchedule from,to;
+	std::string out;
+
+	if (!load(from,argv[i])) {
+		fprintf(stderr,"Problem loading file %s\n",argv[i]);
+		return 1;
+	}
+	if (!load(to,argv[i+1])) {
+		fprintf(stderr,"Problem loading file %s\n",argv[i+1]);
+		return 1;
+	}
+
+	diff.compute(from,to);
+	diff.write(out);
+	fwrite(out.data(),1,out.length(),stdout);
+	return diff.empty() ? 0 : 2;
+}
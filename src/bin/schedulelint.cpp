@@ -0,0 +1,110 @@
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <math.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/schedule_object.h>
+#include <castus4-public/schedule_helpers.h>
+#include <castus4-public/schedule_lint.h>
+#include <castus4-public/schedule_mediajoin.h>
+
+using namespace std;
+using namespace Castus4publicScheduleHelpers;
+
+/* Reports timeline problems in a schedule, one per line, tab separated:
+ *
+ *   <type> <start us> <end us> <item> <other item>
+ *
+ * type is overlap, gap, zero-length, past-end or invalid-time. Items without a path print "-".
+ *
+ * With -m the media the items play is checked too (see Castus4publicScheduleMediaJoin), adding
+ * missing, no-metadata, no-duration and duration-mismatch lines. For those the last field is the
+ * media's duration in microseconds instead of another item ("-" if not known). -t sets how far
+ * an item's "item duration" may be off, in seconds (default 0.5).
+ *
+ * Exits 0 if the schedule is clean, 2 if anything was reported, 1 on error. */
+
+static const char *item_name(const Castus4publicSchedule::ScheduleItem *item) {
+	const char *s;
+
+	if (item == NULL) return "-";
+	s = item->getItem();
+	return (s != NULL && *s != 0) ? s : "-";
+}
+
+int main(int argc,char **argv) {
+	Castus4publicSchedule::ideal_time_t min_gap = 0;
+	Castus4publicSchedule::ideal_time_t tolerance = 500000;
+	Castus4publicScheduleMediaJoin media_join;
+	bool check_media = false;
+	bool clean = true;
+	std::vector<Castus4publicScheduleLint::Issue> issues;
+	Castus4publicSchedule schedule;
+	const char *path = NULL;
+	int i;
+
+	for (i=1;i < argc;i++) {
+		if (!strcmp(argv[i],"-g") && (i+1) < argc)
+			min_gap = (Castus4publicSchedule::ideal_time_t)(atof(argv[++i]) * 1000000);
+		else if (!strcmp(argv[i],"-t") && (i+1) < argc)
+			tolerance = (Castus4publicSchedule::ideal_time_t)(atof(argv[++i]) * 1000000);
+		else if (!strcmp(argv[i],"-m"))
+			check_media = true;
+		else if (argv[i][0] == '-')
+			break;
+		else if (path == NULL)
+			path = argv[i];
+		else
+			break;
+	}
+
+	if (path == NULL || i < argc) {
+		fprintf(stderr,"schedulelint [-g <min gap seconds>] [-m [-t <duration tolerance seconds>]] <schedule>\n");
+		return 1;
+	}
+
+	if (!load(schedule,path)) {
+		fprintf(stderr,"Problem loading file %s\n",path);
+		return 1;
+	}
+
+	if (!Castus4publicScheduleLint::analyze(schedule,issues,min_gap))
+		clean = false;
+
+	for (size_t j=0;j < issues.size();j++) {
+		const Castus4publicScheduleLint::Issue &is = issues[j];
+
+		printf("%s\t%lld\t%lld\t%s\t%s\n",
+			Castus4publicScheduleLint::issue_name(is.type),
+			(signed long long)is.start,
+			(signed long long)is.end,
+			item_name(is.item),
+			item_name(is.other));
+	}
+
+	if (check_media && !media_join.check(schedule,tolerance)) {
+		clean = false;
+
+		for (size_t j=0;j < media_join.issues.size();j++) {
+			const Castus4publicScheduleMediaJoin::Issue &is = media_join.issues[j];
+			const Castus4publicScheduleMediaJoin::Media &md = media_join.media[is.media];
+
+			printf("%s\t%lld\t%lld\t%s\t",
+				Castus4publicScheduleMediaJoin::issue_name(is.type),
+				(signed long long)is.item->getStartTime(),
+				(signed long long)is.item->getEndTime(),
+				item_name(is.item));
+			if (md.duration_us != 0) printf("%llu\n",md.duration_us);
+			else printf("-\n");
+		}
+	}
+
+	return clean ? 0 : 2;
+}
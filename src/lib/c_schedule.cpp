@@ -1,12 +1,206 @@
-#include <castus4-public/schedule_object.h>
-#include <castus4-public/schedule.h>
-#include <castus4-public/parsetime.h>
-#include <castus4-public/gentime.h>
-#include <castus4-public/chomp.h>
-#include <castus4-public/schedule_helpers.h>
+#include <castus4-public/c_schedule.h>
+
+#include <algorithm>
+#include <iterator>
 
 const int to_second_conversion = 1000000;
 
+/**
+* Position within a std::map or std::list, shared by all the C cursors
+*
+* seek() moves to an absolute position from whichever of begin(), end() or
+* the current position is closest, so walking positions 0, 1, 2... costs
+* O(1) per step.
+*
+* A cursor given a generation counter starts over whenever it moves, so a
+* change that leaves the size alone still can't leave pos dangling.
+**/
+template <class C> class c_schedule_cursor {
+public:
+    c_schedule_cursor(C *container, const unsigned long long *generation = nullptr) : container(container), pos(container->begin()), index(0),
+        size(container->size()), generation(generation), seen(generation ? *generation : 0) {
+    }
+
+    bool valid() const {
+        return pos != container->end();
+    }
+
+    bool next() {
+        if (!valid())
+            return false;
+        ++pos;
+        ++index;
+        return valid();
+    }
+
+    bool seek(size_t n) {
+        // the container changed behind our back, the iterator can't be trusted
+        if (size != container->size() || (generation && *generation != seen))
+            rewind();
+        if (n >= container->size())
+            return false;
+
+        size_t from_here = (n > index) ? (n - index) : (index - n);
+        if (n < from_here) {
+            rewind();
+        }
+        else if ((container->size() - n) < from_here) {
+            pos = container->end();
+            index = container->size();
+        }
+
+        for (; index < n; ++index) ++pos;
+        for (; index > n; --index) --pos;
+        return true;
+    }
+
+    void rewind() {
+        pos = container->begin();
+        index = 0;
+        size = container->size();
+        if (generation)
+            seen = *generation;
+    }
+public:
+    C *container;
+    typename C::iterator pos;
+    size_t index;
+    size_t size;
+    const unsigned long long *generation;
+    unsigned long long seen;
+};
+
+struct schedule_entry_cursor : public c_schedule_cursor< std::map<std::string,std::string> > {
+    schedule_entry_cursor(std::map<std::string,std::string> *m, const unsigned long long *g = nullptr) : c_schedule_cursor(m, g) { }
+};
+
+struct schedule_item_cursor : public c_schedule_cursor< std::list<Castus4publicSchedule::ScheduleItem> > {
+    schedule_item_cursor(std::list<Castus4publicSchedule::ScheduleItem> *l, const unsigned long long *g = nullptr) : c_schedule_cursor(l, g) { }
+};
+
+struct schedule_block_cursor : public c_schedule_cursor< std::list<Castus4publicSchedule::ScheduleBlock> > {
+    schedule_block_cursor(std::list<Castus4publicSchedule::ScheduleBlock> *l, const unsigned long long *g = nullptr) : c_schedule_cursor(l, g) { }
+};
+
+/**
+* The schedule handed out by schedule_alloc()
+*
+* Carries the cursors used by the positional accessors so that they pick up
+* where the previous call left off.
+**/
+class Castus4publicCSchedule : public Castus4publicSchedule {
+public:
+    Castus4publicCSchedule() : globals(&global_values, &generation), items(&schedule_items, &generation), blocks(&schedule_blocks, &generation) {
+    }
+    virtual ~Castus4publicCSchedule() {
+    }
+public:
+    schedule_entry_cursor globals;
+    schedule_item_cursor items;
+    schedule_block_cursor blocks;
+    std::string write_buffer;
+};
+
+/* The positional accessors use the handle's cursors when self came from schedule_alloc(),
+ * and the caller's temporary (seeked from the start) otherwise */
+static schedule_entry_cursor &c_schedule_globals_cursor(Castus4publicSchedule *self, schedule_entry_cursor &tmp) {
+    Castus4publicCSchedule *h = dynamic_cast<Castus4publicCSchedule*>(self);
+    return h ? h->globals : tmp;
+}
+
+static schedule_item_cursor &c_schedule_items_cursor(Castus4publicSchedule *self, schedule_item_cursor &tmp) {
+    Castus4publicCSchedule *h = dynamic_cast<Castus4publicCSchedule*>(self);
+    return h ? h->items : tmp;
+}
+
+static schedule_block_cursor &c_schedule_blocks_cursor(Castus4publicSchedule *self, schedule_block_cursor &tmp) {
+    Castus4publicCSchedule *h = dynamic_cast<Castus4publicCSchedule*>(self);
+    return h ? h->blocks : tmp;
+}
+
+static void c_schedule_reset_cursors(Castus4publicSchedule *self) {
+    Castus4publicCSchedule *h = dynamic_cast<Castus4publicCSchedule*>(self);
+    if (h) {
+        h->globals.rewind();
+        h->items.rewind();
+        h->blocks.rewind();
+    }
+}
+
+/* The item_entry_* and block_entry_* accessors have no handle to keep a cursor in, so each
+ * thread keeps one for the record it last looked at: walking one record's entries in order is
+ * O(1) per step. The record's entry stamp says when that position is no longer good. */
+struct c_schedule_entry_cache {
+    const void *owner;
+    unsigned long long stamp;
+    schedule_entry_cursor cursor;
+};
+
+static std::map<std::string,std::string> c_schedule_no_entries;
+
+template <class R> static schedule_entry_cursor &c_schedule_record_cursor(R *self) {
+    static thread_local c_schedule_entry_cache cache = { nullptr, 0, schedule_entry_cursor(&c_schedule_no_entries) };
+
+    if (cache.owner != self || cache.stamp != self->getEntryStamp()) {
+        cache.owner = self;
+        cache.stamp = self->getEntryStamp();
+        cache.cursor = schedule_entry_cursor(&self->entry);
+    }
+
+    return cache.cursor;
+}
+
+template <class C> static typename C::iterator c_schedule_position(C &c, int pos) {
+    if (pos < 0 || (size_t)pos >= c.size())
+        return c.end();
+
+    auto i = c.begin();
+    std::advance(i, pos);
+    return i;
+}
+
+template <class C> static int c_schedule_erase(C &c, int first, int count) {
+    if (first < 0 || count <= 0 || (size_t)first >= c.size())
+        return 0;
+
+    auto i = c_schedule_position(c, first);
+    int erased = 0;
+    while (i != c.end() && erased < count) {
+        i = c.erase(i);
+        erased++;
+    }
+
+    return erased;
+}
+
+class c_schedule_buffer_writer {
+public:
+    c_schedule_buffer_writer(char *buf, size_t size) : buf(buf), size(size), length(0) {
+    }
+public:
+    static bool cb(Castus4publicSchedule *, const char *line, void *opaque) {
+        c_schedule_buffer_writer *w = (c_schedule_buffer_writer*)opaque;
+        size_t len = strlen(line);
+
+        if (w->length < w->size) {
+            size_t copy = std::min(len, w->size - w->length);
+            memcpy(w->buf + w->length, line, copy);
+        }
+
+        w->length += len;
+        return true;
+    }
+
+    static bool string_cb(Castus4publicSchedule *, const char *line, void *opaque) {
+        ((std::string*)opaque)->append(line);
+        return true;
+    }
+public:
+    char *buf;
+    size_t size;
+    size_t length;
+};
+
 extern "C" {
 
     char *time_to_string( signed long long time) { 
@@ -24,11 +218,13 @@ extern "C" {
     }
 
     Castus4publicSchedule* schedule_alloc() {
-        return new Castus4publicSchedule{};
+        return new Castus4publicCSchedule{};
     }
 
     bool schedule_load_from_string(Castus4publicSchedule* self, const char* data) {
-        return Castus4publicScheduleHelpers::load_from_string(*self, data);
+        bool ok = Castus4publicScheduleHelpers::load_from_string(*self, data);
+        c_schedule_reset_cursors(self);
+        return ok;
     }   
 
     void schedule_free(Castus4publicSchedule* sched) {
@@ -36,11 +232,20 @@ extern "C" {
     }
 
     bool schedule_load(Castus4publicSchedule* self, const char* path) {
-        return Castus4publicScheduleHelpers::load(*self, path);
+        bool ok = Castus4publicScheduleHelpers::load(*self, path);
+        c_schedule_reset_cursors(self);
+        return ok;
     }   
 
     const char *schedule_type(Castus4publicSchedule* self) { 
-        return strdup( self->type().c_str() );
+        static const char *names[] = { "None", "Daily", "Weekly", "Monthly", "Yearly", "Interval" };
+        std::string type = self->type();
+
+        for (auto name : names)
+            if (type == name)
+                return name;
+
+        return names[0];
     }
 
     int schedule_interval_in_days(Castus4publicSchedule* self) { 
@@ -51,53 +256,124 @@ extern "C" {
         return self->global_values.size();
     }
 
-    // TODO use iterator math
     const char *schedule_global_item_key(Castus4publicSchedule* self, unsigned int pos) { 
-        for (auto ret = self->global_values.begin(); true; --pos, ++ret)
-            if (pos<=0)
-                return strdup( ret->first.c_str() );
-        return 0;
+        schedule_entry_cursor tmp(&self->global_values);
+        schedule_entry_cursor &c = c_schedule_globals_cursor(self, tmp);
+
+        if (!c.seek(pos))
+            return nullptr;
+        return c.pos->first.c_str();
     }
 
-    // TODO use iterator math
     const char *schedule_global_item_value(Castus4publicSchedule* self, unsigned int pos) { 
-        for (auto ret = self->global_values.begin(); true; --pos, ++ret)
-            if (pos<=0)
-                return strdup( ret->second.c_str() );
-        return 0;
+        schedule_entry_cursor tmp(&self->global_values);
+        schedule_entry_cursor &c = c_schedule_globals_cursor(self, tmp);
+
+        if (!c.seek(pos))
+            return nullptr;
+        return c.pos->second.c_str();
     }
 
     int schedule_item_count(Castus4publicSchedule* self) { 
         return self->schedule_items.size();
     }
 
-    // TODO use iterator math
     Castus4publicSchedule::ScheduleItem *schedule_item(Castus4publicSchedule* self, int pos) { 
-        for (auto ret = self->schedule_items.begin(); true; --pos, ++ret)
-            if (pos<=0)
-                return &(*ret);
-           
-        return nullptr;
+        self->apply_time_shifts(); /* callers read the times from the item's entries */
+        schedule_item_cursor tmp(&self->schedule_items);
+        schedule_item_cursor &c = c_schedule_items_cursor(self, tmp);
+
+        if (pos < 0 || !c.seek(pos))
+            return nullptr;
+        return &(*c.pos);
     }
 
     int schedule_block_count(Castus4publicSchedule* self) { 
         return self->schedule_blocks.size();
     }
 
-
-    // TODO use iterator math
     Castus4publicSchedule::ScheduleBlock *schedule_block(Castus4publicSchedule* self, int pos) { 
-        for (auto ret = self->schedule_blocks.begin(); true; --pos, ++ret)
-            if (pos<=0)
-                return &(*ret);
-           
-        return nullptr;
+        schedule_block_cursor tmp(&self->schedule_blocks);
+        schedule_block_cursor &c = c_schedule_blocks_cursor(self, tmp);
+
+        if (pos < 0 || !c.seek(pos))
+            return nullptr;
+        return &(*c.pos);
+    }
+
+    int schedule_export_items(Castus4publicSchedule* self, int first, struct schedule_item_export *out, int max) {
+        int count = 0;
+
+        if (first < 0 || max <= 0 || out == nullptr)
+            return 0;
+
+        self->apply_time_shifts();
+
+        /* seek with the handle's cursor, so paging through in chunks costs O(max) per call */
+        schedule_item_cursor tmp(&self->schedule_items);
+        schedule_item_cursor &c = c_schedule_items_cursor(self, tmp);
+        if (!c.seek(first))
+            return 0;
+
+        auto i = c.pos;
+
+        for (; i != self->schedule_items.end() && count < max; ++i, ++count) {
+            struct schedule_item_export &e = out[count];
+            auto item = i->entry.find("item");
+
+            e.start = i->getStartTime();
+            e.end = i->getEndTime();
+            e.handle = &(*i);
+            if (item != i->entry.end()) {
+                e.item = item->second.c_str();
+                e.item_length = item->second.length();
+            }
+            else {
+                e.item = nullptr;
+                e.item_length = 0;
+            }
+        }
+
+        return count;
+    }
+
+    int schedule_export_blocks(Castus4publicSchedule* self, int first, struct schedule_block_export *out, int max) {
+        int count = 0;
+
+        if (first < 0 || max <= 0 || out == nullptr)
+            return 0;
+
+        schedule_block_cursor tmp(&self->schedule_blocks);
+        schedule_block_cursor &c = c_schedule_blocks_cursor(self, tmp);
+        if (!c.seek(first))
+            return 0;
+
+        auto i = c.pos;
+
+        for (; i != self->schedule_blocks.end() && count < max; ++i, ++count) {
+            struct schedule_block_export &e = out[count];
+            auto name = i->entry.find("block");
+
+            e.start = i->getStartTime();
+            e.end = i->getEndTime();
+            e.handle = &(*i);
+            if (name != i->entry.end()) {
+                e.name = name->second.c_str();
+                e.name_length = name->second.length();
+            }
+            else {
+                e.name = nullptr;
+                e.name_length = 0;
+            }
+        }
+
+        return count;
     }
 
    // Block functions
 
     const char *block_name( Castus4publicSchedule::ScheduleBlock *self ) {
-        return strdup( self->getValue("block") );
+        return self->getBlockName();
     }
 
     long long block_start_time( Castus4publicSchedule::ScheduleBlock *self ) {
@@ -113,22 +389,20 @@ extern "C" {
         return self->entry.size();
     }
 
-    // TODO use iterator math
     const char *block_entry_key(Castus4publicSchedule::ScheduleBlock* self, int pos) { 
-        for (auto ret = self->entry.begin(); true; --pos, ++ret)
-            if (pos<=0 ) 
-                return strdup(ret->first.c_str());
-           
-        return "";
+        schedule_entry_cursor &c = c_schedule_record_cursor(self);
+
+        if (pos < 0 || !c.seek(pos))
+            return "";
+        return c.pos->first.c_str();
     }
 
-    // TODO use iterator math
     const char *block_entry_value(Castus4publicSchedule::ScheduleBlock* self, int pos) { 
-        for (auto ret = self->entry.begin(); true; --pos, ++ret)
-            if (pos<=0 ) 
-                return strdup(ret->second.c_str());
-           
-        return "";
+        schedule_entry_cursor &c = c_schedule_record_cursor(self);
+
+        if (pos < 0 || !c.seek(pos))
+            return "";
+        return c.pos->second.c_str();
     }
 
     // Item functions
@@ -146,26 +420,316 @@ extern "C" {
         return self->entry.size();
     }
 
-    // TODO use iterator math
     const char *item_entry_key(Castus4publicSchedule::ScheduleItem* self, int pos) { 
-        for (auto ret = self->entry.begin(); true; --pos, ++ret)
-            if (pos<=0 ) 
-                return strdup(ret->first.c_str());
-           
-        return "";
+        schedule_entry_cursor &c = c_schedule_record_cursor(self);
+
+        if (pos < 0 || !c.seek(pos))
+            return "";
+        return c.pos->first.c_str();
     }
 
-    // TODO use iterator math
     const char *item_entry_value(Castus4publicSchedule::ScheduleItem* self, int pos) { 
-        for (auto ret = self->entry.begin(); true; --pos, ++ret)
-            if (pos<=0 ) 
-                return strdup(ret->second.c_str());
-           
-        return "";
+        schedule_entry_cursor &c = c_schedule_record_cursor(self);
+
+        if (pos < 0 || !c.seek(pos))
+            return "";
+        return c.pos->second.c_str();
+    }
+
+    // Cursors
+
+    schedule_entry_cursor *schedule_globals_begin(Castus4publicSchedule* self) {
+        return new schedule_entry_cursor(&self->global_values);
+    }
+
+    schedule_entry_cursor *item_entries_begin(Castus4publicSchedule::ScheduleItem* self) {
+        return new schedule_entry_cursor(&self->entry);
+    }
+
+    schedule_entry_cursor *block_entries_begin(Castus4publicSchedule::ScheduleBlock* self) {
+        return new schedule_entry_cursor(&self->entry);
+    }
+
+    bool entry_cursor_valid(schedule_entry_cursor* c) {
+        return c->valid();
     }
 
+    bool entry_cursor_next(schedule_entry_cursor* c) {
+        return c->next();
+    }
+
+    const char *entry_cursor_key(schedule_entry_cursor* c, size_t *length) {
+        if (!c->valid())
+            return nullptr;
+        if (length)
+            *length = c->pos->first.length();
+        return c->pos->first.c_str();
+    }
 
+    const char *entry_cursor_value(schedule_entry_cursor* c, size_t *length) {
+        if (!c->valid())
+            return nullptr;
+        if (length)
+            *length = c->pos->second.length();
+        return c->pos->second.c_str();
+    }
+
+    void entry_cursor_free(schedule_entry_cursor* c) {
+        delete c;
+    }
 
+    schedule_item_cursor *schedule_items_begin(Castus4publicSchedule* self) {
+        self->apply_time_shifts();
+        return new schedule_item_cursor(&self->schedule_items);
+    }
+
+    bool item_cursor_valid(schedule_item_cursor* c) {
+        return c->valid();
+    }
+
+    bool item_cursor_next(schedule_item_cursor* c) {
+        return c->next();
+    }
 
+    Castus4publicSchedule::ScheduleItem *item_cursor_item(schedule_item_cursor* c) {
+        return c->valid() ? &(*c->pos) : nullptr;
+    }
+
+    void item_cursor_free(schedule_item_cursor* c) {
+        delete c;
+    }
+
+    schedule_block_cursor *schedule_blocks_begin(Castus4publicSchedule* self) {
+        return new schedule_block_cursor(&self->schedule_blocks);
+    }
+
+    bool block_cursor_valid(schedule_block_cursor* c) {
+        return c->valid();
+    }
+
+    bool block_cursor_next(schedule_block_cursor* c) {
+        return c->next();
+    }
+
+    Castus4publicSchedule::ScheduleBlock *block_cursor_block(schedule_block_cursor* c) {
+        return c->valid() ? &(*c->pos) : nullptr;
+    }
+
+    void block_cursor_free(schedule_block_cursor* c) {
+        delete c;
+    }
+
+    // Editing
+
+    bool schedule_init(Castus4publicSchedule* self, int type) {
+        if (type < C4_SCHED_TYPE_DAILY || type > C4_SCHED_TYPE_INTERVAL)
+            return false;
+
+        self->begin_load();
+        // begin_load() keeps the globals, an empty schedule should not
+        self->global_values.clear();
+        self->schedule_type = type;
+        self->end_load();
+        c_schedule_reset_cursors(self);
+        return true;
+    }
+
+    // every edit below says changed(), so the ordered item index and the cursors of other
+    // handles on the schedule never follow an entry that is gone
+
+    void schedule_set_global(Castus4publicSchedule* self, const char *key, const char *value) {
+        self->global_values[key] = value;
+        self->changed();
+        c_schedule_reset_cursors(self);
+    }
+
+    void schedule_delete_global(Castus4publicSchedule* self, const char *key) {
+        self->global_values.erase(key);
+        self->changed();
+        c_schedule_reset_cursors(self);
+    }
+
+    // items go through insert_item()/erase_item(), which keep ordered mode and batches right
+    Castus4publicSchedule::ScheduleItem *schedule_add_item(Castus4publicSchedule* self, int pos) {
+        auto i = self->insert_item(c_schedule_position(self->schedule_items, pos),
+            Castus4publicSchedule::ScheduleItem(self->schedule_type));
+        c_schedule_reset_cursors(self);
+        return &(*i);
+    }
+
+    Castus4publicSchedule::ScheduleItem *schedule_copy_item(Castus4publicSchedule* self, const Castus4publicSchedule::ScheduleItem *src, int pos) {
+        Castus4publicSchedule::ScheduleItem item(*src);
+
+        item.schedule_type = self->schedule_type;
+        auto i = self->insert_item(c_schedule_position(self->schedule_items, pos), item);
+        c_schedule_reset_cursors(self);
+        return &(*i);
+    }
+
+    int schedule_erase_items(Castus4publicSchedule* self, int first, int count) {
+        if (first < 0 || count <= 0 || (size_t)first >= self->schedule_items.size())
+            return 0;
+
+        auto i = c_schedule_position(self->schedule_items, first);
+        int erased = 0;
+        while (i != self->schedule_items.end() && erased < count) {
+            i = self->erase_item(i);
+            erased++;
+        }
+
+        c_schedule_reset_cursors(self);
+        return erased;
+    }
+
+    Castus4publicSchedule::ScheduleBlock *schedule_add_block(Castus4publicSchedule* self, int pos) {
+        auto i = self->schedule_blocks.insert(c_schedule_position(self->schedule_blocks, pos),
+            Castus4publicSchedule::ScheduleBlock(self->schedule_type));
+        self->changed();
+        c_schedule_reset_cursors(self);
+        return &(*i);
+    }
+
+    int schedule_erase_blocks(Castus4publicSchedule* self, int first, int count) {
+        int erased = c_schedule_erase(self->schedule_blocks, first, count);
+        self->changed();
+        c_schedule_reset_cursors(self);
+        return erased;
+    }
+
+    bool schedule_set_item_value(Castus4publicSchedule* self, Castus4publicSchedule::ScheduleItem* item, const char *key, const char *value) {
+        auto i = self->find_item(item);
+        if (i == self->schedule_items.end())
+            return false;
+
+        bool ok = self->set_item_value(i, key, value);
+        c_schedule_reset_cursors(self);
+        return ok;
+    }
+
+    bool schedule_set_item_start_time_us(Castus4publicSchedule* self, Castus4publicSchedule::ScheduleItem* item, long long t) {
+        auto i = self->find_item(item);
+        if (i == self->schedule_items.end())
+            return false;
+
+        bool ok = self->retime_item(i, t, Castus4publicSchedule::ideal_time_t_invalid);
+        c_schedule_reset_cursors(self);
+        return ok;
+    }
+
+    bool schedule_set_item_stop_time_us(Castus4publicSchedule* self, Castus4publicSchedule::ScheduleItem* item, long long t) {
+        auto i = self->find_item(item);
+        if (i == self->schedule_items.end() || t < 0)
+            return false;
+
+        bool ok;
+        Castus4publicSchedule::ideal_time_t start = self->item_start_time(i);
+        if (start != Castus4publicSchedule::ideal_time_t_invalid) {
+            ok = self->retime_item(i, start, t);
+        }
+        else {
+            // no start to keep it in order by: only the end changes, and the index, which
+            // holds the end too, is rebuilt on next use
+            ok = i->setEndTime(t);
+            self->changed();
+            if (self->in_edit())
+                self->edit_touched[&(*i)] = i;
+        }
+
+        c_schedule_reset_cursors(self);
+        return ok;
+    }
+
+    void schedule_sort(Castus4publicSchedule* self) {
+        self->sort_schedule_items();
+        self->sort_schedule_blocks();
+        c_schedule_reset_cursors(self);
+    }
+
+    const char *item_get_value(Castus4publicSchedule::ScheduleItem* self, const char *key) {
+        return self->getValue(key);
+    }
+
+    void item_set_value(Castus4publicSchedule::ScheduleItem* self, const char *key, const char *value) {
+        self->setValue(key, value);
+    }
+
+    void item_delete_value(Castus4publicSchedule::ScheduleItem* self, const char *key) {
+        self->deleteValue(key);
+    }
+
+    long long item_start_time_us(Castus4publicSchedule::ScheduleItem* self) {
+        return self->getStartTime();
+    }
+
+    long long item_stop_time_us(Castus4publicSchedule::ScheduleItem* self) {
+        return self->getEndTime();
+    }
+
+    void item_set_start_time_us(Castus4publicSchedule::ScheduleItem* self, long long t) {
+        self->setStartTime(t);
+    }
+
+    void item_set_stop_time_us(Castus4publicSchedule::ScheduleItem* self, long long t) {
+        self->setEndTime(t);
+    }
+
+    const char *block_get_value(Castus4publicSchedule::ScheduleBlock* self, const char *key) {
+        return self->getValue(key);
+    }
+
+    void block_set_value(Castus4publicSchedule::ScheduleBlock* self, const char *key, const char *value) {
+        self->setValue(key, value);
+    }
+
+    void block_delete_value(Castus4publicSchedule::ScheduleBlock* self, const char *key) {
+        self->deleteValue(key);
+    }
+
+    long long block_start_time_us(Castus4publicSchedule::ScheduleBlock* self) {
+        return self->getStartTime();
+    }
+
+    long long block_stop_time_us(Castus4publicSchedule::ScheduleBlock* self) {
+        return self->getEndTime();
+    }
+
+    void block_set_start_time_us(Castus4publicSchedule::ScheduleBlock* self, long long t) {
+        self->setStartTime(t);
+    }
+
+    void block_set_stop_time_us(Castus4publicSchedule::ScheduleBlock* self, long long t) {
+        self->setEndTime(t);
+    }
+
+    // Serializing
+
+    bool schedule_write_to_buffer(Castus4publicSchedule* self, char *buf, size_t size, size_t *length) {
+        c_schedule_buffer_writer w(buf, size);
+
+        if (buf == nullptr)
+            w.size = 0;
+
+        bool ok = self->write_out(&c_schedule_buffer_writer::cb, &w);
+        if (length)
+            *length = w.length;
+        if (w.size > 0)
+            buf[std::min(w.length, w.size - 1)] = 0;
+
+        return ok && w.length < w.size;
+    }
+
+    const char *schedule_write_out(Castus4publicSchedule* self, size_t *length) {
+        Castus4publicCSchedule *h = dynamic_cast<Castus4publicCSchedule*>(self);
+        if (h == nullptr)
+            return nullptr;
+
+        h->write_buffer.clear();
+        if (!self->write_out(&c_schedule_buffer_writer::string_cb, &h->write_buffer))
+            return nullptr;
+
+        if (length)
+            *length = h->write_buffer.length();
+        return h->write_buffer.c_str();
+    }
 
 }
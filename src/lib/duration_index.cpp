@@ -0,0 +1,84 @@
+
+#include <sys/types.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/duration_index.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+bool castus4public_duration_index::entry::operator<(const entry &a) const {
+	if (duration_us != a.duration_us) return duration_us < a.duration_us;
+	return path < a.path;
+}
+
+castus4public_duration_index::castus4public_duration_index() {
+}
+
+castus4public_duration_index::~castus4public_duration_index() {
+}
+
+void castus4public_duration_index::clear() {
+	entries.clear();
+}
+
+void castus4public_duration_index::add(const std::string &path,const unsigned long long duration_us) {
+	entry e;
+
+	e.duration_us = duration_us;
+	e.path = path;
+	entries.insert(std::upper_bound(entries.begin(),entries.end(),e),e);
+}
+
+void castus4public_duration_index::add_unsorted(const std::string &path,const unsigned long long duration_us) {
+	entry e;
+
+	e.duration_us = duration_us;
+	e.path = path;
+	entries.push_back(e);
+}
+
+void castus4public_duration_index::build() {
+	std::sort(entries.begin(),entries.end());
+}
+
+bool castus4public_duration_index::remove(const std::string &path,const unsigned long long duration_us) {
+	entry e;
+
+	e.duration_us = duration_us;
+	e.path = path;
+
+	std::vector<entry>::iterator i = std::lower_bound(entries.begin(),entries.end(),e);
+	if (i == entries.end() || i->duration_us != duration_us || i->path != path) return false;
+
+	entries.erase(i);
+	return true;
+}
+
+size_t castus4public_duration_index::range(const unsigned long long min_us,const unsigned long long max_us,std::vector<const entry*> &out) const {
+	entry e;
+
+	out.clear();
+	if (max_us < min_us) return 0;
+
+	e.duration_us = min_us;
+	for (std::vector<entry>::const_iterator i=std::lower_bound(entries.begin(),entries.end(),e);i!=entries.end() && i->duration_us <= max_us;i++)
+		out.push_back(&(*i));
+
+	return out.size();
+}
+
+const castus4public_duration_index::entry *castus4public_duration_index::longest_within(const unsigned long long max_us) const {
+	entry e;
+
+	if (max_us == ~0ULL) return entries.empty() ? NULL : &entries.back();
+
+	e.duration_us = max_us + 1ULL;
+	std::vector<entry>::const_iterator i = std::lower_bound(entries.begin(),entries.end(),e);
+	if (i == entries.begin()) return NULL;
+	return &(*(--i));
+}
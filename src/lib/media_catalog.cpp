@@ -0,0 +1,288 @@
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+#include <castus4-public/metadata.h>
+#include <castus4-public/metadata_batch.h>
+#include <castus4-public/media_catalog.h>
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+
+extern const char *castus4public_metadir_prefix;
+
+castus4public_media_catalog::castus4public_media_catalog() : watch_failures(0), watch_error(0), inotify_fd(-1), callback(NULL), callback_opaque(NULL) {
+}
+
+castus4public_media_catalog::~castus4public_media_catalog() {
+	close();
+}
+
+bool castus4public_media_catalog::open() {
+#ifdef HAVE_SYS_INOTIFY_H
+	if (inotify_fd >= 0) return true;
+
+	inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify_fd < 0) return false;
+
+	/* directories added before open() get their watches now */
+	rescan();
+	return true;
+#else
+	errno = ENOSYS;
+	return false;
+#endif
+}
+
+void castus4public_media_catalog::close() {
+	if (inotify_fd >= 0) {
+		::close(inotify_fd);
+		inotify_fd = -1;
+	}
+
+	watches.clear();
+	for (std::map<std::string,int>::iterator i=directories.begin();i!=directories.end();i++)
+		i->second = -1;
+}
+
+int castus4public_media_catalog::fd() const {
+	return inotify_fd;
+}
+
+void castus4public_media_catalog::set_callback(change_cb_t cb,void *opaque) {
+	callback = cb;
+	callback_opaque = opaque;
+}
+
+const castus4public_metadata_list *castus4public_media_catalog::lookup(const std::string &path) const {
+	std::unordered_map<std::string,castus4public_metadata_list>::const_iterator i = entries.find(path);
+	if (i == entries.end()) return NULL;
+	return &(i->second);
+}
+
+size_t castus4public_media_catalog::size() const {
+	return entries.size();
+}
+
+bool castus4public_media_catalog::watch_metadir(const std::string &dir_path,const char *name) {
+#ifdef HAVE_SYS_INOTIFY_H
+	if (inotify_fd < 0) return true;
+
+	const std::string metadir = dir_path + "/" + name;
+	const int wd = inotify_add_watch(inotify_fd,metadir.c_str(),
+		IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_ONLYDIR);
+	if (wd < 0) {
+		/* gone already, or not a directory: nothing to watch, and nothing missed */
+		if (errno == ENOENT || errno == ENOTDIR) return true;
+
+		watch_failures++;
+		watch_error = errno;
+		return false;
+	}
+
+	watch &w = watches[wd];
+	w.path = metadir;
+	w.media_path = dir_path + "/" + (name + strlen(castus4public_metadir_prefix));
+#endif
+	return true;
+}
+
+bool castus4public_media_catalog::add_directory(const char *dir_path) {
+	std::vector<castus4public_metadata_result> results;
+	std::string dir;
+	struct dirent *d;
+	DIR *dp;
+
+	if (dir_path == NULL) return false;
+	dir = dir_path;
+
+	/* recorded first, so that the next rescan tries again whatever fails below */
+	int &wd = directories[dir];
+	int watch_err = 0;
+
+	wd = -1;
+#ifdef HAVE_SYS_INOTIFY_H
+	/* watch before reading so that nothing changing meanwhile is missed */
+	if (inotify_fd >= 0) {
+		wd = inotify_add_watch(inotify_fd,dir_path,
+			IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_ONLYDIR);
+		if (wd < 0) {
+			watch_err = errno;
+			watch_failures++;
+			watch_error = watch_err;
+		}
+		else {
+			watches[wd].path = dir;
+			watches[wd].media_path.clear();
+		}
+	}
+#endif
+
+	if ((dp=opendir(dir_path)) == NULL) return false;
+	while ((d=readdir(dp)) != NULL) {
+		if (castus4public_is_metadata_dir(d->d_name) && !watch_metadir(dir,d->d_name) && watch_err == 0)
+			watch_err = errno;
+	}
+	closedir(dp);
+
+	if (!castus4public_read_metadata_dir(dir_path,results)) return false;
+	for (size_t i=0;i < results.size();i++) {
+		if (results[i].error != 0) continue;
+
+		std::unordered_map<std::string,castus4public_metadata_list>::iterator e = entries.find(results[i].path);
+		if (e != entries.end()) {
+			if (e->second.fields().duration_us != 0) durations.remove(e->first,e->second.fields().duration_us);
+		}
+		else {
+			e = entries.insert(std::make_pair(results[i].path,castus4public_metadata_list())).first;
+		}
+
+		e->second.list.swap(results[i].meta.list);
+		e->second.invalidate_fields();
+		if (e->second.fields().duration_us != 0) durations.add_unsorted(e->first,e->second.fields().duration_us);
+	}
+
+	durations.build();
+
+	/* loaded, but not followed */
+	if (watch_err != 0) {
+		errno = watch_err;
+		return false;
+	}
+
+	return true;
+}
+
+/* reread one media file's metadata, and tell the callback what became of it */
+void castus4public_media_catalog::refresh(const std::string &media_path) {
+	std::unordered_map<std::string,castus4public_metadata_list>::iterator i = entries.find(media_path);
+	const std::string meta_path = castus4public_file_to_metadata_file(media_path);
+	castus4public_metadata_list ml;
+	struct stat st;
+
+	if (stat(media_path.c_str(),&st) == 0 && S_ISREG(st.st_mode) && ml.read_metadata(meta_path.c_str())) {
+		enum change_type type = Changed;
+
+		if (i != entries.end()) {
+			if (i->second.list == ml.list) return;
+			if (i->second.fields().duration_us != 0) durations.remove(media_path,i->second.fields().duration_us);
+		}
+		else {
+			i = entries.insert(std::make_pair(media_path,castus4public_metadata_list())).first;
+			type = Added;
+		}
+
+		i->second.list.swap(ml.list);
+		i->second.invalidate_fields();
+		if (i->second.fields().duration_us != 0) durations.add(media_path,i->second.fields().duration_us);
+		if (callback != NULL) callback(*this,media_path,type,callback_opaque);
+	}
+	else if (i != entries.end()) {
+		if (i->second.fields().duration_us != 0) durations.remove(media_path,i->second.fields().duration_us);
+		entries.erase(i);
+		if (callback != NULL) callback(*this,media_path,Removed,callback_opaque);
+	}
+}
+
+/* after an event queue overflow: nothing can be trusted, start over */
+void castus4public_media_catalog::rescan() {
+	std::map<std::string,int> dirs;
+
+#ifdef HAVE_SYS_INOTIFY_H
+	for (std::map<int,watch>::iterator i=watches.begin();i!=watches.end();i++)
+		inotify_rm_watch(inotify_fd,i->first);
+#endif
+	watches.clear();
+	dirs.swap(directories);
+
+	std::unordered_map<std::string,castus4public_metadata_list> old;
+	old.swap(entries);
+	durations.clear();
+	for (std::map<std::string,int>::iterator i=dirs.begin();i!=dirs.end();i++)
+		add_directory(i->first.c_str());
+
+	if (callback == NULL) return;
+
+	for (std::unordered_map<std::string,castus4public_metadata_list>::iterator i=entries.begin();i!=entries.end();i++) {
+		std::unordered_map<std::string,castus4public_metadata_list>::iterator o = old.find(i->first);
+		if (o == old.end()) callback(*this,i->first,Added,callback_opaque);
+		else if (o->second.list != i->second.list) callback(*this,i->first,Changed,callback_opaque);
+	}
+	for (std::unordered_map<std::string,castus4public_metadata_list>::iterator i=old.begin();i!=old.end();i++) {
+		if (entries.find(i->first) == entries.end())
+			callback(*this,i->first,Removed,callback_opaque);
+	}
+}
+
+size_t castus4public_media_catalog::process_events() {
+#ifdef HAVE_SYS_INOTIFY_H
+	char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+	std::set<std::string> touched;
+	bool overflow = false;
+	ssize_t rd;
+
+	if (inotify_fd < 0) return 0;
+
+	/* collect everything queued first: one burst of events for a file is one refresh */
+	while ((rd=read(inotify_fd,buf,sizeof(buf))) > 0) {
+		for (char *p=buf;p < (buf+rd);) {
+			const struct inotify_event *ev = (const struct inotify_event*)p;
+			p += sizeof(struct inotify_event) + ev->len;
+
+			if (ev->mask & IN_Q_OVERFLOW) {
+				overflow = true;
+				continue;
+			}
+
+			std::map<int,watch>::iterator wi = watches.find(ev->wd);
+			if (wi == watches.end()) continue;
+
+			if (ev->mask & IN_IGNORED) {
+				watches.erase(wi);
+				continue;
+			}
+			if (ev->len == 0) continue;
+
+			const watch &w = wi->second;
+			if (!w.media_path.empty()) {
+				/* in a .castusmeta.* directory only the metadata file matters */
+				if (!strcmp(ev->name,"metadata"))
+					touched.insert(w.media_path);
+			}
+			else if (castus4public_is_metadata_dir(ev->name)) {
+				if ((ev->mask & (IN_CREATE | IN_MOVED_TO)) && (ev->mask & IN_ISDIR))
+					watch_metadir(w.path,ev->name);
+
+				touched.insert(w.path + "/" + (ev->name + strlen(castus4public_metadir_prefix)));
+			}
+			else if (ev->name[0] != '.') {
+				touched.insert(w.path + "/" + ev->name);
+			}
+		}
+	}
+
+	if (overflow) {
+		rescan();
+		return touched.size() + 1;
+	}
+
+	for (std::set<std::string>::iterator i=touched.begin();i!=touched.end();i++)
+		refresh(*i);
+
+	return touched.size();
+#else
+	return 0;
+#endif
+}
@@ -4,6 +4,8 @@
 #include <sys/file.h> /* flock */
 #include <assert.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -11,35 +13,74 @@
 #include <math.h>
 
 #include <castus4-public/metadata.h>
+#include <castus4-public/metadata_binary.h>
 #include <castus4-public/chomp.h>
 
+#include <atomic>
+
 const char *castus4public_metadir_prefix = ".castusmeta.";
 
-castus4public_metadata_list::castus4public_metadata_list() {
+castus4public_metadata_fields::castus4public_metadata_fields() : duration_us(0), width(0), height(0), frame_rate(0) {
 }
 
-castus4public_metadata_list::~castus4public_metadata_list() {
+void castus4public_metadata_fields::clear() {
+	duration_us = 0;
+	type.clear();
+	width = height = 0;
+	frame_rate = 0;
 }
 
-bool castus4public_metadata_list::read_metadata(const char *path) {
-	char line[4096];
-	char *equ;
-	FILE *fp;
+static const char *castus4public_metadata_fields_value(void *opaque,const char *name) {
+	const std::map<std::string,std::string> &list = *((const std::map<std::string,std::string>*)opaque);
+	std::map<std::string,std::string>::const_iterator i = list.find(name);
+	if (i == list.end()) return NULL;
+	return i->second.c_str();
+}
 
-	list.clear();
-	if (path == NULL) return false;
+void castus4public_metadata_fields::parse(const std::map<std::string,std::string> &list) {
+	parse(castus4public_metadata_fields_value,(void*)(&list));
+}
 
-	fp = fopen(path,"r");
-	if (!fp) return false;
+void castus4public_metadata_fields::parse(const char *(*get)(void *opaque,const char *name),void *opaque) {
+	const char *v;
 
-	/* Linux/POSIX offers file locking. Castus uses file locking for the metadata file. We do too.
-	 * You can skip this step but then you risk reading an incomplete metadata file if the user is updating
-	 * metadata from the web UI at exactly the same time */
-	if (::flock(fileno(fp),LOCK_EX)) {
-		fclose(fp);
-		return false;
+	clear();
+
+	if ((v=get(opaque,"duration")) != NULL) {
+		const double d = atof(v);
+		if (d > 0) duration_us = (unsigned long long)(d * 1000000);
 	}
 
+	if ((v=get(opaque,"type")) != NULL)
+		type = v;
+
+	if ((v=get(opaque,"width")) != NULL)
+		width = (unsigned int)strtoul(v,NULL,10);
+	if ((v=get(opaque,"height")) != NULL)
+		height = (unsigned int)strtoul(v,NULL,10);
+
+	if ((v=get(opaque,"frame rate")) != NULL) {
+		char *s = NULL;
+		double n = strtod(v,&s);
+
+		if (s != NULL && *s == '/') {
+			const double d = strtod(s+1,NULL);
+			n = d > 0 ? (n / d) : 0;
+		}
+		if (n > 0) frame_rate = n;
+	}
+}
+
+castus4public_metadata_list::castus4public_metadata_list() : fields_valid(false) {
+}
+
+castus4public_metadata_list::~castus4public_metadata_list() {
+}
+
+static void castus4public_metadata_parse(std::map<std::string,std::string> &list,FILE *fp) {
+	char line[4096];
+	char *equ;
+
 	while (!feof(fp) && !ferror(fp)) {
 		if (fgets(line,sizeof(line)-1,fp) == NULL) break;
 		castus4public_chomp(line);
@@ -60,28 +101,240 @@ bool castus4public_metadata_list::read_metadata(const char *path) {
 		else
 			list[line] += std::string("\n") + equ;
 	}
+}
+
+static bool castus4public_metadata_same_file(const struct stat &a,const struct stat &b) {
+	return a.st_dev == b.st_dev && a.st_ino == b.st_ino && a.st_size == b.st_size &&
+		a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+static const unsigned int castus4public_metadata_read_attempts = 4;
+
+bool castus4public_metadata_list::read_metadata(const char *path) {
+	return read_metadata_at(AT_FDCWD,path);
+}
+
+/* path is relative to dirfd (AT_FDCWD: the current directory), so a scan of one directory can
+ * open ".castusmeta.<name>/metadata" in it without the kernel walking the full path each time */
+bool castus4public_metadata_list::read_metadata_at(int dirfd,const char *path) {
+	struct stat before,after,now;
+	FILE *fp;
+	int fd;
+
+	list.clear();
+	fields_valid = false;
+	if (path == NULL) return false;
+
+	/* A metadata.bin made from the text file as it is now saves parsing it. The sidecar is only
+	 * ever replaced by rename, so it needs no lock; if the text file is replaced between the stat
+	 * and here, what we return is what a read just before that would have. */
+	if (fstatat(dirfd,path,&now,0) == 0) {
+		castus4public_metadata_binary bin;
+
+		if (bin.open_at(dirfd,castus4public_metadata_file_to_binary(path).c_str()) && bin.matches(now)) {
+			bin.to_list(*this);
+			return true;
+		}
+	}
+
+	for (unsigned int attempt=0;attempt < castus4public_metadata_read_attempts;attempt++) {
+		fd = openat(dirfd,path,O_RDONLY | O_CLOEXEC);
+		if (fd < 0) return false;
+
+		fp = fdopen(fd,"r");
+		if (!fp) {
+			close(fd);
+			return false;
+		}
+
+		/* Linux/POSIX offers file locking. Castus uses file locking for the metadata file. We do too.
+		 * You can skip this step but then you risk reading an incomplete metadata file if the user is updating
+		 * metadata from the web UI at exactly the same time. A shared lock is enough to keep writers out,
+		 * and readers do not hold each other up. */
+		if (::flock(fileno(fp),LOCK_SH)) {
+			fclose(fp);
+			return false;
+		}
+
+		if (fstat(fileno(fp),&before)) {
+			::flock(fileno(fp),LOCK_UN);
+			fclose(fp);
+			return false;
+		}
+
+		list.clear();
+		castus4public_metadata_parse(list,fp);
+
+		/* Writers that do not lock can still change the file under us, and write_metadata()
+		 * replaces it by rename, which leaves us reading the old one. Either way the file is no
+		 * longer what we started reading: read it again. */
+		const bool changed = fstat(fileno(fp),&after) || !castus4public_metadata_same_file(before,after) ||
+			fstatat(dirfd,path,&now,0) || now.st_dev != after.st_dev || now.st_ino != after.st_ino;
+
+		::flock(fileno(fp),LOCK_UN);
+		fclose(fp);
+
+		if (!changed) return true;
+	}
 
-	::flock(fileno(fp),LOCK_UN);
+	list.clear();
+	errno = EAGAIN;
+	return false;
+}
+
+/* Multi-line values go out as repeated name=value lines, as read_metadata() reads them */
+void castus4public_metadata_list::format_metadata(std::string &out) const {
+	out.clear();
+	for (std::map<std::string,std::string>::const_iterator i=list.begin();i!=list.end();i++) {
+		size_t pos = 0,nl;
+
+		do {
+			nl = i->second.find('\n',pos);
+			out += i->first;
+			out += '=';
+			out.append(i->second,pos,nl == std::string::npos ? std::string::npos : nl - pos);
+			out += '\n';
+			pos = nl + 1;
+		} while (nl != std::string::npos);
+	}
+}
+
+/* The text format has no escapes, so what comes back is not always what went out: a key with
+ * '=' in it splits, and a trailing '\r' or the rest of a line over 4K is lost or misread. Going
+ * through the same parser as read_metadata() gets whatever it would. */
+void castus4public_metadata_list::parse_metadata(const std::string &in) {
+	FILE *fp;
+
+	list.clear();
+	fields_valid = false;
+	if (in.empty()) return;
+
+	fp = fmemopen((void*)in.data(),in.length(),"r");
+	if (fp == NULL) return;
+
+	castus4public_metadata_parse(list,fp);
 	fclose(fp);
-	return true;
+}
+
+/* beside the target, unique to this process and call */
+std::string castus4public_metadata_temp_path(const std::string &path) {
+	static std::atomic<unsigned long> counter(0);
+	char tmp[64];
+
+	sprintf(tmp,".tmp.%ld.%lu",(long)getpid(),(unsigned long)(counter++));
+	return path + tmp;
+}
+
+int castus4public_metadata_create_temp(int dirfd,const std::string &path,std::string &tmp_path,const struct stat *like) {
+	int fd = -1;
+
+	/* the name is only hard to collide with, not to guess, so O_EXCL and a few tries */
+	for (unsigned int tries=0;fd < 0 && tries < 16;tries++) {
+		tmp_path = castus4public_metadata_temp_path(path);
+		fd = openat(dirfd,tmp_path.c_str(),O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,0666);
+		if (fd < 0 && errno != EEXIST) return -1;
+	}
+	if (fd < 0) return -1;
+
+	if (like != NULL) {
+		/* rename() would otherwise leave the file with our umask and owner. Giving it to another
+		 * user takes privilege we may not have; the group and mode are still copied then */
+		if ((like->st_uid != geteuid() || like->st_gid != getegid()) && fchown(fd,like->st_uid,like->st_gid))
+			(void)fchown(fd,(uid_t)-1,like->st_gid);
+
+		if (fchmod(fd,like->st_mode & 07777)) {
+			const int err = errno;
+			close(fd);
+			unlinkat(dirfd,tmp_path.c_str(),0);
+			errno = err;
+			return -1;
+		}
+	}
+
+	return fd;
+}
+
+bool castus4public_metadata_list::write_metadata(const char *path) const {
+	return write_metadata_at(AT_FDCWD,path);
+}
+
+/* Written to a temporary file beside the metadata file, synced, and renamed over it, so readers
+ * see the old file or the new one and never half of one. The old file is held LOCK_EX meanwhile
+ * to keep out writers that update it in place. A metadata.bin sidecar for the new file follows;
+ * until it is in place the old one no longer matches and is ignored. */
+bool castus4public_metadata_list::write_metadata_at(int dirfd,const char *path) const {
+	std::string tmp_path;
+	int lock_fd,fd;
+	FILE *fp;
+
+	if (path == NULL) return false;
+
+	lock_fd = openat(dirfd,path,O_RDONLY | O_CLOEXEC);
+	if (lock_fd >= 0 && ::flock(lock_fd,LOCK_EX)) {
+		close(lock_fd);
+		return false;
+	}
+
+	/* the new file keeps the old one's permissions and owner */
+	struct stat old_st;
+	const bool have_old = lock_fd >= 0 && fstat(lock_fd,&old_st) == 0;
+
+	fd = castus4public_metadata_create_temp(dirfd,path,tmp_path,have_old ? &old_st : NULL);
+	fp = fd >= 0 ? fdopen(fd,"w") : NULL;
+	if (fp == NULL) {
+		if (fd >= 0) close(fd);
+		if (lock_fd >= 0) close(lock_fd);
+		return false;
+	}
+
+	std::string out;
+	format_metadata(out);
+
+	struct stat st;
+	bool ok = fwrite(out.data(),1,out.length(),fp) == out.length() && fflush(fp) == 0 && fsync(fileno(fp)) == 0 && fstat(fileno(fp),&st) == 0;
+	ok = (fclose(fp) == 0) && ok;
+	ok = ok && renameat(dirfd,tmp_path.c_str(),dirfd,path) == 0;
+	if (!ok) unlinkat(dirfd,tmp_path.c_str(),0);
+
+	/* rename keeps the inode and mtime, so the stamp taken from the temp file is the new file's */
+	if (ok) castus4public_metadata_binary::write_at(dirfd,castus4public_metadata_file_to_binary(path).c_str(),*this,st);
+
+	if (lock_fd >= 0) close(lock_fd); /* drops the lock */
+	return ok;
 }
 
 void castus4public_metadata_list::clear() {
 	list.clear();
+	fields_valid = false;
+}
+
+const castus4public_metadata_fields &castus4public_metadata_list::fields() const {
+	if (!fields_valid) {
+		fields_cache.parse(list);
+		fields_valid = true;
+	}
+
+	return fields_cache;
+}
+
+void castus4public_metadata_list::invalidate_fields() {
+	fields_valid = false;
 }
 
-const char *castus4public_metadata_list::getValue(const char *name) {
-	std::map<std::string,std::string>::iterator i = list.find(name);
+const char *castus4public_metadata_list::getValue(const char *name) const {
+	std::map<std::string,std::string>::const_iterator i = list.find(name);
 	if (i == list.end()) return NULL;
 	return i->second.c_str();
 }
 
 void castus4public_metadata_list::setValue(const char *name,const char *value) {
 	list[name] = value;
+	fields_valid = false;
 }
 
 void castus4public_metadata_list::setValue(const char *name,std::string &value) {
 	list[name] = value;
+	fields_valid = false;
 }
 
 bool castus4public_is_metadata_dir(const char *path) {
@@ -119,3 +372,14 @@ std::string castus4public_file_to_metadata_dir(const std::string &path) {
 	return castus4public_file_to_metadata_dir(path.c_str());
 }
 
+std::string castus4public_file_to_metadata_file(const char *path) {
+	std::string res = castus4public_file_to_metadata_dir(path);
+
+	if (!res.empty()) res += "/metadata";
+	return res;
+}
+
+std::string castus4public_file_to_metadata_file(const std::string &path) {
+	return castus4public_file_to_metadata_file(path.c_str());
+}
+
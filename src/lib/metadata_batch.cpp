@@ -0,0 +1,145 @@
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <castus4-public/metadata.h>
+#include <castus4-public/metadata_batch.h>
+
+#include <system_error>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <vector>
+
+static const unsigned int castus4public_metadata_batch_default_threads = 16;
+
+castus4public_metadata_result::castus4public_metadata_result() : error(0) {
+}
+
+class castus4public_metadata_batch_job {
+public:
+	std::vector<castus4public_metadata_result>*	out;
+	std::vector<std::string>			meta_paths;	// relative to dirfd
+	int						dirfd;
+	std::atomic<size_t>				next;
+};
+
+static void castus4public_metadata_batch_read(castus4public_metadata_batch_job *job,const size_t i) {
+	castus4public_metadata_result &r = (*job->out)[i];
+
+	if (job->meta_paths[i].empty()) {
+		r.error = EINVAL;
+		return;
+	}
+
+	errno = 0;
+	if (!r.meta.read_metadata_at(job->dirfd,job->meta_paths[i].c_str())) {
+		r.error = errno != 0 ? errno : EIO;
+		r.meta.clear();
+	}
+}
+
+/* each worker takes the next unread file; results go to their own slots, so no locking */
+static void castus4public_metadata_batch_worker(castus4public_metadata_batch_job *job) {
+	size_t i;
+
+	while ((i=job->next++) < job->out->size())
+		castus4public_metadata_batch_read(job,i);
+}
+
+static void castus4public_metadata_batch_run(castus4public_metadata_batch_job &job,unsigned int threads) {
+	std::vector<std::thread> workers;
+
+	if (threads == 0) threads = castus4public_metadata_batch_default_threads;
+	if (threads > job.out->size()) threads = (unsigned int)job.out->size();
+
+	/* the calling thread is one of the workers */
+	try {
+		for (unsigned int t=1;t < threads;t++)
+			workers.push_back(std::thread(castus4public_metadata_batch_worker,&job));
+	}
+	catch (const std::system_error &) {
+		/* fewer threads than asked for still gets through the list */
+	}
+
+	castus4public_metadata_batch_worker(&job);
+	for (size_t t=0;t < workers.size();t++) workers[t].join();
+}
+
+bool castus4public_read_metadata_batch(const std::vector<std::string> &files,std::vector<castus4public_metadata_result> &out,unsigned int threads) {
+	return castus4public_read_metadata_batch_at(AT_FDCWD,files,out,threads);
+}
+
+bool castus4public_read_metadata_batch_at(int dirfd,const std::vector<std::string> &files,std::vector<castus4public_metadata_result> &out,unsigned int threads) {
+	castus4public_metadata_batch_job job;
+
+	out.clear();
+	out.resize(files.size());
+	job.out = &out;
+	job.dirfd = dirfd;
+	job.next = 0;
+	job.meta_paths.resize(files.size());
+	for (size_t i=0;i < files.size();i++) {
+		out[i].path = files[i];
+		job.meta_paths[i] = castus4public_file_to_metadata_file(files[i]);
+	}
+
+	castus4public_metadata_batch_run(job,threads);
+	return true;
+}
+
+/* The directory is opened once and everything after that is relative to it: readdir on the same
+ * fd, and each metadata file opened as ".castusmeta.<name>/metadata" from there. */
+bool castus4public_read_metadata_dir(const char *dir_path,std::vector<castus4public_metadata_result> &out,unsigned int threads) {
+	std::vector<std::string> names;
+	struct dirent *d;
+	struct stat st;
+	int dirfd,fd;
+	DIR *dir;
+
+	out.clear();
+	if (dir_path == NULL) return false;
+
+	dirfd = open(dir_path,O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirfd < 0) return false;
+
+	/* closedir() closes the fd it was given, so give it its own */
+	fd = dup(dirfd);
+	dir = fd >= 0 ? fdopendir(fd) : NULL;
+	if (dir == NULL) {
+		if (fd >= 0) close(fd);
+		close(dirfd);
+		return false;
+	}
+
+	while ((d=readdir(dir)) != NULL) {
+		if (d->d_name[0] == '.') continue;
+
+		if (d->d_type == DT_UNKNOWN || d->d_type == DT_LNK) {
+			if (fstatat(dirfd,d->d_name,&st,0) || !S_ISREG(st.st_mode)) continue;
+		}
+		else if (d->d_type != DT_REG) {
+			continue;
+		}
+
+		names.push_back(d->d_name);
+	}
+
+	closedir(dir);
+
+	castus4public_read_metadata_batch_at(dirfd,names,out,threads);
+	close(dirfd);
+
+	for (size_t i=0;i < out.size();i++)
+		out[i].path = std::string(dir_path) + "/" + out[i].path;
+
+	return true;
+}
@@ -0,0 +1,370 @@
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h> /* flock */
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <castus4-public/metadata.h>
+#include <castus4-public/metadata_binary.h>
+
+#include <string>
+#include <map>
+
+/*
+ * header (64 bytes):
+ *   char     magic[8]     "C4MBIN1\0"
+ *   uint32   byte_order   0x01020304 as written
+ *   uint32   count        number of records
+ *   uint64   dev, ino     of the text metadata file
+ *   int64    mtime_sec
+ *   int64    mtime_nsec
+ *   int64    size
+ *   uint64   strings      length of the string table
+ * records (16 bytes each, sorted by key as std::string compares):
+ *   uint32   key offset, key length, value offset, value length (into the string table)
+ * string table
+ */
+static const char castus4public_metadata_binary_magic[8] = { 'C','4','M','B','I','N','1',0 };
+static const uint32_t castus4public_metadata_binary_order = 0x01020304;
+static const size_t castus4public_metadata_binary_header = 64;
+static const size_t castus4public_metadata_binary_record = 16;
+
+template <class T> static T castus4public_metadata_binary_get(const unsigned char *p) {
+	T r;
+	memcpy(&r,p,sizeof(r)); /* no alignment assumed */
+	return r;
+}
+
+template <class T> static void castus4public_metadata_binary_put(std::string &out,const T v) {
+	out.append((const char*)(&v),sizeof(v));
+}
+
+castus4public_metadata_binary::castus4public_metadata_binary() : base(NULL), length(0), count(0), records(NULL), strings(NULL), strings_length(0) {
+}
+
+castus4public_metadata_binary::~castus4public_metadata_binary() {
+	close();
+}
+
+void castus4public_metadata_binary::close() {
+	if (base != NULL) munmap((void*)base,length);
+	base = records = strings = NULL;
+	length = count = strings_length = 0;
+}
+
+bool castus4public_metadata_binary::is_open() const {
+	return base != NULL;
+}
+
+bool castus4public_metadata_binary::open_at(int dirfd,const char *path) {
+	struct stat st;
+	void *p;
+	int fd;
+
+	close();
+	if (path == NULL) return false;
+
+	fd = openat(dirfd,path,O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return false;
+
+	if (fstat(fd,&st) || !S_ISREG(st.st_mode) || (size_t)st.st_size < castus4public_metadata_binary_header) {
+		::close(fd);
+		return false;
+	}
+
+	p = mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_SHARED,fd,0);
+	::close(fd); /* the mapping stays */
+	if (p == MAP_FAILED) return false;
+
+	base = (const unsigned char*)p;
+	length = (size_t)st.st_size;
+
+	if (memcmp(base,castus4public_metadata_binary_magic,8) != 0 ||
+		castus4public_metadata_binary_get<uint32_t>(base+8) != castus4public_metadata_binary_order) {
+		close();
+		return false;
+	}
+
+	count = castus4public_metadata_binary_get<uint32_t>(base+12);
+	strings_length = (size_t)castus4public_metadata_binary_get<uint64_t>(base+56);
+	if (count > (length - castus4public_metadata_binary_header) / castus4public_metadata_binary_record ||
+		strings_length != length - castus4public_metadata_binary_header - (count * castus4public_metadata_binary_record)) {
+		close();
+		return false;
+	}
+
+	records = base + castus4public_metadata_binary_header;
+	strings = records + (count * castus4public_metadata_binary_record);
+
+	/* check every offset once here so lookups need not */
+	for (size_t i=0;i < count;i++) {
+		const unsigned char *r = records + (i * castus4public_metadata_binary_record);
+
+		for (unsigned int j=0;j < 2;j++) {
+			const size_t o = castus4public_metadata_binary_get<uint32_t>(r+(j*8));
+			const size_t l = castus4public_metadata_binary_get<uint32_t>(r+(j*8)+4);
+
+			if (o > strings_length || l > strings_length - o) {
+				close();
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool castus4public_metadata_binary::matches(const struct stat &text_st) const {
+	if (base == NULL) return false;
+
+	return	castus4public_metadata_binary_get<uint64_t>(base+16) == (uint64_t)text_st.st_dev &&
+		castus4public_metadata_binary_get<uint64_t>(base+24) == (uint64_t)text_st.st_ino &&
+		castus4public_metadata_binary_get<int64_t>(base+32) == (int64_t)text_st.st_mtim.tv_sec &&
+		castus4public_metadata_binary_get<int64_t>(base+40) == (int64_t)text_st.st_mtim.tv_nsec &&
+		castus4public_metadata_binary_get<int64_t>(base+48) == (int64_t)text_st.st_size;
+}
+
+size_t castus4public_metadata_binary::size() const {
+	return count;
+}
+
+const char *castus4public_metadata_binary::key(const size_t i,size_t &len) const {
+	const unsigned char *r;
+
+	assert(i < count);
+	r = records + (i * castus4public_metadata_binary_record);
+	len = castus4public_metadata_binary_get<uint32_t>(r+4);
+	return (const char*)(strings + castus4public_metadata_binary_get<uint32_t>(r));
+}
+
+const char *castus4public_metadata_binary::value(const size_t i,size_t &len) const {
+	const unsigned char *r;
+
+	assert(i < count);
+	r = records + (i * castus4public_metadata_binary_record);
+	len = castus4public_metadata_binary_get<uint32_t>(r+12);
+	return (const char*)(strings + castus4public_metadata_binary_get<uint32_t>(r+8));
+}
+
+const char *castus4public_metadata_binary::find(const char *name,size_t &len) const {
+	const size_t name_len = name != NULL ? strlen(name) : 0;
+	size_t lo = 0,hi = count;
+
+	if (name == NULL) return NULL;
+
+	/* same order as std::string: bytes as unsigned, then the shorter first */
+	while (lo < hi) {
+		const size_t mid = lo + ((hi - lo) / 2);
+		size_t klen;
+		const char *k = key(mid,klen);
+		int c = memcmp(k,name,klen < name_len ? klen : name_len);
+
+		if (c == 0) c = klen < name_len ? -1 : (klen > name_len ? 1 : 0);
+		if (c == 0) return value(mid,len);
+		if (c < 0) lo = mid + 1;
+		else hi = mid;
+	}
+
+	return NULL;
+}
+
+void castus4public_metadata_binary::to_list(castus4public_metadata_list &meta) const {
+	std::map<std::string,std::string>::iterator hint;
+	size_t kl,vl;
+
+	meta.clear();
+	hint = meta.list.end();
+
+	/* records are already in map order, so every insert goes at the end */
+	for (size_t i=0;i < count;i++) {
+		const char *k = key(i,kl);
+		const char *v = value(i,vl);
+
+		hint = meta.list.insert(hint,std::pair<std::string,std::string>(std::string(k,kl),std::string(v,vl)));
+	}
+}
+
+class castus4public_metadata_binary_lookup {
+public:
+	const castus4public_metadata_binary*	bin;
+	std::string				value;	/* NUL terminated copy of the last one found */
+};
+
+static const char *castus4public_metadata_binary_get_value(void *opaque,const char *name) {
+	castus4public_metadata_binary_lookup *l = (castus4public_metadata_binary_lookup*)opaque;
+	size_t len;
+	const char *v = l->bin->find(name,len);
+
+	if (v == NULL) return NULL;
+	l->value.assign(v,len);
+	return l->value.c_str();
+}
+
+void castus4public_metadata_binary::to_fields(castus4public_metadata_fields &fields) const {
+	castus4public_metadata_binary_lookup l;
+
+	l.bin = this;
+	fields.parse(castus4public_metadata_binary_get_value,&l);
+}
+
+void castus4public_metadata_binary::format(std::string &out,const castus4public_metadata_list &src,const struct stat &text_st) {
+	castus4public_metadata_list meta;
+	std::string strtab;
+
+	/* the sidecar stands in for the text file, so it holds what reading that text gives, which
+	 * for some keys and values is not quite what the list held */
+	src.format_metadata(out);
+	meta.parse_metadata(out);
+
+	out.clear();
+	out.append(castus4public_metadata_binary_magic,8);
+	castus4public_metadata_binary_put<uint32_t>(out,castus4public_metadata_binary_order);
+	castus4public_metadata_binary_put<uint32_t>(out,(uint32_t)meta.list.size());
+	castus4public_metadata_binary_put<uint64_t>(out,(uint64_t)text_st.st_dev);
+	castus4public_metadata_binary_put<uint64_t>(out,(uint64_t)text_st.st_ino);
+	castus4public_metadata_binary_put<int64_t>(out,(int64_t)text_st.st_mtim.tv_sec);
+	castus4public_metadata_binary_put<int64_t>(out,(int64_t)text_st.st_mtim.tv_nsec);
+	castus4public_metadata_binary_put<int64_t>(out,(int64_t)text_st.st_size);
+
+	const size_t strings_at = out.length();
+	castus4public_metadata_binary_put<uint64_t>(out,0);
+	assert(out.length() == castus4public_metadata_binary_header);
+
+	for (std::map<std::string,std::string>::const_iterator i=meta.list.begin();i!=meta.list.end();i++) {
+		castus4public_metadata_binary_put<uint32_t>(out,(uint32_t)strtab.length());
+		castus4public_metadata_binary_put<uint32_t>(out,(uint32_t)i->first.length());
+		strtab += i->first;
+		castus4public_metadata_binary_put<uint32_t>(out,(uint32_t)strtab.length());
+		castus4public_metadata_binary_put<uint32_t>(out,(uint32_t)i->second.length());
+		strtab += i->second;
+	}
+
+	{
+		const uint64_t l = (uint64_t)strtab.length();
+		out.replace(strings_at,sizeof(l),(const char*)(&l),sizeof(l));
+	}
+
+	out += strtab;
+}
+
+bool castus4public_metadata_binary::write_at(int dirfd,const char *path,const castus4public_metadata_list &meta,const struct stat &text_st) {
+	std::string out,tmp_path;
+	int fd;
+
+	if (path == NULL) return false;
+
+	format(out,meta,text_st);
+
+	/* readable by whoever can read the text file, and no one else */
+	fd = castus4public_metadata_create_temp(dirfd,path,tmp_path,&text_st);
+	if (fd < 0) return false;
+
+	for (size_t done=0;done < out.length();) {
+		const ssize_t wr = write(fd,out.data() + done,out.length() - done);
+		if (wr < 0 && errno == EINTR) continue;
+		if (wr <= 0) {
+			::close(fd);
+			unlinkat(dirfd,tmp_path.c_str(),0);
+			return false;
+		}
+		done += (size_t)wr;
+	}
+
+	/* synced like the text file: a sidecar that survives a crash as zeros would still match */
+	bool ok = fsync(fd) == 0;
+	ok = (::close(fd) == 0) && ok;
+	if (!ok || renameat(dirfd,tmp_path.c_str(),dirfd,path)) {
+		unlinkat(dirfd,tmp_path.c_str(),0);
+		return false;
+	}
+
+	return true;
+}
+
+std::string castus4public_metadata_file_to_binary(const std::string &meta_path) {
+	return meta_path + ".bin";
+}
+
+bool castus4public_metadata_binary::update_at(int dirfd,const char *meta_path) {
+	struct stat st,now;
+	std::string text;
+	char buf[4096];
+	ssize_t rd;
+	int fd;
+
+	if (meta_path == NULL) return false;
+
+	const std::string bin_path = castus4public_metadata_file_to_binary(meta_path);
+
+	fd = openat(dirfd,meta_path,O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return false;
+
+	/* the shared lock keeps write_metadata() out until our sidecar is in place, so its newer one
+	 * always lands after ours */
+	if (::flock(fd,LOCK_SH) || fstat(fd,&st) || !S_ISREG(st.st_mode)) {
+		::close(fd);
+		return false;
+	}
+
+	/* replaced while we waited for the lock: this is not the file at meta_path any more */
+	if (fstatat(dirfd,meta_path,&now,0) || now.st_dev != st.st_dev || now.st_ino != st.st_ino) {
+		::close(fd);
+		errno = EAGAIN;
+		return false;
+	}
+
+	{
+		castus4public_metadata_binary bin;
+		if (bin.open_at(dirfd,bin_path.c_str()) && bin.matches(st)) {
+			::close(fd);
+			return true;
+		}
+	}
+
+	while ((rd=read(fd,buf,sizeof(buf))) != 0) {
+		if (rd < 0 && errno == EINTR) continue;
+		if (rd < 0) {
+			::close(fd);
+			return false;
+		}
+		text.append(buf,(size_t)rd);
+	}
+
+	castus4public_metadata_list meta;
+	meta.parse_metadata(text);
+
+	const bool ok = write_at(dirfd,bin_path.c_str(),meta,st);
+	::close(fd); /* drops the lock */
+	return ok;
+}
+
+bool castus4public_read_metadata_fields_at(int dirfd,const char *meta_path,castus4public_metadata_fields &fields) {
+	struct stat st;
+
+	fields.clear();
+	if (meta_path == NULL) return false;
+
+	/* as read_metadata_at() does: the sidecar is only ever replaced by rename, so no lock */
+	if (fstatat(dirfd,meta_path,&st,0) == 0) {
+		castus4public_metadata_binary bin;
+
+		if (bin.open_at(dirfd,castus4public_metadata_file_to_binary(meta_path).c_str()) && bin.matches(st)) {
+			bin.to_fields(fields);
+			return true;
+		}
+	}
+
+	castus4public_metadata_list meta;
+	if (!meta.read_metadata_at(dirfd,meta_path)) return false;
+
+	fields = meta.fields();
+	return true;
+}
@@ -0,0 +1,391 @@
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <castus4-public/metadata.h>
+#include <castus4-public/metadata_cache.h>
+#include <castus4-public/chomp.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <map>
+
+static const char *castus4public_metadata_cache_magic = "castus4-metacache 1";
+
+castus4public_metadata_cache::stamp::stamp() : dev(0), ino(0), mtime_sec(0), mtime_nsec(0), size(0) {
+}
+
+void castus4public_metadata_cache::stamp::from_stat(const struct stat &st) {
+	dev = (unsigned long long)st.st_dev;
+	ino = (unsigned long long)st.st_ino;
+	mtime_sec = (long long)st.st_mtim.tv_sec;
+	mtime_nsec = (long)st.st_mtim.tv_nsec;
+	size = (long long)st.st_size;
+}
+
+bool castus4public_metadata_cache::stamp::operator==(const stamp &a) const {
+	return dev == a.dev && ino == a.ino && mtime_sec == a.mtime_sec && mtime_nsec == a.mtime_nsec && size == a.size;
+}
+
+bool castus4public_metadata_cache::stamp::operator!=(const stamp &a) const {
+	return !(*this == a);
+}
+
+castus4public_metadata_cache::castus4public_metadata_cache() : trust_directory_mtime(false), dirty(false) {
+}
+
+castus4public_metadata_cache::~castus4public_metadata_cache() {
+}
+
+void castus4public_metadata_cache::clear() {
+	entries.clear();
+	directories.clear();
+	dirty = false;
+}
+
+const castus4public_metadata_list *castus4public_metadata_cache::lookup(const std::string &file_path) {
+	const std::string meta_path = castus4public_file_to_metadata_file(file_path);
+
+	if (meta_path.empty()) return NULL;
+	return lookup_at(AT_FDCWD,meta_path,file_path);
+}
+
+/* meta_path is relative to dirfd, the entry is filed under file_path */
+const castus4public_metadata_list *castus4public_metadata_cache::lookup_at(int dirfd,const std::string &meta_path,const std::string &file_path) {
+	struct stat st;
+	stamp s;
+
+	std::map<std::string,entry>::iterator i = entries.find(file_path);
+
+	if (fstatat(dirfd,meta_path.c_str(),&st,0) || !S_ISREG(st.st_mode)) {
+		if (i != entries.end()) {
+			entries.erase(i);
+			dirty = true;
+		}
+		return NULL;
+	}
+
+	s.from_stat(st);
+	if (i != entries.end() && i->second.st == s)
+		return &(i->second.meta);
+
+	entry &e = entries[file_path];
+	if (!e.meta.read_metadata_at(dirfd,meta_path.c_str())) {
+		entries.erase(file_path);
+		dirty = true;
+		return NULL;
+	}
+
+	e.st = s;
+	dirty = true;
+	return &e.meta;
+}
+
+/* The directory is opened once; readdir and every stat and open after that are relative to it */
+bool castus4public_metadata_cache::scan(const char *dir_path,scan_result &out) {
+	std::vector<std::string> names;
+	struct dirent *d;
+	struct stat st;
+	int dirfd,fd;
+	stamp s;
+	DIR *dir;
+
+	out.clear();
+	if (dir_path == NULL) return false;
+
+	dirfd = open(dir_path,O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirfd < 0) return false;
+
+	if (fstat(dirfd,&st)) {
+		close(dirfd);
+		return false;
+	}
+	s.from_stat(st);
+
+	std::map<std::string,directory>::iterator di = directories.find(dir_path);
+	if (trust_directory_mtime && di != directories.end() && di->second.st == s) {
+		bool complete = true;
+
+		for (size_t i=0;i < di->second.files.size();i++) {
+			std::map<std::string,entry>::iterator ei = entries.find(di->second.files[i]);
+			if (ei == entries.end()) {
+				complete = false;
+				break;
+			}
+			out.push_back(std::pair<std::string,const castus4public_metadata_list*>(ei->first,&(ei->second.meta)));
+		}
+
+		if (complete) {
+			close(dirfd);
+			return true;
+		}
+		out.clear();
+	}
+
+	/* closedir() closes the fd it was given, so give it its own */
+	fd = dup(dirfd);
+	dir = fd >= 0 ? fdopendir(fd) : NULL;
+	if (dir == NULL) {
+		if (fd >= 0) close(fd);
+		close(dirfd);
+		return false;
+	}
+
+	directory &nd = directories[dir_path];
+	std::vector<std::string> before;
+	before.swap(nd.files);
+	if (nd.st != s) {
+		nd.st = s;
+		dirty = true;
+	}
+
+	while ((d=readdir(dir)) != NULL) {
+		if (d->d_name[0] == '.') continue;
+
+		/* readdir already says what most entries are, only symlinks and the odd filesystem
+		 * that does not fill in d_type need a stat() */
+		if (d->d_type == DT_UNKNOWN || d->d_type == DT_LNK) {
+			if (fstatat(dirfd,d->d_name,&st,0) || !S_ISREG(st.st_mode)) continue;
+		}
+		else if (d->d_type != DT_REG) {
+			continue;
+		}
+
+		names.push_back(d->d_name);
+	}
+
+	closedir(dir);
+
+	/* entries can move in the map as others are added, so look them up once all are in */
+	std::vector<std::string> found;
+	for (size_t i=0;i < names.size();i++) {
+		const std::string file_path = std::string(dir_path) + "/" + names[i];
+
+		if (lookup_at(dirfd,castus4public_file_to_metadata_file(names[i]),file_path) != NULL)
+			found.push_back(file_path);
+	}
+
+	close(dirfd);
+
+	if (found != before) dirty = true;
+	nd.files = found;
+
+	/* forget media that has gone from the directory */
+	std::sort(found.begin(),found.end());
+	for (size_t i=0;i < before.size();i++) {
+		if (!std::binary_search(found.begin(),found.end(),before[i]))
+			entries.erase(before[i]);
+	}
+	found = nd.files;
+	for (size_t i=0;i < found.size();i++)
+		out.push_back(std::pair<std::string,const castus4public_metadata_list*>(found[i],&(entries[found[i]].meta)));
+
+	return true;
+}
+
+/* fields are tab separated; tabs, newlines and backslashes within them are escaped */
+static void castus4public_metadata_cache_put(std::string &out,const std::string &s) {
+	for (size_t i=0;i < s.length();i++) {
+		const char c = s[i];
+
+		if (c == '\\') out += "\\\\";
+		else if (c == '\n') out += "\\n";
+		else if (c == '\t') out += "\\t";
+		else out += c;
+	}
+}
+
+static void castus4public_metadata_cache_fields(const char *line,std::vector<std::string> &f) {
+	f.clear();
+	f.push_back(std::string());
+
+	for (;*line != 0;line++) {
+		if (*line == '\t') {
+			f.push_back(std::string());
+		}
+		else if (*line == '\\' && line[1] != 0) {
+			line++;
+			f.back() += *line == 'n' ? '\n' : (*line == 't' ? '\t' : *line);
+		}
+		else {
+			f.back() += *line;
+		}
+	}
+}
+
+static void castus4public_metadata_cache_put_stamp(std::string &out,const castus4public_metadata_cache::stamp &s) {
+	char tmp[160];
+
+	sprintf(tmp,"\t%llu\t%llu\t%lld\t%ld\t%lld\n",s.dev,s.ino,s.mtime_sec,s.mtime_nsec,s.size);
+	out += tmp;
+}
+
+static bool castus4public_metadata_cache_get_stamp(const std::vector<std::string> &f,castus4public_metadata_cache::stamp &s) {
+	if (f.size() != 7) return false;
+
+	s.dev = strtoull(f[2].c_str(),NULL,10);
+	s.ino = strtoull(f[3].c_str(),NULL,10);
+	s.mtime_sec = strtoll(f[4].c_str(),NULL,10);
+	s.mtime_nsec = strtol(f[5].c_str(),NULL,10);
+	s.size = strtoll(f[6].c_str(),NULL,10);
+	return true;
+}
+
+/*
+ * castus4-metacache 1
+ * dir <path> <dev> <ino> <mtime sec> <mtime nsec> <size>
+ * file <media path>                   (one per media file in the dir above)
+ * entry <media path> <dev> <ino> <mtime sec> <mtime nsec> <size>
+ * value <name> <value>                (one per metadata value of the entry above)
+ */
+bool castus4public_metadata_cache::load(const char *path) {
+	std::vector<std::string> f;
+	directory *cur_dir = NULL;
+	entry *cur_entry = NULL;
+	std::string line;
+	char tmp[4096];
+	bool ok = true;
+	FILE *fp;
+
+	clear();
+	if (path == NULL) return false;
+
+	/* the cache is trusted as if it were the metadata, so only take one that nobody else could
+	 * have written: ours, not writable by group or other, and not through a symlink */
+	{
+		struct stat st;
+		int fd;
+
+		fd = open(path,O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+		if (fd < 0) return false;
+
+		if (fstat(fd,&st) || !S_ISREG(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0 ||
+			(fp = fdopen(fd,"r")) == NULL) {
+			close(fd);
+			return false;
+		}
+	}
+
+	if (fgets(tmp,sizeof(tmp),fp) == NULL || (castus4public_chomp(tmp),strcmp(tmp,castus4public_metadata_cache_magic))) {
+		fclose(fp);
+		return false;
+	}
+
+	while (ok) {
+		/* lines can be longer than the buffer */
+		line.clear();
+		while (fgets(tmp,sizeof(tmp),fp) != NULL) {
+			line += tmp;
+			if (!line.empty() && line[line.length()-1] == '\n') break;
+		}
+		if (line.empty()) break;
+		if (line[line.length()-1] != '\n') {
+			ok = false;	/* truncated */
+			break;
+		}
+		line.resize(line.length()-1);
+
+		castus4public_metadata_cache_fields(line.c_str(),f);
+		if (f[0] == "dir") {
+			cur_dir = &directories[f.size() > 1 ? f[1] : std::string()];
+			cur_entry = NULL;
+			ok = castus4public_metadata_cache_get_stamp(f,cur_dir->st);
+		}
+		else if (f[0] == "file" && f.size() == 2 && cur_dir != NULL) {
+			cur_dir->files.push_back(f[1]);
+		}
+		else if (f[0] == "entry") {
+			cur_entry = &entries[f.size() > 1 ? f[1] : std::string()];
+			cur_dir = NULL;
+			ok = castus4public_metadata_cache_get_stamp(f,cur_entry->st);
+		}
+		else if (f[0] == "value" && f.size() == 3 && cur_entry != NULL) {
+			cur_entry->meta.list[f[1]] = f[2];
+			cur_entry->meta.invalidate_fields();
+		}
+		else {
+			ok = false;
+		}
+	}
+
+	fclose(fp);
+	if (!ok) clear();
+	dirty = false;
+	return ok;
+}
+
+bool castus4public_metadata_cache::save(const char *path) {
+	std::string out,tmp_path;
+	FILE *fp;
+
+	if (path == NULL) return false;
+
+	out = castus4public_metadata_cache_magic;
+	out += "\n";
+
+	for (std::map<std::string,directory>::iterator i=directories.begin();i!=directories.end();i++) {
+		out += "dir\t";
+		castus4public_metadata_cache_put(out,i->first);
+		castus4public_metadata_cache_put_stamp(out,i->second.st);
+		for (size_t j=0;j < i->second.files.size();j++) {
+			out += "file\t";
+			castus4public_metadata_cache_put(out,i->second.files[j]);
+			out += "\n";
+		}
+	}
+
+	for (std::map<std::string,entry>::iterator i=entries.begin();i!=entries.end();i++) {
+		out += "entry\t";
+		castus4public_metadata_cache_put(out,i->first);
+		castus4public_metadata_cache_put_stamp(out,i->second.st);
+		for (std::map<std::string,std::string>::iterator j=i->second.meta.list.begin();j!=i->second.meta.list.end();j++) {
+			out += "value\t";
+			castus4public_metadata_cache_put(out,j->first);
+			out += "\t";
+			castus4public_metadata_cache_put(out,j->second);
+			out += "\n";
+		}
+	}
+
+	/* write beside the target and rename over it, so the old cache stays whole until then. The
+	 * temporary file gets a name nobody can guess ahead, created 0600 by mkstemp() */
+	{
+		std::vector<char> name(strlen(path) + 8);
+		int fd;
+
+		sprintf(&name[0],"%s.XXXXXX",path);
+		fd = mkstemp(&name[0]);
+		if (fd < 0) return false;
+
+		tmp_path = &name[0];
+		fp = fdopen(fd,"w");
+		if (fp == NULL) {
+			close(fd);
+			unlink(tmp_path.c_str());
+			return false;
+		}
+	}
+
+	if (fwrite(out.data(),1,out.length(),fp) != out.length() || fflush(fp) || fsync(fileno(fp))) {
+		fclose(fp);
+		unlink(tmp_path.c_str());
+		return false;
+	}
+
+	if (fclose(fp) || rename(tmp_path.c_str(),path)) {
+		unlink(tmp_path.c_str());
+		return false;
+	}
+
+	dirty = false;
+	return true;
+}
@@ -0,0 +1,211 @@
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h> /* flock */
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/metadata.h>
+#include <castus4-public/metadata_writer.h>
+#include <castus4-public/metadata_binary.h>
+
+#include <string>
+#include <vector>
+#include <map>
+
+castus4public_metadata_writer::castus4public_metadata_writer() {
+}
+
+castus4public_metadata_writer::~castus4public_metadata_writer() {
+	abort();
+}
+
+size_t castus4public_metadata_writer::pending() const {
+	return files.size();
+}
+
+bool castus4public_metadata_writer::add(const std::string &media_path,const castus4public_metadata_list &meta) {
+	const std::string meta_dir = castus4public_file_to_metadata_dir(media_path);
+	std::string out;
+	struct stat st;
+	file f;
+	int fd;
+
+	if (meta_dir.empty()) {
+		failed.push_back(std::make_pair(media_path,EINVAL));
+		return false;
+	}
+
+	if (mkdir(meta_dir.c_str(),0777) && errno != EEXIST) {
+		failed.push_back(std::make_pair(media_path,errno));
+		return false;
+	}
+
+	f.media_path = media_path;
+	f.meta_path = meta_dir + "/metadata";
+
+	/* the new file keeps the old one's permissions and owner, and commit() checks it is still
+	 * the old one */
+	struct stat old_st;
+	f.had_old = stat(f.meta_path.c_str(),&old_st) == 0;
+	if (f.had_old) {
+		f.old_ino = old_st.st_ino;
+		f.old_mtime = old_st.st_mtim;
+		f.old_size = old_st.st_size;
+	}
+
+	fd = castus4public_metadata_create_temp(AT_FDCWD,f.meta_path,f.tmp_path,f.had_old ? &old_st : NULL);
+	if (fd < 0) {
+		failed.push_back(std::make_pair(media_path,errno));
+		return false;
+	}
+
+	meta.format_metadata(out);
+	for (size_t done=0;done < out.length();) {
+		const ssize_t wr = write(fd,out.data() + done,out.length() - done);
+		if (wr < 0 && errno == EINTR) continue;
+		if (wr <= 0) {
+			failed.push_back(std::make_pair(media_path,wr < 0 ? errno : EIO));
+			close(fd);
+			unlink(f.tmp_path.c_str());
+			return false;
+		}
+		done += (size_t)wr;
+	}
+
+	if (fstat(fd,&st)) {
+		failed.push_back(std::make_pair(media_path,errno));
+		close(fd);
+		unlink(f.tmp_path.c_str());
+		return false;
+	}
+
+	if (close(fd)) {
+		failed.push_back(std::make_pair(media_path,errno));
+		unlink(f.tmp_path.c_str());
+		return false;
+	}
+
+	/* remember one directory per filesystem to syncfs() later */
+	if (sync_fds.find(st.st_dev) == sync_fds.end()) {
+		const int dfd = open(meta_dir.c_str(),O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (dfd >= 0) sync_fds[st.st_dev] = dfd;
+	}
+
+	/* the sidecar is optional: if it cannot be staged the old one goes, as it would be stale */
+	f.bin_path = castus4public_metadata_file_to_binary(f.meta_path);
+	castus4public_metadata_binary::format(out,meta,st);
+	fd = castus4public_metadata_create_temp(AT_FDCWD,f.bin_path,f.bin_tmp_path,&st);
+	if (fd >= 0) {
+		bool ok = true;
+
+		for (size_t done=0;ok && done < out.length();) {
+			const ssize_t wr = write(fd,out.data() + done,out.length() - done);
+			if (wr < 0 && errno == EINTR) continue;
+			if (wr <= 0) ok = false;
+			else done += (size_t)wr;
+		}
+		if (close(fd)) ok = false;
+		if (!ok) {
+			unlink(f.bin_tmp_path.c_str());
+			f.bin_tmp_path.clear();
+		}
+	}
+	else {
+		f.bin_tmp_path.clear();
+	}
+
+	files.push_back(f);
+	return true;
+}
+
+/* is what lock_fd has open (-1: nothing there) still the file add() saw? */
+static bool castus4public_metadata_writer_same_file(const int lock_fd,const bool had_old,const ino_t ino,const struct timespec &mtime,const off_t size) {
+	struct stat st;
+
+	if (lock_fd < 0) return !had_old;
+	if (!had_old || fstat(lock_fd,&st)) return false;
+
+	return st.st_ino == ino && st.st_size == size &&
+		st.st_mtim.tv_sec == mtime.tv_sec && st.st_mtim.tv_nsec == mtime.tv_nsec;
+}
+
+bool castus4public_metadata_writer::sync_all() {
+	bool ok = true;
+
+	for (std::map<dev_t,int>::iterator i=sync_fds.begin();i!=sync_fds.end();i++) {
+		if (syncfs(i->second)) ok = false;
+	}
+
+	return ok;
+}
+
+bool castus4public_metadata_writer::commit() {
+	bool ok = true;
+
+	/* the new contents are on disk before any of them replaces an old file */
+	if (!sync_all()) {
+		const int err = errno;
+		for (size_t i=0;i < files.size();i++) failed.push_back(std::make_pair(files[i].media_path,err));
+		abort();
+		return false;
+	}
+
+	for (size_t i=0;i < files.size();i++) {
+		const file &f = files[i];
+		const int lock_fd = open(f.meta_path.c_str(),O_RDONLY | O_CLOEXEC);
+
+		if (lock_fd >= 0) ::flock(lock_fd,LOCK_EX);
+		if (!castus4public_metadata_writer_same_file(lock_fd,f.had_old,f.old_ino,f.old_mtime,f.old_size)) {
+			/* rewritten (or created, or removed) since add(): theirs wins */
+			failed.push_back(std::make_pair(f.media_path,ESTALE));
+			unlink(f.tmp_path.c_str());
+			if (!f.bin_tmp_path.empty()) unlink(f.bin_tmp_path.c_str());
+			if (lock_fd >= 0) close(lock_fd);
+			ok = false;
+			continue;
+		}
+		if (rename(f.tmp_path.c_str(),f.meta_path.c_str())) {
+			failed.push_back(std::make_pair(f.media_path,errno));
+			unlink(f.tmp_path.c_str());
+			if (!f.bin_tmp_path.empty()) unlink(f.bin_tmp_path.c_str());
+			if (lock_fd >= 0) close(lock_fd);
+			ok = false;
+			continue;
+		}
+		if (lock_fd >= 0) close(lock_fd); /* drops the lock */
+
+		if (!f.bin_tmp_path.empty()) {
+			if (rename(f.bin_tmp_path.c_str(),f.bin_path.c_str())) unlink(f.bin_tmp_path.c_str());
+		}
+		else {
+			unlink(f.bin_path.c_str());
+		}
+	}
+
+	files.clear();
+
+	/* and the renames */
+	if (!sync_all()) ok = false;
+
+	for (std::map<dev_t,int>::iterator i=sync_fds.begin();i!=sync_fds.end();i++) close(i->second);
+	sync_fds.clear();
+
+	return ok;
+}
+
+void castus4public_metadata_writer::abort() {
+	for (size_t i=0;i < files.size();i++) {
+		unlink(files[i].tmp_path.c_str());
+		if (!files[i].bin_tmp_path.empty()) unlink(files[i].bin_tmp_path.c_str());
+	}
+	files.clear();
+
+	for (std::map<dev_t,int>::iterator i=sync_fds.begin();i!=sync_fds.end();i++) close(i->second);
+	sync_fds.clear();
+}
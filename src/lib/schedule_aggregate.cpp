@@ -0,0 +1,176 @@
+
+#include <sys/types.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/schedule_object.h>
+#include <castus4-public/schedule_aggregate.h>
+
+#include <vector>
+#include <list>
+
+Castus4publicScheduleAggregate::Castus4publicScheduleAggregate() : bucket(60000000LL), length(0) {
+}
+
+Castus4publicScheduleAggregate::~Castus4publicScheduleAggregate() {
+}
+
+void Castus4publicScheduleAggregate::clear() {
+	starts.clear();
+	ends.clear();
+	prefix.clear();
+	bucket_first.clear();
+	length = 0;
+}
+
+class Castus4publicScheduleAggregateMatch {
+public:
+	const char*			name;
+	const char*			value;
+public:
+	static bool match(const Castus4publicSchedule::ScheduleItem &item,void *opaque) {
+		Castus4publicScheduleAggregateMatch *m = (Castus4publicScheduleAggregateMatch*)opaque;
+		const char *v = item.getValue(m->name);
+
+		if (v == NULL) return false;
+		if (m->value != NULL) return !strcmp(v,m->value);
+		return *v != 0 && strcmp(v,"0") != 0;
+	}
+};
+
+bool Castus4publicScheduleAggregate::build(const Castus4publicSchedule &schedule,const char *name,const char *value,const ideal_time_t bkt) {
+	Castus4publicScheduleAggregateMatch m;
+
+	m.name = name;
+	m.value = value;
+	return build(schedule,&Castus4publicScheduleAggregateMatch::match,&m,bkt);
+}
+
+bool Castus4publicScheduleAggregate::build(const Castus4publicSchedule &schedule,predicate_t pred,void *opaque,const ideal_time_t bkt) {
+	std::vector<Castus4publicSchedule::ideal_time_key> keys;
+	std::vector<ideal_time_t> item_ends;
+
+	clear();
+	if (bkt <= 0 || pred == NULL) return false;
+	bucket = bkt;
+	schedule.apply_time_shifts();
+
+	if (schedule.interval_length > 0)
+		length = (ideal_time_t)schedule.interval_length * (ideal_time_t)Castus4publicSchedule::ideal_hour_per_day *
+			(ideal_time_t)Castus4publicSchedule::ideal_min_per_hour * (ideal_time_t)Castus4publicSchedule::ideal_sec_per_min *
+			(ideal_time_t)Castus4publicSchedule::ideal_microsec_per_sec;
+
+	for (std::list<Castus4publicSchedule::ScheduleItem>::const_iterator i=schedule.schedule_items.begin();i!=schedule.schedule_items.end();i++) {
+		if (!pred(*i,opaque)) continue;
+
+		ideal_time_t start = i->getStartTime();
+		ideal_time_t end = i->getEndTime();
+		if (start == Castus4publicSchedule::ideal_time_t_invalid || end == Castus4publicSchedule::ideal_time_t_invalid || end <= start)
+			continue;
+
+		Castus4publicSchedule::ideal_time_key k;
+		k.time = start;
+		k.index = item_ends.size();
+		keys.push_back(k);
+		item_ends.push_back(end);
+	}
+
+	Castus4publicSchedule::radix_sort_time_keys(keys);
+
+	/* merge overlapping or touching intervals */
+	for (size_t i=0;i < keys.size();i++) {
+		ideal_time_t s = keys[i].time,e = item_ends[keys[i].index];
+
+		if (!ends.empty() && s <= ends.back()) {
+			if (e > ends.back()) ends.back() = e;
+		}
+		else {
+			starts.push_back(s);
+			ends.push_back(e);
+		}
+	}
+
+	prefix.resize(starts.size() + 1);
+	prefix[0] = 0;
+	for (size_t i=0;i < starts.size();i++)
+		prefix[i+1] = prefix[i] + (ends[i] - starts[i]);
+
+	ideal_time_t span = length;
+	if (!ends.empty() && ends.back() > span) span = ends.back();
+
+	size_t buckets = (size_t)(span / bucket) + 1;
+	bucket_first.resize(buckets);
+	for (size_t b=0,j=0;b < buckets;b++) {
+		ideal_time_t t = (ideal_time_t)b * bucket;
+		while (j < ends.size() && ends[j] <= t) j++;
+		bucket_first[b] = j;
+	}
+
+	return true;
+}
+
+Castus4publicSchedule::ideal_time_t Castus4publicScheduleAggregate::total() const {
+	return prefix.empty() ? 0 : prefix.back();
+}
+
+/* matching time in [0, t) */
+Castus4publicSchedule::ideal_time_t Castus4publicScheduleAggregate::covered_before(const ideal_time_t t) const {
+	if (t <= 0 || starts.empty()) return 0;
+
+	size_t b = (size_t)(t / bucket);
+	if (b >= bucket_first.size()) return total();
+
+	/* every interval before j ended by the start of this bucket */
+	size_t j = bucket_first[b];
+	while (j < starts.size() && ends[j] <= t) j++;
+
+	ideal_time_t sum = prefix[j];
+	if (j < starts.size() && starts[j] < t) sum += t - starts[j];
+	return sum;
+}
+
+Castus4publicSchedule::ideal_time_t Castus4publicScheduleAggregate::window_sum(const ideal_time_t a,const ideal_time_t b) const {
+	if (b <= a) return 0;
+
+	if (length > 0 && b > length) {
+		if ((b - a) >= length) return total();
+		if (a >= length) return window_sum(a - length,b - length);
+		return (covered_before(length) - covered_before(a)) + covered_before(b - length);
+	}
+
+	return covered_before(b) - covered_before(a);
+}
+
+/* The busiest window always either starts where a merged interval starts or ends where one
+ * ends, so those are the only candidates worth checking */
+Castus4publicSchedule::ideal_time_t Castus4publicScheduleAggregate::worst_window(const ideal_time_t window,ideal_time_t *start) const {
+	ideal_time_t best = 0,best_start = 0;
+
+	if (window <= 0) return 0;
+
+	for (size_t i=0;i < starts.size();i++) {
+		ideal_time_t s = starts[i];
+		ideal_time_t v = window_sum(s,s + window);
+		if (v > best) {
+			best = v;
+			best_start = s;
+		}
+
+		s = ends[i] - window;
+		if (s < 0) {
+			if (length <= 0) s = 0;
+			else s += length;
+		}
+		v = window_sum(s,s + window);
+		if (v > best) {
+			best = v;
+			best_start = s;
+		}
+	}
+
+	if (start != NULL) *start = best_start;
+	return best;
+}
@@ -0,0 +1,161 @@
+#include <sys/types.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/schedule_object.h>
+#include <castus4-public/schedule_blockjoin.h>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include <queue>
+#include <list>
+#include <set>
+
+Castus4publicScheduleBlockJoin::Castus4publicScheduleBlockJoin() {
+}
+
+Castus4publicScheduleBlockJoin::~Castus4publicScheduleBlockJoin() {
+}
+
+void Castus4publicScheduleBlockJoin::clear() {
+	items.clear();
+	blocks.clear();
+}
+
+/* time of [s,e) inside the block not yet counted, given everything before 'to' was */
+static Castus4publicSchedule::ideal_time_t Castus4publicScheduleBlockJoin_cover(Castus4publicSchedule::ideal_time_t &to,
+	Castus4publicSchedule::ideal_time_t s,Castus4publicSchedule::ideal_time_t e) {
+	if (s < to) s = to;
+	if (e <= s) return 0;
+	to = e;
+	return e - s;
+}
+
+/* item r overlaps block b */
+static void Castus4publicScheduleBlockJoin_visit(Castus4publicScheduleBlockJoin::ItemResult &r,Castus4publicScheduleBlockJoin::BlockResult &br,
+	const size_t b,const bool ad,Castus4publicSchedule::ideal_time_t &fill_to,Castus4publicSchedule::ideal_time_t &ad_to) {
+	if (br.start <= r.start && r.end <= br.end) {
+		if (r.block < 0) r.block = (long)b;
+		else r.partial.push_back(b);
+	}
+	else {
+		r.partial.push_back(b);
+	}
+
+	br.item_count++;
+
+	const Castus4publicSchedule::ideal_time_t s = std::max(r.start,br.start),e = std::min(r.end,br.end);
+	if (fill_to < br.start) fill_to = br.start;
+	if (ad_to < br.start) ad_to = br.start;
+	br.fill += Castus4publicScheduleBlockJoin_cover(fill_to,s,e);
+	if (ad) br.ad_time += Castus4publicScheduleBlockJoin_cover(ad_to,s,e);
+}
+
+bool Castus4publicScheduleBlockJoin::join(const Castus4publicSchedule &schedule) {
+	std::vector<Castus4publicSchedule::ideal_time_key> keys;
+	std::vector<ideal_time_t> fill_to,ad_to;
+	std::vector<bool> ads;
+
+	clear();
+	schedule.apply_time_shifts();
+
+	{
+		std::vector<BlockResult> tmp;
+
+		for (std::list<Castus4publicSchedule::ScheduleBlock>::const_iterator i=schedule.schedule_blocks.begin();i!=schedule.schedule_blocks.end();i++) {
+			BlockResult b;
+			Castus4publicSchedule::ideal_time_key k;
+
+			b.block = &(*i);
+			b.start = i->getStartTime();
+			b.end = i->getEndTime();
+			b.fill = b.ad_time = 0;
+			b.item_count = 0;
+			if (b.start == Castus4publicSchedule::ideal_time_t_invalid || b.end == Castus4publicSchedule::ideal_time_t_invalid || b.end < b.start)
+				continue;
+
+			k.time = b.start;
+			k.index = tmp.size();
+			keys.push_back(k);
+			tmp.push_back(b);
+		}
+
+		Castus4publicSchedule::radix_sort_time_keys(keys);
+		blocks.reserve(tmp.size());
+		for (size_t i=0;i < keys.size();i++) blocks.push_back(tmp[keys[i].index]);
+	}
+
+	{
+		std::vector<ItemResult> tmp;
+		std::vector<bool> tmp_ads;
+
+		keys.clear();
+		for (std::list<Castus4publicSchedule::ScheduleItem>::const_iterator i=schedule.schedule_items.begin();i!=schedule.schedule_items.end();i++) {
+			ItemResult r;
+			Castus4publicSchedule::ideal_time_key k;
+
+			r.item = &(*i);
+			r.start = i->getStartTime();
+			r.end = i->getEndTime();
+			r.block = -1;
+			if (r.start == Castus4publicSchedule::ideal_time_t_invalid || r.end == Castus4publicSchedule::ideal_time_t_invalid || r.end < r.start)
+				continue;
+
+			const char *v = i->getValue("advertisement");
+
+			k.time = r.start;
+			k.index = tmp.size();
+			keys.push_back(k);
+			tmp.push_back(r);
+			tmp_ads.push_back(v != NULL && atoi(v) > 0);
+		}
+
+		Castus4publicSchedule::radix_sort_time_keys(keys);
+		items.reserve(tmp.size());
+		ads.reserve(tmp.size());
+		for (size_t i=0;i < keys.size();i++) {
+			items.push_back(tmp[keys[i].index]);
+			ads.push_back(tmp_ads[keys[i].index]);
+		}
+	}
+
+	fill_to.resize(blocks.size(),0);
+	ad_to.resize(blocks.size(),0);
+
+	/* Blocks enter the active set as the item starts pass theirs and leave it, through a heap on
+	 * their ends, once the item starts pass those. An item then overlaps exactly the active
+	 * blocks plus those starting inside it, which come next in start order: each item visits
+	 * only blocks it overlaps, however long or nested they are. The active set is kept by block
+	 * index, so blocks are visited in start order as a plain scan would. */
+	std::priority_queue<std::pair<ideal_time_t,size_t>,std::vector<std::pair<ideal_time_t,size_t> >,
+		std::greater<std::pair<ideal_time_t,size_t> > > ending;
+	std::set<size_t> active;
+	size_t next = 0;
+
+	for (size_t i=0;i < items.size();i++) {
+		ItemResult &r = items[i];
+
+		for (;next < blocks.size() && blocks[next].start <= r.start;next++) {
+			if (blocks[next].end <= r.start) continue;
+			active.insert(next);
+			ending.push(std::make_pair(blocks[next].end,next));
+		}
+		while (!ending.empty() && ending.top().first <= r.start) {
+			active.erase(ending.top().second);
+			ending.pop();
+		}
+
+		for (std::set<size_t>::const_iterator a=active.begin();a!=active.end();a++)
+			Castus4publicScheduleBlockJoin_visit(r,blocks[*a],*a,ads[i],fill_to[*a],ad_to[*a]);
+
+		/* zero-length items are only inside blocks already active */
+		for (size_t b=next;b < blocks.size() && blocks[b].start < r.end;b++)
+			Castus4publicScheduleBlockJoin_visit(r,blocks[b],b,ads[i],fill_to[b],ad_to[b]);
+	}
+
+	return true;
+}
@@ -0,0 +1,438 @@
+#include <sys/types.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/schedule_object.h>
+#include <castus4-public/schedule_diff.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <map>
+
+Castus4publicScheduleDiff::Op::Op() : op(Add), record(Item), start(Castus4publicSchedule::ideal_time_t_invalid), hash(0),
+	new_start(Castus4publicSchedule::ideal_time_t_invalid), new_end(Castus4publicSchedule::ideal_time_t_invalid) {
+}
+
+Castus4publicScheduleDiff::Castus4publicScheduleDiff() {
+}
+
+Castus4publicScheduleDiff::~Castus4publicScheduleDiff() {
+}
+
+bool Castus4publicScheduleDiff::empty() const {
+	return ops.empty();
+}
+
+void Castus4publicScheduleDiff::clear() {
+	ops.clear();
+}
+
+class Castus4publicScheduleDiffRecord {
+public:
+	Castus4publicSchedule::ideal_time_t		start;
+	Castus4publicSchedule::ideal_time_t		end;
+	unsigned long long				hash;
+	unsigned long long				body;
+	const std::map<std::string,std::string>*	entry;
+	bool						matched;
+public:
+	bool operator<(const Castus4publicScheduleDiffRecord &a) const {
+		if (start != a.start) return start < a.start;
+		return hash < a.hash;
+	}
+	bool same(const Castus4publicScheduleDiffRecord &a) const {
+		return start == a.start && hash == a.hash;
+	}
+
+	template <class L> static void collect(std::vector<Castus4publicScheduleDiffRecord> &out,const L &list) {
+		std::vector<Castus4publicSchedule::ideal_time_key> keys;
+		std::vector<Castus4publicScheduleDiffRecord> tmp;
+
+		for (typename L::const_iterator i=list.begin();i!=list.end();i++) {
+			Castus4publicScheduleDiffRecord r;
+			Castus4publicSchedule::ideal_time_key k;
+
+			r.start = i->getStartTime();
+			r.end = i->getEndTime();
+			r.hash = i->getContentHash();
+			r.body = Castus4publicSchedule::entry_content_hash(i->entry,false);
+			r.entry = &(i->entry);
+			r.matched = false;
+
+			k.time = r.start;
+			k.index = tmp.size();
+			keys.push_back(k);
+			tmp.push_back(r);
+		}
+
+		/* by start time, then by hash within the (short) runs of equal start */
+		Castus4publicSchedule::radix_sort_time_keys(keys);
+		out.clear();
+		out.reserve(tmp.size());
+		for (size_t i=0;i < keys.size();i++) out.push_back(tmp[keys[i].index]);
+
+		for (size_t i=0;i < out.size();) {
+			size_t j = i + 1;
+			while (j < out.size() && out[j].start == out[i].start) j++;
+			if ((j - i) > 1) std::sort(out.begin() + i,out.begin() + j);
+			i = j;
+		}
+	}
+};
+
+static void Castus4publicScheduleDiff_records(std::vector<Castus4publicScheduleDiff::Op> &ops,
+	std::vector<Castus4publicScheduleDiffRecord> &a,std::vector<Castus4publicScheduleDiffRecord> &b,
+	const Castus4publicScheduleDiff::record_type rt) {
+	std::map<unsigned long long,std::deque<size_t> > by_body;
+	std::map<Castus4publicSchedule::ideal_time_t,std::deque<size_t> > by_start;
+	size_t i = 0,j = 0;
+
+	/* unchanged records */
+	while (i < a.size() && j < b.size()) {
+		if (a[i].same(b[j])) {
+			a[i++].matched = true;
+			b[j++].matched = true;
+		}
+		else if (a[i] < b[j]) {
+			i++;
+		}
+		else {
+			j++;
+		}
+	}
+
+	/* same content, new times */
+	for (i=0;i < a.size();i++) {
+		if (!a[i].matched) by_body[a[i].body].push_back(i);
+	}
+	for (j=0;j < b.size();j++) {
+		if (b[j].matched) continue;
+
+		std::map<unsigned long long,std::deque<size_t> >::iterator f = by_body.find(b[j].body);
+		if (f == by_body.end() || f->second.empty()) continue;
+
+		Castus4publicScheduleDiffRecord &o = a[f->second.front()];
+		f->second.pop_front();
+
+		Castus4publicScheduleDiff::Op op;
+		op.op = Castus4publicScheduleDiff::Retime;
+		op.record = rt;
+		op.start = o.start;
+		op.hash = o.hash;
+		op.new_start = b[j].start;
+		op.new_end = b[j].end;
+		ops.push_back(op);
+		o.matched = b[j].matched = true;
+	}
+
+	/* same start time, new content */
+	for (i=0;i < a.size();i++) {
+		if (!a[i].matched) by_start[a[i].start].push_back(i);
+	}
+	for (j=0;j < b.size();j++) {
+		if (b[j].matched) continue;
+
+		std::map<Castus4publicSchedule::ideal_time_t,std::deque<size_t> >::iterator f = by_start.find(b[j].start);
+		if (f == by_start.end() || f->second.empty()) continue;
+
+		Castus4publicScheduleDiffRecord &o = a[f->second.front()];
+		f->second.pop_front();
+
+		Castus4publicScheduleDiff::Op op;
+		op.op = Castus4publicScheduleDiff::Change;
+		op.record = rt;
+		op.start = o.start;
+		op.hash = o.hash;
+
+		for (std::map<std::string,std::string>::const_iterator k=b[j].entry->begin();k!=b[j].entry->end();k++) {
+			if (k->first == "start") continue;
+			if (k->first == "end") {
+				if (b[j].end != o.end) op.entry[k->first] = k->second;
+				continue;
+			}
+
+			std::map<std::string,std::string>::const_iterator p = o.entry->find(k->first);
+			if (p == o.entry->end() || p->second != k->second) op.entry[k->first] = k->second;
+		}
+		for (std::map<std::string,std::string>::const_iterator k=o.entry->begin();k!=o.entry->end();k++) {
+			if (k->first != "start" && b[j].entry->find(k->first) == b[j].entry->end())
+				op.deleted.push_back(k->first);
+		}
+
+		ops.push_back(op);
+		o.matched = b[j].matched = true;
+	}
+
+	for (i=0;i < a.size();i++) {
+		if (a[i].matched) continue;
+
+		Castus4publicScheduleDiff::Op op;
+		op.op = Castus4publicScheduleDiff::Remove;
+		op.record = rt;
+		op.start = a[i].start;
+		op.hash = a[i].hash;
+		ops.push_back(op);
+	}
+
+	for (j=0;j < b.size();j++) {
+		if (b[j].matched) continue;
+
+		Castus4publicScheduleDiff::Op op;
+		op.op = Castus4publicScheduleDiff::Add;
+		op.record = rt;
+		op.entry = *(b[j].entry);
+		ops.push_back(op);
+	}
+}
+
+bool Castus4publicScheduleDiff::compute(const Castus4publicSchedule &from,const Castus4publicSchedule &to) {
+	std::vector<Castus4publicScheduleDiffRecord> a,b;
+
+	clear();
+	from.apply_time_shifts();
+	to.apply_time_shifts();
+
+	Castus4publicScheduleDiffRecord::collect(a,from.schedule_blocks);
+	Castus4publicScheduleDiffRecord::collect(b,to.schedule_blocks);
+	Castus4publicScheduleDiff_records(ops,a,b,Block);
+
+	Castus4publicScheduleDiffRecord::collect(a,from.schedule_items);
+	Castus4publicScheduleDiffRecord::collect(b,to.schedule_items);
+	Castus4publicScheduleDiff_records(ops,a,b,Item);
+
+	return true;
+}
+
+template <class L> static bool Castus4publicScheduleDiff_resolve(L &list,const std::vector<Castus4publicScheduleDiff::Op> &ops,
+	const Castus4publicScheduleDiff::record_type rt,std::vector<typename L::iterator> &target) {
+	std::map<std::pair<Castus4publicSchedule::ideal_time_t,unsigned long long>,std::deque<typename L::iterator> > index;
+
+	for (typename L::iterator i=list.begin();i!=list.end();i++)
+		index[std::make_pair(i->getStartTime(),i->getContentHash())].push_back(i);
+
+	target.resize(ops.size(),list.end());
+	for (size_t i=0;i < ops.size();i++) {
+		if (ops[i].record != rt || ops[i].op == Castus4publicScheduleDiff::Add) continue;
+
+		typename std::map<std::pair<Castus4publicSchedule::ideal_time_t,unsigned long long>,std::deque<typename L::iterator> >::iterator f =
+			index.find(std::make_pair(ops[i].start,ops[i].hash));
+		if (f == index.end() || f->second.empty()) return false;
+
+		target[i] = f->second.front();
+		f->second.pop_front();
+	}
+
+	return true;
+}
+
+bool Castus4publicScheduleDiff::apply(Castus4publicSchedule &schedule) const {
+	std::vector<std::list<Castus4publicSchedule::ScheduleBlock>::iterator> blocks;
+	std::vector<Castus4publicSchedule::item_iterator> items;
+	bool blocks_changed = false,blocks_reordered = false;
+
+	schedule.apply_time_shifts();
+
+	if (!Castus4publicScheduleDiff_resolve(schedule.schedule_blocks,ops,Block,blocks)) return false;
+	if (!Castus4publicScheduleDiff_resolve(schedule.schedule_items,ops,Item,items)) return false;
+
+	schedule.begin_edit();
+	for (size_t i=0;i < ops.size();i++) {
+		const Op &op = ops[i];
+
+		if (op.record == Item) {
+			Castus4publicSchedule::item_iterator t = items[i];
+
+			if (op.op == Add) {
+				Castus4publicSchedule::ScheduleItem item(schedule.schedule_type);
+				for (std::map<std::string,std::string>::const_iterator k=op.entry.begin();k!=op.entry.end();k++)
+					item.setValue(k->first.c_str(),k->second);
+				schedule.insert_item(item);
+			}
+			else if (op.op == Remove) {
+				schedule.erase_item(t);
+			}
+			else if (op.op == Retime) {
+				schedule.retime_item(t,op.new_start,op.new_end);
+			}
+			else if (op.op == Change) {
+				for (std::map<std::string,std::string>::const_iterator k=op.entry.begin();k!=op.entry.end();k++)
+					schedule.set_item_value(t,k->first.c_str(),k->second.c_str());
+				for (size_t k=0;k < op.deleted.size();k++)
+					schedule.set_item_value(t,op.deleted[k].c_str(),NULL);
+			}
+		}
+		else {
+			std::list<Castus4publicSchedule::ScheduleBlock>::iterator t = blocks[i];
+
+			blocks_changed = true;
+			if (op.op == Add || op.op == Retime) blocks_reordered = true;
+
+			if (op.op == Add) {
+				Castus4publicSchedule::ScheduleBlock block(schedule.schedule_type);
+				for (std::map<std::string,std::string>::const_iterator k=op.entry.begin();k!=op.entry.end();k++)
+					block.setValue(k->first.c_str(),k->second);
+				schedule.schedule_blocks.push_back(block);
+			}
+			else if (op.op == Remove) {
+				schedule.schedule_blocks.erase(t);
+			}
+			else if (op.op == Retime) {
+				t->setStartTime(op.new_start);
+				if (op.new_end != Castus4publicSchedule::ideal_time_t_invalid) t->setEndTime(op.new_end);
+			}
+			else if (op.op == Change) {
+				for (std::map<std::string,std::string>::const_iterator k=op.entry.begin();k!=op.entry.end();k++)
+					t->setValue(k->first.c_str(),k->second);
+				for (size_t k=0;k < op.deleted.size();k++)
+					t->deleteValue(op.deleted[k].c_str());
+			}
+		}
+	}
+
+	/* blocks have no batch mode: put them back in order once here, as commit() does the items */
+	if (blocks_reordered)
+		schedule.sort_schedule_blocks();
+	else if (blocks_changed)
+		schedule.changed();
+
+	return schedule.commit();
+}
+
+static void Castus4publicScheduleDiff_escape(std::string &out,const std::string &s,const bool key) {
+	for (size_t i=0;i < s.length();i++) {
+		const char c = s[i];
+
+		if (c == '\\') out += "\\\\";
+		else if (c == '\n') out += "\\n";
+		else if (c == '\t') out += "\\t";
+		else if (key && (c == '=' || c == '!')) { out += '\\'; out += c; }
+		else out += c;
+	}
+}
+
+static const char Castus4publicScheduleDiff_op_chars[] = "+-~=";
+
+void Castus4publicScheduleDiff::write(std::string &out) const {
+	char tmp[128];
+
+	out = "c4diff 1\n";
+	for (size_t i=0;i < ops.size();i++) {
+		const Op &op = ops[i];
+
+		out += Castus4publicScheduleDiff_op_chars[op.op];
+		out += op.record == Item ? 'i' : 'b';
+		if (op.op != Add) {
+			sprintf(tmp," %lld %016llx",(long long)op.start,op.hash);
+			out += tmp;
+		}
+		if (op.op == Retime) {
+			sprintf(tmp," %lld %lld",(long long)op.new_start,(long long)op.new_end);
+			out += tmp;
+		}
+		out += '\n';
+
+		for (std::map<std::string,std::string>::const_iterator k=op.entry.begin();k!=op.entry.end();k++) {
+			out += '\t';
+			Castus4publicScheduleDiff_escape(out,k->first,true);
+			out += '=';
+			Castus4publicScheduleDiff_escape(out,k->second,false);
+			out += '\n';
+		}
+		for (size_t k=0;k < op.deleted.size();k++) {
+			out += "\t!";
+			Castus4publicScheduleDiff_escape(out,op.deleted[k],true);
+			out += '\n';
+		}
+	}
+}
+
+/* unescape s from i up to an unescaped stop character (or the end) */
+static std::string Castus4publicScheduleDiff_unescape(const std::string &s,size_t &i,const char stop) {
+	std::string r;
+
+	while (i < s.length() && s[i] != stop) {
+		if (s[i] == '\\' && (i+1) < s.length()) {
+			const char c = s[++i];
+			r += c == 'n' ? '\n' : (c == 't' ? '\t' : c);
+		}
+		else {
+			r += s[i];
+		}
+		i++;
+	}
+
+	return r;
+}
+
+bool Castus4publicScheduleDiff::read(const std::string &in) {
+	size_t pos = 0;
+	bool header = false;
+
+	clear();
+	while (pos < in.length()) {
+		size_t eol = in.find('\n',pos);
+		if (eol == std::string::npos) eol = in.length();
+		const std::string line = in.substr(pos,eol - pos);
+		pos = eol + 1;
+
+		if (line.empty()) continue;
+
+		if (!header) {
+			if (line != "c4diff 1") return false;
+			header = true;
+			continue;
+		}
+
+		if (line[0] == '\t') {
+			if (ops.empty()) return false;
+			Op &op = ops.back();
+			size_t i = 1;
+
+			if (line.length() > 1 && line[1] == '!') {
+				i = 2;
+				op.deleted.push_back(Castus4publicScheduleDiff_unescape(line,i,0));
+			}
+			else {
+				const std::string k = Castus4publicScheduleDiff_unescape(line,i,'=');
+				if (i >= line.length()) return false;
+				i++;
+				op.entry[k] = Castus4publicScheduleDiff_unescape(line,i,0);
+			}
+			continue;
+		}
+
+		const char *p = strchr(Castus4publicScheduleDiff_op_chars,line[0]);
+		if (p == NULL || *p == 0 || line.length() < 2 || (line[1] != 'i' && line[1] != 'b')) return false;
+
+		Op op;
+		op.op = (enum op_type)(p - Castus4publicScheduleDiff_op_chars);
+		op.record = line[1] == 'i' ? Item : Block;
+
+		if (op.op != Add) {
+			long long s = 0,ns = 0,ne = 0;
+			unsigned long long h = 0;
+
+			if (op.op == Retime) {
+				if (sscanf(line.c_str() + 2," %lld %llx %lld %lld",&s,&h,&ns,&ne) != 4) return false;
+				op.new_start = ns;
+				op.new_end = ne;
+			}
+			else if (sscanf(line.c_str() + 2," %lld %llx",&s,&h) != 2) {
+				return false;
+			}
+
+			op.start = s;
+			op.hash = h;
+		}
+
+		ops.push_back(op);
+	}
+
+	return header;
+}
@@ -0,0 +1,127 @@
+#include <sys/types.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/parsetime.h>
+#include <castus4-public/schedule_object.h>
+
+#include <string>
+#include <list>
+#include <map>
+
+/* FNV-1a over the canonical bytes, then a 64-bit finalizer so that records differing in one
+ * character still differ in every part of the hash (the schedule hash adds them up) */
+static void Castus4publicSchedule_hash_bytes(unsigned long long &h,const void *p,size_t len) {
+	const unsigned char *s = (const unsigned char*)p;
+
+	for (size_t i=0;i < len;i++) {
+		h ^= (unsigned long long)s[i];
+		h *= 0x100000001B3ULL;
+	}
+}
+
+static void Castus4publicSchedule_hash_number(unsigned long long &h,const long long v) {
+	unsigned char b[8];
+
+	for (unsigned int i=0;i < 8;i++) b[i] = (unsigned char)((unsigned long long)v >> (i * 8));
+	Castus4publicSchedule_hash_bytes(h,b,sizeof(b));
+}
+
+static void Castus4publicSchedule_hash_entries(unsigned long long &h,const std::map<std::string,std::string> &entry,const bool skip_times) {
+	for (std::map<std::string,std::string>::const_iterator i=entry.begin();i!=entry.end();i++) {
+		if (skip_times && (i->first == "start" || i->first == "end")) continue;
+		Castus4publicSchedule_hash_bytes(h,i->first.c_str(),i->first.length() + 1);
+		Castus4publicSchedule_hash_bytes(h,i->second.c_str(),i->second.length() + 1);
+	}
+}
+
+static unsigned long long Castus4publicSchedule_hash_final(unsigned long long h) {
+	h ^= h >> 30;
+	h *= 0xBF58476D1CE4E5B9ULL;
+	h ^= h >> 27;
+	h *= 0x94D049BB133111EBULL;
+	h ^= h >> 31;
+	return h;
+}
+
+static Castus4publicSchedule::ideal_time_t Castus4publicSchedule_entry_time(const std::map<std::string,std::string> &entry,const char *name) {
+	std::map<std::string,std::string>::const_iterator i = entry.find(name);
+	if (i == entry.end()) return Castus4publicSchedule::ideal_time_t_invalid;
+
+	int sch_type = 0;
+	unsigned long sub_us = 0;
+	struct tm t = castus4_schedule_parse_time(i->second.c_str(),&sub_us,&sch_type);
+
+	return Castus4publicSchedule::time_tm_to_ideal_time(t,sub_us,sch_type);
+}
+
+unsigned long long Castus4publicSchedule::entry_content_hash(const std::map<std::string,std::string> &entry,const bool with_times) {
+	unsigned long long h = 0xCBF29CE484222325ULL;
+
+	Castus4publicSchedule_hash_entries(h,entry,true);
+	if (with_times) {
+		Castus4publicSchedule_hash_number(h,Castus4publicSchedule_entry_time(entry,"start"));
+		Castus4publicSchedule_hash_number(h,Castus4publicSchedule_entry_time(entry,"end"));
+	}
+
+	return Castus4publicSchedule_hash_final(h);
+}
+
+unsigned long long Castus4publicSchedule::ScheduleItem::getContentHash() const {
+	if (!hash_cache_valid) {
+		hash_cache = entry_content_hash(entry,true);
+		hash_cache_valid = true;
+	}
+
+	return hash_cache;
+}
+
+void Castus4publicSchedule::ScheduleItem::invalidateContentHash() {
+	entryChanged();
+}
+
+unsigned long long Castus4publicSchedule::ScheduleBlock::getContentHash() const {
+	if (!hash_cache_valid) {
+		hash_cache = entry_content_hash(entry,true);
+		hash_cache_valid = true;
+	}
+
+	return hash_cache;
+}
+
+void Castus4publicSchedule::ScheduleBlock::invalidateContentHash() {
+	entryChanged();
+}
+
+/* Items and blocks are summed, so the result does not depend on their order and one edited
+ * record costs one rehash; the sums are mixed in with distinct tags so moving a record from
+ * items to blocks changes the hash */
+unsigned long long Castus4publicSchedule::content_hash() const {
+	unsigned long long items = 0,blocks = 0;
+	unsigned long long h = 0xCBF29CE484222325ULL;
+
+	apply_time_shifts();
+	for (std::list<ScheduleItem>::const_iterator i=schedule_items.begin();i!=schedule_items.end();i++)
+		items += i->getContentHash();
+	for (std::list<ScheduleBlock>::const_iterator i=schedule_blocks.begin();i!=schedule_blocks.end();i++)
+		blocks += i->getContentHash();
+
+	Castus4publicSchedule_hash_number(h,schedule_type);
+	Castus4publicSchedule_hash_number(h,interval_length);
+	Castus4publicSchedule_hash_bytes(h,"g",2);
+	Castus4publicSchedule_hash_entries(h,global_values,false);
+	Castus4publicSchedule_hash_bytes(h,"d",2);
+	Castus4publicSchedule_hash_bytes(h,defaults_type.c_str(),defaults_type.length() + 1);
+	Castus4publicSchedule_hash_entries(h,defaults_values,false);
+	Castus4publicSchedule_hash_bytes(h,"i",2);
+	Castus4publicSchedule_hash_number(h,(long long)schedule_items.size());
+	Castus4publicSchedule_hash_number(h,(long long)items);
+	Castus4publicSchedule_hash_bytes(h,"b",2);
+	Castus4publicSchedule_hash_number(h,(long long)schedule_blocks.size());
+	Castus4publicSchedule_hash_number(h,(long long)blocks);
+
+	return Castus4publicSchedule_hash_final(h);
+}
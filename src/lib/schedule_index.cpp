@@ -0,0 +1,757 @@
+
+#include <sys/types.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/parsetime.h>
+#include <castus4-public/schedule_object.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+
+/* Ordered item mode.
+ *
+ * The items stay in schedule_items (so everything that walks the list keeps working), and a
+ * treap keyed on (start time, sequence) sits next to it. Each node points at its list element.
+ * Inserting or retiming an item looks up its successor in the treap in O(log n) and splices the
+ * list node in front of it, so the list is in start time order at all times and the final
+ * sort_schedule_items() a filter does only has to check that, in O(n), before returning.
+ *
+ * The sequence number keeps items with the same start time in the order they were added,
+ * the same as the stable sort does.
+ *
+ * shift_items() moves every item from a given time onward by the same amount. Shifting a
+ * suffix of the treap never reorders it, so the shift is a split, an add to the root of the
+ * right half, and a merge: O(log n). The add is pushed down lazily, and each node remembers that
+ * its item's start/end strings are stale. The strings are only rewritten when the item is read
+ * through the schedule, retimed, or written out (apply_time_shifts()).
+ *
+ * Inside begin_edit()/commit() the index is dropped and edits go straight to the list, each
+ * O(1). commit() then does one radix sort and one linear index build for the whole batch. */
+
+class Castus4publicSchedule::ItemIndex {
+public:
+	class Node {
+	public:
+		Node(item_iterator item,ideal_time_t start,ideal_time_t end,unsigned long long seq,unsigned int prio) :
+			start(start), end(end), lazy(0), seq(seq), prio(prio), dirty(false),
+			left(NULL), right(NULL), parent(NULL), item(item) {
+		}
+	public:
+		bool less(const ideal_time_t s,const unsigned long long q) const {
+			return start < s || (start == s && seq < q);
+		}
+
+		/* shift this node, and (lazily) everything below it */
+		void add(const ideal_time_t delta) {
+			start += delta;
+			if (end != ideal_time_t_invalid) end += delta;
+			lazy += delta;
+			dirty = true;
+		}
+
+		void push() {
+			if (lazy != 0) {
+				if (left != NULL) left->add(lazy);
+				if (right != NULL) right->add(lazy);
+				lazy = 0;
+			}
+		}
+
+		/* write the shifted times back into the item's strings */
+		void fold() {
+			if (dirty) {
+				item->setStartTime(start);
+				if (end != ideal_time_t_invalid) item->setEndTime(end);
+				dirty = false;
+			}
+		}
+	public:
+		ideal_time_t			start;		// valid once every ancestor has been pushed
+		ideal_time_t			end;
+		ideal_time_t			lazy;		// pending shift for the children
+		unsigned long long		seq;
+		unsigned int			prio;
+		bool				dirty;		// start/end differ from the item's strings
+		Node*				left;
+		Node*				right;
+		Node*				parent;
+		item_iterator			item;
+	};
+public:
+	ItemIndex() : root(NULL), next_seq(0), generation(0), pending(false), rng(0x2545F491U) {
+	}
+	~ItemIndex() {
+		clear();
+	}
+public:
+	void clear() {
+		for (std::map<const ScheduleItem*,Node*>::iterator i=nodes.begin();i!=nodes.end();i++)
+			delete i->second;
+
+		nodes.clear();
+		root = NULL;
+		next_seq = 0;
+		pending = false;
+	}
+
+	/* items must already be in start time order */
+	void build(std::list<ScheduleItem> &items) {
+		std::vector<Node*> spine;
+
+		clear();
+
+		/* linear time treap construction from sorted input: keep the right spine on a stack */
+		for (item_iterator i=items.begin();i!=items.end();i++) {
+			Node *n = new_node(i,i->getStartTime(),i->getEndTime());
+			Node *last = NULL;
+
+			while (!spine.empty() && spine.back()->prio < n->prio) {
+				last = spine.back();
+				spine.pop_back();
+			}
+
+			n->left = last;
+			if (last != NULL) last->parent = n;
+			if (!spine.empty()) {
+				spine.back()->right = n;
+				n->parent = spine.back();
+			}
+			spine.push_back(n);
+		}
+
+		root = spine.empty() ? NULL : spine.front();
+	}
+
+	Node *insert(item_iterator i,ideal_time_t start,ideal_time_t end) {
+		Node *n = new_node(i,start,end);
+		link(n);
+		return n;
+	}
+
+	/* detach n from the tree, but keep the node */
+	void unlink(Node *n) {
+		Node *l,*m,*r;
+
+		touch(n);
+		split(root,n->start,n->seq,l,m);
+		split(m,n->start,n->seq + 1ULL,m,r);
+		assert(m == n && n->left == NULL && n->right == NULL);
+		set_root(merge(l,r));
+	}
+
+	void link(Node *n) {
+		Node *l,*r;
+
+		n->left = n->right = n->parent = NULL;
+		split(root,n->start,n->seq,l,r);
+		set_root(merge(merge(l,n),r));
+	}
+
+	void erase(Node *n) {
+		unlink(n);
+		nodes.erase(&(*n->item));
+		delete n;
+	}
+
+	/* push every pending shift down the path from the root to n, so n's times are current */
+	void touch(Node *n) {
+		std::vector<Node*> path;
+
+		for (Node *p=n->parent;p != NULL;p=p->parent) path.push_back(p);
+		while (!path.empty()) {
+			path.back()->push();
+			path.pop_back();
+		}
+	}
+
+	/* shift every node sorting at or after from; returns the nodes that now have to move
+	 * ahead of earlier ones (only possible when delta < 0), in descending order */
+	bool shift(const ideal_time_t from,const ideal_time_t delta,std::vector<Node*> &moved) {
+		Node *l,*r,*l1,*l2;
+
+		moved.clear();
+		if (delta == 0) return true;
+
+		split(root,from,0,l,r);
+		if (r == NULL) {
+			set_root(l);
+			return true;
+		}
+
+		if (delta < 0) {
+			Node *first = r;
+			for (first->push();first->left != NULL;first=first->left) first->left->push();
+			if (first->start + delta < 0) { /* would run into the start of the schedule */
+				set_root(merge(l,r));
+				return false;
+			}
+		}
+
+		r->add(delta);
+		pending = true;
+		if (delta > 0) {
+			set_root(merge(l,r));
+			return true;
+		}
+
+		/* whatever sat in [from+delta, from) is now interleaved with the shifted part */
+		split(l,from + delta,0,l1,l2);
+		set_root(merge(l1,r));
+		collect(l2,moved);
+		for (size_t i=0;i < moved.size();i++) link(moved[i]);
+		std::reverse(moved.begin(),moved.end());
+		return true;
+	}
+
+	void fold_all() {
+		if (pending) fold(root);
+		pending = false;
+	}
+
+	/* n's times with every pending shift above it added, without pushing anything; true if
+	 * they differ from what the item's strings say */
+	bool current_times(const Node *n,ideal_time_t &start,ideal_time_t &end) const {
+		ideal_time_t delta = 0;
+
+		for (const Node *p=n->parent;p != NULL;p=p->parent) delta += p->lazy;
+
+		start = n->start + delta;
+		end = (n->end != ideal_time_t_invalid) ? n->end + delta : ideal_time_t_invalid;
+		return n->dirty || delta != 0;
+	}
+
+	Node *find(const ScheduleItem *item) const {
+		std::map<const ScheduleItem*,Node*>::const_iterator i = nodes.find(item);
+		return (i != nodes.end()) ? i->second : NULL;
+	}
+
+	/* first node that sorts after (start, seq), or NULL */
+	Node *successor(const ideal_time_t start,const unsigned long long seq) const {
+		Node *t = root,*best = NULL;
+
+		while (t != NULL) {
+			t->push();
+			if (t->less(start,seq) || (t->start == start && t->seq == seq)) {
+				t = t->right;
+			}
+			else {
+				best = t;
+				t = t->left;
+			}
+		}
+
+		return best;
+	}
+
+	size_t size() const {
+		return nodes.size();
+	}
+
+	Node *first() const {
+		Node *t = root;
+		while (t != NULL && t->left != NULL) t = t->left;
+		return t;
+	}
+
+	Node *last() const {
+		Node *t = root;
+		while (t != NULL && t->right != NULL) t = t->right;
+		return t;
+	}
+
+	void in_order(std::vector<Node*> &out) {
+		out.clear();
+		out.reserve(nodes.size());
+		collect(root,out);
+	}
+private:
+	Node *new_node(item_iterator i,ideal_time_t start,ideal_time_t end) {
+		/* xorshift32, the priorities only need to be well mixed */
+		rng ^= rng << 13U;
+		rng ^= rng >> 17U;
+		rng ^= rng << 5U;
+
+		Node *n = new Node(i,start,end,next_seq++,rng);
+		nodes[&(*i)] = n;
+		return n;
+	}
+
+	void set_root(Node *t) {
+		root = t;
+		if (root != NULL) root->parent = NULL;
+	}
+
+	/* l gets every node sorting before (start, seq), r the rest */
+	static void split(Node *t,const ideal_time_t start,const unsigned long long seq,Node* &l,Node* &r) {
+		if (t == NULL) {
+			l = r = NULL;
+			return;
+		}
+
+		t->push();
+		if (t->less(start,seq)) {
+			split(t->right,start,seq,t->right,r);
+			if (t->right != NULL) t->right->parent = t;
+			l = t;
+		}
+		else {
+			split(t->left,start,seq,l,t->left);
+			if (t->left != NULL) t->left->parent = t;
+			r = t;
+		}
+	}
+
+	static Node *merge(Node *l,Node *r) {
+		if (l == NULL) return r;
+		if (r == NULL) return l;
+
+		if (l->prio > r->prio) {
+			l->push();
+			l->right = merge(l->right,r);
+			l->right->parent = l;
+			return l;
+		}
+		else {
+			r->push();
+			r->left = merge(l,r->left);
+			r->left->parent = r;
+			return r;
+		}
+	}
+
+	/* in order, pushing shifts down on the way */
+	static void collect(Node *t,std::vector<Node*> &out) {
+		if (t == NULL) return;
+		t->push();
+		collect(t->left,out);
+		out.push_back(t);
+		collect(t->right,out);
+	}
+
+	static void fold(Node *t) {
+		if (t == NULL) return;
+		t->push();
+		t->fold();
+		fold(t->left);
+		fold(t->right);
+	}
+public:
+	std::map<const ScheduleItem*,Node*>	nodes;
+	Node*					root;
+	unsigned long long			next_seq;
+	unsigned long long			generation;	// the schedule's generation the index last matched
+	bool					pending;	// shifts not yet written to the item strings
+	unsigned int				rng;
+};
+
+Castus4publicSchedule::ItemIndexRef::ItemIndexRef() : index(NULL) {
+}
+
+/* the nodes point into the other schedule's list, so never share them. The schedule's copy
+ * constructor writes any pending shifts into the copied items. */
+Castus4publicSchedule::ItemIndexRef::ItemIndexRef(const ItemIndexRef &) : index(NULL) {
+}
+
+Castus4publicSchedule::ItemIndexRef::~ItemIndexRef() {
+	reset();
+}
+
+Castus4publicSchedule::ItemIndexRef &Castus4publicSchedule::ItemIndexRef::operator=(const ItemIndexRef &a) {
+	if (this != &a) reset();
+	return *this;
+}
+
+/* drops the index, and any shifts not yet applied with it */
+void Castus4publicSchedule::ItemIndexRef::reset() {
+	if (index != NULL) {
+		delete index;
+		index = NULL;
+	}
+}
+
+/* Cheap check before each O(log n) operation. Nodes point into the list, so the index is only
+ * trusted if nothing but the index methods changed the list since it was built (code editing the
+ * list directly calls changed()), and its ends are the list's ends. None of this looks through a
+ * node's item, which may be dangling by now. sort_schedule_items() does the full check. */
+bool Castus4publicSchedule::item_index_in_sync() const {
+	const ItemIndex *index = item_index.index;
+
+	if (index == NULL || index->generation != generation || index->size() != schedule_items.size()) return false;
+	if (schedule_items.empty()) return true;
+
+	std::list<ScheduleItem>::const_iterator back = schedule_items.end();
+	back--;
+	return index->first()->item == schedule_items.begin() && index->last()->item == back;
+}
+
+/* Full O(n) check that the list is in start time order and is exactly the treap's order, with
+ * the strings saying what the treap does. Pending shifts must be folded first. This catches
+ * items retimed with ScheduleItem::setStartTime(), which the index cannot see. */
+bool Castus4publicSchedule::item_index_matches() const {
+	std::vector<ItemIndex::Node*> order;
+	ideal_time_t prev = 0;
+	size_t k = 0;
+
+	if (!item_index_in_sync()) return false;
+
+	item_index.index->in_order(order);
+	if (order.size() != schedule_items.size()) return false;
+
+	for (std::list<ScheduleItem>::const_iterator i=schedule_items.begin();i!=schedule_items.end();i++,k++) {
+		if (order[k]->item != i) return false;
+
+		const ideal_time_t t = i->getStartTime();
+		if (order[k]->dirty || order[k]->start != t || (k > 0 && t < prev)) return false;
+		prev = t;
+	}
+
+	return true;
+}
+
+/* for the index methods: the list changes, but the index changes with it */
+void Castus4publicSchedule::item_index_changed() {
+	changed();
+	if (item_index.index != NULL) item_index.index->generation = generation;
+}
+
+void Castus4publicSchedule::rebuild_item_index() {
+	if (item_index.index == NULL) item_index.index = new ItemIndex();
+	item_index.index->build(schedule_items);
+	item_index.index->generation = generation;
+}
+
+void Castus4publicSchedule::set_ordered_items(bool on) {
+	keep_items_ordered = on;
+	if (on) {
+		sort_schedule_items();
+	}
+	else {
+		apply_time_shifts();
+		item_index.reset();
+	}
+}
+
+bool Castus4publicSchedule::ordered_items() const {
+	return keep_items_ordered;
+}
+
+Castus4publicSchedule::item_iterator Castus4publicSchedule::insert_item(const ScheduleItem &item) {
+	return insert_item(schedule_items.end(),item);
+}
+
+Castus4publicSchedule::item_iterator Castus4publicSchedule::insert_item(item_iterator pos,const ScheduleItem &item) {
+	if (!keep_items_ordered || edit_depth > 0) {
+		changed();
+		item_iterator i = schedule_items.insert(pos,item);
+		if (edit_depth > 0) {
+			edit_touched[&(*i)] = i;
+			edit_reordered = true;
+		}
+		return i;
+	}
+
+	if (!item_index_in_sync()) sort_schedule_items();
+	item_index_changed();
+
+	ideal_time_t start = item.getStartTime();
+	ItemIndex::Node *next = item_index.index->successor(start,item_index.index->next_seq);
+	item_iterator i = schedule_items.insert(next != NULL ? next->item : schedule_items.end(),item);
+	item_index.index->insert(i,start,i->getEndTime());
+	return i;
+}
+
+Castus4publicSchedule::item_iterator Castus4publicSchedule::erase_item(item_iterator i) {
+	if (edit_depth > 0) {
+		edit_touched.erase(&(*i));
+		edit_failed.erase(&(*i));
+	}
+
+	if (keep_items_ordered && item_index_in_sync()) {
+		ItemIndex::Node *n = item_index.index->find(&(*i));
+		if (n != NULL) item_index.index->erase(n);
+		item_index_changed();
+	}
+	else {
+		changed(); /* the index, if any, is rebuilt on next use */
+	}
+
+	return schedule_items.erase(i);
+}
+
+Castus4publicSchedule::item_iterator Castus4publicSchedule::find_item(const ScheduleItem *item) {
+	if (keep_items_ordered && edit_depth == 0 && item_index_in_sync()) {
+		ItemIndex::Node *n = item_index.index->find(item);
+		return n != NULL ? n->item : schedule_items.end();
+	}
+
+	for (item_iterator i=schedule_items.begin();i!=schedule_items.end();i++) {
+		if (&(*i) == item) return i;
+	}
+
+	return schedule_items.end();
+}
+
+/* start and end are written as a pair; if either fails the item is left as it was */
+static bool Castus4publicSchedule_set_times(Castus4publicSchedule::ScheduleItem &item,const Castus4publicSchedule::ideal_time_t start,
+	const Castus4publicSchedule::ideal_time_t end) {
+	const std::map<std::string,std::string> old = item.entry;
+
+	if (item.setStartTime(start) && (end == Castus4publicSchedule::ideal_time_t_invalid || item.setEndTime(end)))
+		return true;
+
+	item.entry = old;
+	item.invalidateContentHash();
+	return false;
+}
+
+/* end == ideal_time_t_invalid leaves the end time alone. Fails, changing nothing, if a time is
+ * before the start of the schedule. Inside begin_edit()/commit() a failure is reported again by
+ * commit(). */
+bool Castus4publicSchedule::retime_item(item_iterator i,const ideal_time_t start,const ideal_time_t end) {
+	ideal_time_t new_end = end;
+	ItemIndex::Node *n = NULL;
+
+	if (edit_depth > 0) {
+		changed();
+		edit_touched[&(*i)] = i;
+		edit_reordered = true;
+		if (start >= 0 && (end >= 0 || end == ideal_time_t_invalid) && Castus4publicSchedule_set_times(*i,start,end)) return true;
+		edit_failed[&(*i)] = i;
+		return false;
+	}
+
+	if (start < 0 || (end < 0 && end != ideal_time_t_invalid)) return false;
+
+	if (!keep_items_ordered) {
+		changed();
+		return Castus4publicSchedule_set_times(*i,start,end);
+	}
+
+	if (keep_items_ordered) {
+		if (!item_index_in_sync()) sort_schedule_items();
+		item_index_changed();
+
+		n = item_index.index->find(&(*i));
+		if (n != NULL) {
+			item_index.index->touch(n);
+			if (new_end == ideal_time_t_invalid) new_end = n->end; /* possibly shifted */
+			item_index.index->unlink(n);
+		}
+	}
+
+	if (!Castus4publicSchedule_set_times(*i,start,new_end)) {
+		if (n != NULL) item_index.index->link(n); /* back where it was, times unchanged */
+		return false;
+	}
+
+	if (keep_items_ordered) {
+		ItemIndex::Node *next = item_index.index->successor(start,item_index.index->next_seq);
+		schedule_items.splice(next != NULL ? next->item : schedule_items.end(),schedule_items,i);
+
+		if (n != NULL) {
+			/* sorts after everything else starting at the same time, as a new item would */
+			n->start = start;
+			n->end = new_end;
+			n->lazy = 0;
+			n->dirty = false;
+			n->seq = item_index.index->next_seq++;
+			item_index.index->link(n);
+		}
+		else {
+			item_index.index->insert(i,start,new_end);
+		}
+	}
+
+	return true;
+}
+
+/* Move every item starting at or after from by delta. In ordered mode this is O(log n) and the
+ * item strings are updated lazily (see above); otherwise every affected item is rewritten now.
+ * Fails without changing anything if an item would end up before the start of the schedule. */
+bool Castus4publicSchedule::shift_items(const ideal_time_t from,const ideal_time_t delta) {
+	if (from < 0) return false;
+
+	if (!keep_items_ordered || edit_depth > 0) {
+		changed();
+		for (item_iterator i=schedule_items.begin();i!=schedule_items.end();i++) {
+			ideal_time_t start = i->getStartTime();
+			if (start != ideal_time_t_invalid && start >= from && start + delta < 0) return false;
+		}
+
+		for (item_iterator i=schedule_items.begin();i!=schedule_items.end();i++) {
+			ideal_time_t start = i->getStartTime();
+			if (start == ideal_time_t_invalid || start < from) continue;
+
+			ideal_time_t end = i->getEndTime();
+			i->setStartTime(start + delta);
+			if (end != ideal_time_t_invalid) i->setEndTime(end + delta);
+			if (edit_depth > 0) {
+				edit_touched[&(*i)] = i;
+				edit_reordered = true;
+			}
+		}
+
+		return true;
+	}
+
+	if (!item_index_in_sync()) sort_schedule_items();
+	item_index_changed();
+
+	std::vector<ItemIndex::Node*> moved;
+	if (!item_index.index->shift(from,delta,moved)) return false;
+
+	/* items that were passed by the shifted ones: highest first, so each one's successor
+	 * is already where it belongs */
+	for (size_t i=0;i < moved.size();i++) {
+		ItemIndex::Node *n = moved[i];
+		ItemIndex::Node *next = item_index.index->successor(n->start,n->seq);
+		schedule_items.splice(next != NULL ? next->item : schedule_items.end(),schedule_items,n->item);
+	}
+
+	return true;
+}
+
+Castus4publicSchedule::ideal_time_t Castus4publicSchedule::item_start_time(item_iterator i) {
+	if (keep_items_ordered && item_index.index != NULL) {
+		ItemIndex::Node *n = item_index.index->find(&(*i));
+		if (n != NULL) {
+			item_index.index->touch(n);
+			return n->start;
+		}
+	}
+
+	return i->getStartTime();
+}
+
+Castus4publicSchedule::ideal_time_t Castus4publicSchedule::item_end_time(item_iterator i) {
+	if (keep_items_ordered && item_index.index != NULL) {
+		ItemIndex::Node *n = item_index.index->find(&(*i));
+		if (n != NULL) {
+			item_index.index->touch(n);
+			return n->end;
+		}
+	}
+
+	return i->getEndTime();
+}
+
+/* Write any pending shifts into the item strings, so ScheduleItem::getStartTime() etc. are
+ * current. O(1) if there are none. const because the times themselves do not change, only their
+ * strings catch up; every reader taking a const schedule calls this first. */
+void Castus4publicSchedule::apply_time_shifts() const {
+	if (item_index.index == NULL || !item_index.index->pending) return;
+
+	if (item_index_in_sync()) {
+		item_index.index->fold_all();
+		return;
+	}
+
+	/* the list changed behind the index: only write to items still in it */
+	std::list<ScheduleItem> &items = const_cast<std::list<ScheduleItem>&>(schedule_items);
+	for (item_iterator i=items.begin();i!=items.end();i++) {
+		ItemIndex::Node *n = item_index.index->find(&(*i));
+		if (n == NULL) continue;
+
+		item_index.index->touch(n);
+		n->item = i;
+		n->fold();
+	}
+	item_index.index->pending = false;
+}
+
+/* the copy gets the shifted times in its strings, and the source stays as it was */
+void Castus4publicSchedule::copy_time_shifts(Castus4publicSchedule &to) const {
+	ideal_time_t start,end;
+
+	if (item_index.index == NULL || !item_index.index->pending) return;
+
+	item_iterator j = to.schedule_items.begin();
+	for (std::list<ScheduleItem>::const_iterator i=schedule_items.begin();i!=schedule_items.end();i++,j++) {
+		const ItemIndex::Node *n = item_index.index->find(&(*i));
+
+		if (n != NULL && item_index.index->current_times(n,start,end)) {
+			j->setStartTime(start);
+			if (end != ideal_time_t_invalid) j->setEndTime(end);
+		}
+	}
+}
+
+void Castus4publicSchedule::begin_edit() {
+	if (edit_depth++ > 0) return;
+
+	/* the list is about to change under the index, so settle it and let it go */
+	apply_time_shifts();
+	item_index.reset();
+	edit_touched.clear();
+	edit_failed.clear();
+	edit_reordered = false;
+}
+
+bool Castus4publicSchedule::in_edit() const {
+	return edit_depth > 0;
+}
+
+/* name "start" or "end" goes through retime_item() so ordering is kept, and false is returned if
+ * the time was rejected; value NULL deletes */
+bool Castus4publicSchedule::set_item_value(item_iterator i,const char *name,const char *value) {
+	if (value != NULL && (!strcmp(name,"start") || !strcmp(name,"end"))) {
+		struct tm t;
+		unsigned long usec = 0;
+		int sch_type = 0;
+
+		t = castus4_schedule_parse_time(value,&usec,&sch_type);
+		ideal_time_t v = time_tm_to_ideal_time(t,usec,sch_type);
+
+		if (!strcmp(name,"start"))
+			return retime_item(i,v,ideal_time_t_invalid);
+
+		ideal_time_t start = item_start_time(i);
+		if (start != ideal_time_t_invalid)
+			return retime_item(i,start,v);
+	}
+
+	if (value != NULL)
+		i->setValue(name,value);
+	else
+		i->deleteValue(name);
+
+	if (edit_depth > 0) edit_touched[&(*i)] = i;
+	return true;
+}
+
+/* Restore ordering (if the batch added or retimed anything, in either mode) and the index once
+ * for the whole batch, then check every item the batch touched: it needs a start and an end, must
+ * not end before it starts, and must not have had a retime rejected. Items that fail are appended
+ * to *invalid. Returns false if any did. */
+bool Castus4publicSchedule::commit(std::vector<item_iterator> *invalid) {
+	bool ok = true;
+
+	if (edit_depth == 0) return true;
+	if (--edit_depth > 0) return true;
+
+	if (edit_reordered || keep_items_ordered)
+		sort_schedule_items();
+
+	for (std::map<const ScheduleItem*,item_iterator>::iterator j=edit_touched.begin();j!=edit_touched.end();j++) {
+		ideal_time_t start = j->second->getStartTime();
+		ideal_time_t end = j->second->getEndTime();
+
+		if (start == ideal_time_t_invalid || end == ideal_time_t_invalid || end < start ||
+			edit_failed.find(j->first) != edit_failed.end()) {
+			if (invalid != NULL) invalid->push_back(j->second);
+			ok = false;
+		}
+	}
+
+	edit_touched.clear();
+	edit_failed.clear();
+	edit_reordered = false;
+	return ok;
+}
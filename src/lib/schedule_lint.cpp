@@ -0,0 +1,134 @@
+
+#include <sys/types.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/schedule_object.h>
+#include <castus4-public/schedule_lint.h>
+
+#include <string>
+#include <vector>
+#include <list>
+
+Castus4publicScheduleLint::Issue::Issue() : type(Overlap), start(0), end(0), item(NULL), other(NULL) {
+}
+
+const char *Castus4publicScheduleLint::issue_name(const enum issue_type t) {
+	switch (t) {
+		case Overlap:		return "overlap";
+		case Gap:		return "gap";
+		case ZeroLength:	return "zero-length";
+		case PastEnd:		return "past-end";
+		case InvalidTime:	return "invalid-time";
+	};
+	return "unknown";
+}
+
+/* Each time is parsed once, the starts are radix sorted, and one pass carries the furthest end
+ * seen so far ("reach"). An item starting before the reach overlaps whatever set it, an item
+ * starting after it leaves a gap. */
+bool Castus4publicScheduleLint::analyze(const Castus4publicSchedule &schedule,std::vector<Issue> &issues,const ideal_time_t min_gap) {
+	std::vector<const Castus4publicSchedule::ScheduleItem*> refs;
+	std::vector<Castus4publicSchedule::ideal_time_key> keys;
+	std::vector<ideal_time_t> ends;
+	size_t first_issue = issues.size();
+	ideal_time_t interval_end = 0;
+
+	schedule.apply_time_shifts();
+	if (schedule.interval_length > 0)
+		interval_end = (ideal_time_t)schedule.interval_length * (ideal_time_t)Castus4publicSchedule::ideal_hour_per_day *
+			(ideal_time_t)Castus4publicSchedule::ideal_min_per_hour * (ideal_time_t)Castus4publicSchedule::ideal_sec_per_min *
+			(ideal_time_t)Castus4publicSchedule::ideal_microsec_per_sec;
+
+	refs.reserve(schedule.schedule_items.size());
+	keys.reserve(schedule.schedule_items.size());
+	ends.reserve(schedule.schedule_items.size());
+	for (std::list<Castus4publicSchedule::ScheduleItem>::const_iterator i=schedule.schedule_items.begin();i!=schedule.schedule_items.end();i++) {
+		ideal_time_t start = i->getStartTime();
+		ideal_time_t end = i->getEndTime();
+
+		if (start == Castus4publicSchedule::ideal_time_t_invalid || end == Castus4publicSchedule::ideal_time_t_invalid) {
+			Issue is;
+			is.type = InvalidTime;
+			is.item = &(*i);
+			issues.push_back(is);
+			continue;
+		}
+
+		Castus4publicSchedule::ideal_time_key k;
+		k.time = start;
+		k.index = refs.size();
+		keys.push_back(k);
+		refs.push_back(&(*i));
+		ends.push_back(end);
+	}
+
+	Castus4publicSchedule::radix_sort_time_keys(keys);
+
+	ideal_time_t reach = 0;
+	const Castus4publicSchedule::ScheduleItem *reach_item = NULL;
+
+	for (size_t i=0;i < keys.size();i++) {
+		const Castus4publicSchedule::ScheduleItem *item = refs[keys[i].index];
+		const ideal_time_t start = keys[i].time;
+		const ideal_time_t end = ends[keys[i].index];
+
+		if (end <= start) {
+			Issue is;
+			is.type = ZeroLength;
+			is.start = start;
+			is.end = end;
+			is.item = item;
+			issues.push_back(is);
+			continue;
+		}
+
+		if (start < reach) {
+			Issue is;
+			is.type = Overlap;
+			is.start = start;
+			is.end = (end < reach) ? end : reach;
+			is.item = item;
+			is.other = reach_item;
+			issues.push_back(is);
+		}
+		else if (start > reach && (start - reach) >= min_gap) {
+			Issue is;
+			is.type = Gap;
+			is.start = reach;
+			is.end = start;
+			is.item = item;
+			is.other = reach_item;
+			issues.push_back(is);
+		}
+
+		if (interval_end > 0 && end > interval_end) {
+			Issue is;
+			is.type = PastEnd;
+			is.start = (start > interval_end) ? start : interval_end;
+			is.end = end;
+			is.item = item;
+			issues.push_back(is);
+		}
+
+		if (end > reach) {
+			reach = end;
+			reach_item = item;
+		}
+	}
+
+	/* dead air from the last item to the end of the schedule, where that is known */
+	if (interval_end > 0 && reach < interval_end && (interval_end - reach) >= min_gap) {
+		Issue is;
+		is.type = Gap;
+		is.start = reach;
+		is.end = interval_end;
+		is.other = reach_item;
+		issues.push_back(is);
+	}
+
+	return issues.size() == first_issue;
+}
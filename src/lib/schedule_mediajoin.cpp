@@ -0,0 +1,128 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/schedule_object.h>
+#include <castus4-public/schedule_mediajoin.h>
+#include <castus4-public/metadata.h>
+#include <castus4-public/metadata_batch.h>
+
+#include <unordered_map>
+#include <string>
+#include <vector>
+#include <list>
+
+Castus4publicScheduleMediaJoin::Media::Media() : error(0), duration_us(0) {
+}
+
+Castus4publicScheduleMediaJoin::Issue::Issue() : type(Missing), media(0), item(NULL), item_duration_us(0), media_duration_us(0) {
+}
+
+Castus4publicScheduleMediaJoin::Castus4publicScheduleMediaJoin() {
+}
+
+Castus4publicScheduleMediaJoin::~Castus4publicScheduleMediaJoin() {
+}
+
+void Castus4publicScheduleMediaJoin::clear() {
+	media.clear();
+	issues.clear();
+}
+
+const char *Castus4publicScheduleMediaJoin::issue_name(const enum issue_type t) {
+	switch (t) {
+		case Missing:		return "missing";
+		case NoMetadata:	return "no-metadata";
+		case NoDuration:	return "no-duration";
+		case DurationMismatch:	return "duration-mismatch";
+	}
+
+	return "?";
+}
+
+bool Castus4publicScheduleMediaJoin::check(const Castus4publicSchedule &schedule,const ideal_time_t tolerance,const unsigned int threads) {
+	std::vector<castus4public_metadata_result> results;
+	std::unordered_map<std::string,size_t> by_path;
+	std::vector<std::string> paths;
+	const unsigned long long tol = tolerance > 0 ? (unsigned long long)tolerance : 0ULL;
+
+	clear();
+	schedule.apply_time_shifts();
+
+	for (std::list<Castus4publicSchedule::ScheduleItem>::const_iterator i=schedule.schedule_items.begin();i!=schedule.schedule_items.end();i++) {
+		const char *p = i->getItem();
+
+		if (p == NULL || *p == 0) continue;
+
+		std::pair<std::unordered_map<std::string,size_t>::iterator,bool> r =
+			by_path.insert(std::pair<std::string,size_t>(p,media.size()));
+		if (r.second) {
+			media.push_back(Media());
+			media.back().path = p;
+			paths.push_back(p);
+		}
+
+		media[r.first->second].items.push_back(&(*i));
+	}
+
+	castus4public_read_metadata_batch(paths,results,threads);
+	assert(results.size() == media.size());
+
+	for (size_t m=0;m < media.size();m++) {
+		Media &md = media[m];
+		Issue is;
+
+		is.media = m;
+		is.item = md.items.front();
+		md.error = results[m].error;
+
+		if (md.error != 0) {
+			struct stat st;
+
+			/* only failures cost a stat(), to tell a missing file from one without metadata */
+			is.type = (stat(md.path.c_str(),&st) != 0 && errno == ENOENT) ? Missing : NoMetadata;
+			issues.push_back(is);
+			continue;
+		}
+
+		md.duration_us = results[m].meta.fields().duration_us;
+		if (md.duration_us == 0) {
+			is.type = NoDuration;
+			issues.push_back(is);
+		}
+	}
+
+	for (std::list<Castus4publicSchedule::ScheduleItem>::const_iterator i=schedule.schedule_items.begin();i!=schedule.schedule_items.end();i++) {
+		const char *p = i->getItem();
+		const char *d;
+
+		if (p == NULL || *p == 0) continue;
+		if ((d=i->getValue("item duration")) == NULL || *d == 0) continue;
+
+		const size_t m = by_path.find(p)->second;
+		const Media &md = media[m];
+		if (md.duration_us == 0) continue;
+
+		const double ds = atof(d);
+		const unsigned long long item_us = ds > 0 ? (unsigned long long)((ds * 1000000) + 0.5) : 0ULL;
+		const unsigned long long diff = item_us > md.duration_us ? (item_us - md.duration_us) : (md.duration_us - item_us);
+
+		if (diff > tol) {
+			Issue is;
+
+			is.type = DurationMismatch;
+			is.media = m;
+			is.item = &(*i);
+			is.item_duration_us = item_us;
+			is.media_duration_us = md.duration_us;
+			issues.push_back(is);
+		}
+	}
+
+	return issues.empty();
+}
@@ -0,0 +1,145 @@
+#include <sys/types.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/schedule_object.h>
+#include <castus4-public/schedule_merge.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <list>
+
+Castus4publicScheduleMerge::Castus4publicScheduleMerge() {
+}
+
+Castus4publicScheduleMerge::~Castus4publicScheduleMerge() {
+}
+
+size_t Castus4publicScheduleMerge::add(const Castus4publicSchedule &schedule,const std::string &name) {
+	sources.push_back(&schedule);
+
+	if (name.empty()) {
+		char tmp[32];
+		sprintf(tmp,"%lu",(unsigned long)(sources.size() - 1));
+		names.push_back(tmp);
+	}
+	else {
+		names.push_back(name);
+	}
+
+	return sources.size() - 1;
+}
+
+void Castus4publicScheduleMerge::clear() {
+	sources.clear();
+	names.clear();
+}
+
+/* head of one source's stream in the heap; std heaps are max-heaps, so "less" means later */
+class Castus4publicScheduleMergeHead {
+public:
+	Castus4publicSchedule::ideal_time_t	start;
+	size_t					source;
+	size_t					pos;
+public:
+	bool operator<(const Castus4publicScheduleMergeHead &a) const {
+		if (start != a.start) return start > a.start;
+		return source > a.source;
+	}
+};
+
+void Castus4publicScheduleMerge::merge(std::vector<Entry> &out) const {
+	std::vector<std::vector<Entry> > streams(sources.size());
+	std::vector<Castus4publicScheduleMergeHead> heap;
+	size_t total = 0;
+
+	out.clear();
+
+	/* each source in start order: radix sorted keys, no item copies */
+	for (size_t s=0;s < sources.size();s++) {
+		sources[s]->apply_time_shifts(); /* may have been shifted since add() */
+		std::vector<Castus4publicSchedule::ideal_time_key> keys;
+		std::vector<Entry> tmp;
+
+		for (std::list<Castus4publicSchedule::ScheduleItem>::const_iterator i=sources[s]->schedule_items.begin();i!=sources[s]->schedule_items.end();i++) {
+			Castus4publicSchedule::ideal_time_key k;
+			Entry e;
+
+			e.start = i->getStartTime();
+			e.end = i->getEndTime();
+			e.source = s;
+			e.item = &(*i);
+
+			k.time = e.start;
+			k.index = tmp.size();
+			keys.push_back(k);
+			tmp.push_back(e);
+		}
+
+		Castus4publicSchedule::radix_sort_time_keys(keys);
+		streams[s].reserve(tmp.size());
+		for (size_t i=0;i < keys.size();i++) streams[s].push_back(tmp[keys[i].index]);
+		total += tmp.size();
+
+		if (!streams[s].empty()) {
+			Castus4publicScheduleMergeHead h;
+			h.start = streams[s][0].start;
+			h.source = s;
+			h.pos = 0;
+			heap.push_back(h);
+		}
+	}
+
+	std::make_heap(heap.begin(),heap.end());
+	out.reserve(total);
+
+	while (!heap.empty()) {
+		std::pop_heap(heap.begin(),heap.end());
+		Castus4publicScheduleMergeHead &h = heap.back();
+		const std::vector<Entry> &st = streams[h.source];
+
+		out.push_back(st[h.pos]);
+		if (++h.pos < st.size()) {
+			h.start = st[h.pos].start;
+			std::push_heap(heap.begin(),heap.end());
+		}
+		else {
+			heap.pop_back();
+		}
+	}
+}
+
+bool Castus4publicScheduleMerge::materialize(Castus4publicSchedule &out,const char *tag) const {
+	std::vector<Entry> merged;
+
+	if (sources.empty()) return false;
+
+	const Castus4publicSchedule &first = *sources[0];
+
+	/* "sun 6:00 am" and "the 1st, 6:00 am" are not the same time: only merge like with like */
+	for (size_t s=1;s < sources.size();s++) {
+		if (sources[s]->schedule_type != first.schedule_type || sources[s]->interval_length != first.interval_length)
+			return false;
+	}
+
+	out.reset();
+	out.schedule_type = first.schedule_type;
+	out.interval_length = first.interval_length;
+	out.global_values = first.global_values;
+	out.defaults_type = first.defaults_type;
+	out.defaults_values = first.defaults_values;
+	out.schedule_blocks = first.schedule_blocks;
+
+	merge(merged);
+	for (size_t i=0;i < merged.size();i++) {
+		out.schedule_items.push_back(*(merged[i].item));
+		out.schedule_items.back().schedule_type = out.schedule_type;
+		if (tag != NULL) out.schedule_items.back().setValue(tag,names[merged[i].source]);
+	}
+
+	return true;
+}
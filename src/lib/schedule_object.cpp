@@ -15,6 +15,7 @@
 #include <castus4-public/schedule_object.h>
 
 #include <algorithm>
+#include <atomic>
 #include <string>
 #include <vector>
 #include <list>
@@ -30,37 +31,139 @@ void Castus4publicSchedule::common_std_map_name_value_pair_entry(std::map<std::s
 	}
 }
 
-Castus4publicSchedule::ScheduleItem::ScheduleItem(const int schedule_type) : schedule_type(schedule_type) {
+/* entry stamps are unique across every record in the process, so a stamp seen on one record
+ * address is never seen again after that record is destroyed or changed */
+static unsigned long long Castus4publicSchedule_next_entry_stamp() {
+	static std::atomic<unsigned long long> next(1);
+	return next++;
+}
+
+Castus4publicSchedule::ScheduleItem::ScheduleItem(const int schedule_type) : schedule_type(schedule_type), hash_cache(0), hash_cache_valid(false),
+	entry_stamp(Castus4publicSchedule_next_entry_stamp()) {
+}
+
+Castus4publicSchedule::ScheduleItem::ScheduleItem(const ScheduleItem &a) : entry(a.entry), schedule_type(a.schedule_type), hash_cache(a.hash_cache),
+	hash_cache_valid(a.hash_cache_valid), entry_stamp(Castus4publicSchedule_next_entry_stamp()) {
+}
+
+Castus4publicSchedule::ScheduleItem &Castus4publicSchedule::ScheduleItem::operator=(const ScheduleItem &a) {
+	if (this != &a) {
+		entry = a.entry;
+		schedule_type = a.schedule_type;
+		hash_cache = a.hash_cache;
+		hash_cache_valid = a.hash_cache_valid;
+		entry_stamp = Castus4publicSchedule_next_entry_stamp();
+	}
+	return *this;
+}
+
+void Castus4publicSchedule::ScheduleItem::entryChanged() {
+	hash_cache_valid = false;
+	entry_stamp = Castus4publicSchedule_next_entry_stamp();
+}
+
+unsigned long long Castus4publicSchedule::ScheduleItem::getEntryStamp() const {
+	return entry_stamp;
 }
 
 Castus4publicSchedule::ScheduleItem::~ScheduleItem() {
 }
 
 void Castus4publicSchedule::ScheduleItem::takeNameValuePair(const std::string &name,const std::string &value) {
+	entryChanged();
 	common_std_map_name_value_pair_entry(/*&*/entry,name,value);
 }
 
-Castus4publicSchedule::ScheduleBlock::ScheduleBlock(const int schedule_type) : schedule_type(schedule_type) {
+Castus4publicSchedule::ScheduleBlock::ScheduleBlock(const int schedule_type) : schedule_type(schedule_type), hash_cache(0), hash_cache_valid(false),
+	entry_stamp(Castus4publicSchedule_next_entry_stamp()) {
+}
+
+Castus4publicSchedule::ScheduleBlock::ScheduleBlock(const ScheduleBlock &a) : entry(a.entry), schedule_type(a.schedule_type), hash_cache(a.hash_cache),
+	hash_cache_valid(a.hash_cache_valid), entry_stamp(Castus4publicSchedule_next_entry_stamp()) {
+}
+
+Castus4publicSchedule::ScheduleBlock &Castus4publicSchedule::ScheduleBlock::operator=(const ScheduleBlock &a) {
+	if (this != &a) {
+		entry = a.entry;
+		schedule_type = a.schedule_type;
+		hash_cache = a.hash_cache;
+		hash_cache_valid = a.hash_cache_valid;
+		entry_stamp = Castus4publicSchedule_next_entry_stamp();
+	}
+	return *this;
+}
+
+void Castus4publicSchedule::ScheduleBlock::entryChanged() {
+	hash_cache_valid = false;
+	entry_stamp = Castus4publicSchedule_next_entry_stamp();
+}
+
+unsigned long long Castus4publicSchedule::ScheduleBlock::getEntryStamp() const {
+	return entry_stamp;
 }
 
 Castus4publicSchedule::ScheduleBlock::~ScheduleBlock() {
 }
 
 void Castus4publicSchedule::ScheduleBlock::takeNameValuePair(const std::string &name,const std::string &value) {
+	entryChanged();
 	common_std_map_name_value_pair_entry(/*&*/entry,name,value);
 }
 
-Castus4publicSchedule::Castus4publicSchedule() {
+Castus4publicSchedule::Castus4publicSchedule() : keep_items_ordered(false), edit_depth(0), edit_reordered(false), generation(0) {
 	reset();
 }
 
+/* the copy has no item index (it is rebuilt on first use) and is not inside begin_edit() */
+Castus4publicSchedule::Castus4publicSchedule(const Castus4publicSchedule &a) : head(a.head), entry(a.entry), in_entry(a.in_entry),
+	entry_mode(a.entry_mode), schedule_items(a.schedule_items), schedule_blocks(a.schedule_blocks),
+	defaults_values(a.defaults_values), defaults_type(a.defaults_type), global_values(a.global_values),
+	schedule_type(a.schedule_type), interval_length(a.interval_length), keep_items_ordered(a.keep_items_ordered),
+	edit_depth(0), edit_reordered(false), generation(0) {
+	a.copy_time_shifts(*this);
+}
+
+Castus4publicSchedule &Castus4publicSchedule::operator=(const Castus4publicSchedule &a) {
+	if (this == &a) return *this;
+
+	item_index.reset();
+	edit_touched.clear();
+	edit_failed.clear();
+	edit_reordered = false;
+	edit_depth = 0;
+	changed();
+
+	head = a.head;
+	entry = a.entry;
+	in_entry = a.in_entry;
+	entry_mode = a.entry_mode;
+	schedule_items = a.schedule_items;
+	schedule_blocks = a.schedule_blocks;
+	defaults_values = a.defaults_values;
+	defaults_type = a.defaults_type;
+	global_values = a.global_values;
+	schedule_type = a.schedule_type;
+	interval_length = a.interval_length;
+	keep_items_ordered = a.keep_items_ordered;
+	a.copy_time_shifts(*this);
+	return *this;
+}
+
+void Castus4publicSchedule::changed() {
+	generation++;
+}
+
 Castus4publicSchedule::~Castus4publicSchedule() {
 }
 
 void Castus4publicSchedule::reset() {
+	changed();
 	schedule_type = C4_SCHED_TYPE_NONE;
 	schedule_blocks.clear();
 	defaults_values.clear();
+	item_index.reset();
+	edit_touched.clear();
+	edit_failed.clear();
 	schedule_items.clear();
 	defaults_type.clear();
 	interval_length = 0;
@@ -77,6 +180,7 @@ void Castus4publicSchedule::begin_load() {
 }
 
 void Castus4publicSchedule::end_load() {
+	changed();
 	if (schedule_type == C4_SCHED_TYPE_NONE)
 		schedule_type = C4_SCHED_TYPE_WEEKLY;
 
@@ -88,6 +192,9 @@ void Castus4publicSchedule::end_load() {
 		interval_length = 31;
 	else if (schedule_type == C4_SCHED_TYPE_YEARLY)
 		interval_length = 12*31;
+
+	if (keep_items_ordered)
+		sort_schedule_items();
 }
 
 void Castus4publicSchedule::load_take_line(const char *line) {
@@ -250,6 +357,8 @@ bool Castus4publicSchedule::write_out(writeout_cb_t f,void *opaque) {
 
 	if (schedule_type == C4_SCHED_TYPE_NONE) return false;
 
+	apply_time_shifts();
+
 	switch (schedule_type) {
 		case C4_SCHED_TYPE_DAILY:
 			if (!f(this,"*daily\n",opaque)) return false;
@@ -308,21 +417,111 @@ bool Castus4publicSchedule::write_out(writeout_cb_t f,void *opaque) {
 	return true;
 }
 
+/* Stable LSD radix sort on the 64-bit time, one byte per pass. The sign bit is flipped so that
+ * signed order becomes unsigned order, which also puts ideal_time_t_invalid (-1) ahead of every
+ * valid time, the same place operator< would put it. Passes where every key has the same byte
+ * are skipped, so a weekly schedule typically needs 5 of the 8. */
+void Castus4publicSchedule::radix_sort_time_keys(std::vector<ideal_time_key> &keys) {
+	const unsigned long long sign = 1ULL << 63ULL;
+	const size_t n = keys.size();
+
+	if (n < 2) return;
+
+	if (n < 64) { /* not worth the histograms */
+		std::vector<ideal_time_key> tmp(keys);
+		size_t i,j;
+
+		for (i=1;i < n;i++) {
+			ideal_time_key k = tmp[i];
+			for (j=i;j > 0 && tmp[j-1].time > k.time;j--) tmp[j] = tmp[j-1];
+			tmp[j] = k;
+		}
+
+		keys.swap(tmp);
+		return;
+	}
+
+	size_t count[8][256];
+	memset(count,0,sizeof(count));
+
+	for (size_t i=0;i < n;i++) {
+		unsigned long long u = (unsigned long long)keys[i].time ^ sign;
+		for (unsigned int d=0;d < 8;d++) count[d][(u >> (d * 8U)) & 0xFFU]++;
+	}
+
+	std::vector<ideal_time_key> tmp(n);
+	std::vector<ideal_time_key> *src = &keys,*dst = &tmp;
+
+	for (unsigned int d=0;d < 8;d++) {
+		size_t *c = count[d];
+		size_t sum = 0;
+
+		if (c[((unsigned long long)keys[0].time ^ sign) >> (d * 8U) & 0xFFU] == n) continue;
+
+		for (unsigned int b=0;b < 256;b++) {
+			size_t t = c[b];
+			c[b] = sum;
+			sum += t;
+		}
+
+		for (size_t i=0;i < n;i++) {
+			const ideal_time_key &k = (*src)[i];
+			(*dst)[c[(((unsigned long long)k.time ^ sign) >> (d * 8U)) & 0xFFU]++] = k;
+		}
+
+		std::swap(src,dst);
+	}
+
+	if (src != &keys) keys.swap(tmp);
+}
+
+/* parse each start time once, radix sort, then relink the list nodes in that order */
+template <class T> static void sort_list_by_start_time(std::list<T> &l) {
+	std::vector<typename std::list<T>::iterator> refs;
+	std::vector<Castus4publicSchedule::ideal_time_key> keys;
+
+	refs.reserve(l.size());
+	keys.reserve(l.size());
+	for (typename std::list<T>::iterator i=l.begin();i!=l.end();i++) {
+		Castus4publicSchedule::ideal_time_key k;
+		k.time = i->getStartTime();
+		k.index = refs.size();
+		keys.push_back(k);
+		refs.push_back(i);
+	}
+
+	Castus4publicSchedule::radix_sort_time_keys(keys);
+
+	for (size_t i=0;i < keys.size();i++)
+		l.splice(l.end(),l,refs[keys[i].index]);
+}
+
 void Castus4publicSchedule::sort_schedule_items() {
-	schedule_items.sort();
+	apply_time_shifts();
+
+	/* in ordered mode the list is normally in order already, but items retimed directly with
+	 * ScheduleItem::setStartTime() or list edits made behind the index are only found by looking */
+	if (keep_items_ordered && item_index_matches()) return;
+
+	changed();
+	sort_list_by_start_time(schedule_items);
+	if (keep_items_ordered) rebuild_item_index();
 }
 
 void Castus4publicSchedule::sort_schedule_blocks() {
-	schedule_blocks.sort();
+	changed();
+	sort_list_by_start_time(schedule_blocks);
 }
 
 void Castus4publicSchedule::sort_schedule_items_rev() { // TESTING only
-	schedule_items.sort();
+	sort_schedule_items();
 	schedule_items.reverse();
+	apply_time_shifts();
+	item_index.reset();
 }
 
 void Castus4publicSchedule::sort_schedule_blocks_rev() { // TESTING only
-	schedule_blocks.sort();
+	sort_schedule_blocks();
 	schedule_blocks.reverse();
 }
 
@@ -333,16 +532,21 @@ const char *Castus4publicSchedule::ScheduleItem::getValue(const char *name) cons
 }
 
 void Castus4publicSchedule::ScheduleItem::setValue(const char *name,const char *value) {
+	entryChanged();
 	entry[name] = value;
 }
 
 void Castus4publicSchedule::ScheduleItem::setValue(const char *name,const std::string &value) {
+	entryChanged();
 	entry[name] = value;
 }
 
 void Castus4publicSchedule::ScheduleItem::deleteValue(const char *name) {
 	std::map<std::string,std::string>::iterator i = entry.find(name);
-	if (i != entry.end()) entry.erase(i);
+	if (i != entry.end()) {
+		entryChanged();
+		entry.erase(i);
+	}
 }
 
 const char *Castus4publicSchedule::ScheduleBlock::getValue(const char *name) const {
@@ -352,16 +556,21 @@ const char *Castus4publicSchedule::ScheduleBlock::getValue(const char *name) con
 }
 
 void Castus4publicSchedule::ScheduleBlock::setValue(const char *name,const char *value) {
+	entryChanged();
 	entry[name] = value;
 }
 
 void Castus4publicSchedule::ScheduleBlock::setValue(const char *name,const std::string &value) {
+	entryChanged();
 	entry[name] = value;
 }
 
 void Castus4publicSchedule::ScheduleBlock::deleteValue(const char *name) {
 	std::map<std::string,std::string>::iterator i = entry.find(name);
-	if (i != entry.end()) entry.erase(i);
+	if (i != entry.end()) {
+		entryChanged();
+		entry.erase(i);
+	}
 }
 
 Castus4publicSchedule::ideal_time_t Castus4publicSchedule::time_tm_to_ideal_time(const struct tm &t,const unsigned long usec,const int schedule_type) {
@@ -0,0 +1,219 @@
+
+#include <sys/types.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/schedule_object.h>
+#include <castus4-public/schedule_occupancy.h>
+
+#include <algorithm>
+#include <vector>
+#include <list>
+
+Castus4publicScheduleOccupancy::Castus4publicScheduleOccupancy() : resolution(1000000), length(0), slots(0) {
+}
+
+Castus4publicScheduleOccupancy::~Castus4publicScheduleOccupancy() {
+}
+
+void Castus4publicScheduleOccupancy::clear() {
+	length = 0;
+	slots = 0;
+	count.clear();
+	covered.clear();
+	doubled.clear();
+}
+
+template <class T> static void occupancy_collect(const std::list<T> &l,std::vector<Castus4publicSchedule::ideal_time_t> &times) {
+	for (typename std::list<T>::const_iterator i=l.begin();i!=l.end();i++) {
+		Castus4publicSchedule::ideal_time_t start = i->getStartTime();
+		Castus4publicSchedule::ideal_time_t end = i->getEndTime();
+
+		if (start == Castus4publicSchedule::ideal_time_t_invalid || end == Castus4publicSchedule::ideal_time_t_invalid || end <= start)
+			continue;
+
+		times.push_back(start);
+		times.push_back(end);
+	}
+}
+
+bool Castus4publicScheduleOccupancy::build(const Castus4publicSchedule &schedule,const enum source src,const ideal_time_t res,ideal_time_t len) {
+	std::vector<ideal_time_t> times;
+
+	clear();
+	if (res <= 0) return false;
+	resolution = res;
+	schedule.apply_time_shifts();
+
+	if (src == Blocks)
+		occupancy_collect(schedule.schedule_blocks,times);
+	else
+		occupancy_collect(schedule.schedule_items,times);
+
+	if (len <= 0 && schedule.interval_length > 0)
+		len = (ideal_time_t)schedule.interval_length * (ideal_time_t)Castus4publicSchedule::ideal_hour_per_day *
+			(ideal_time_t)Castus4publicSchedule::ideal_min_per_hour * (ideal_time_t)Castus4publicSchedule::ideal_sec_per_min *
+			(ideal_time_t)Castus4publicSchedule::ideal_microsec_per_sec;
+	if (len <= 0) {
+		for (size_t i=1;i < times.size();i += 2)
+			if (len < times[i]) len = times[i];
+	}
+
+	length = len;
+	slots = (size_t)((length + resolution - 1) / resolution);
+	count.assign(slots,0);
+	covered.assign((slots + 63) / 64,0ULL);
+	doubled.assign((slots + 63) / 64,0ULL);
+
+	/* sweep the sorted start and end slots, filling each run between two of them at once: no
+	 * scratch array per slot, which at one second over a yearly schedule would be 128MB */
+	{
+		std::vector<size_t> starts,ends;
+		size_t pos = 0,si = 0,ei = 0;
+		int c = 0;
+
+		starts.reserve(times.size() / 2);
+		ends.reserve(times.size() / 2);
+		for (size_t i=0;i < times.size();i += 2) {
+			size_t a = to_slot(times[i]),b = to_slot(times[i+1]);
+			if (a >= b) continue;
+			starts.push_back(a);
+			ends.push_back(b);
+		}
+
+		std::sort(starts.begin(),starts.end());
+		std::sort(ends.begin(),ends.end());
+
+		while (si < starts.size() || ei < ends.size()) {
+			const size_t at = (si < starts.size() && (ei >= ends.size() || starts[si] < ends[ei])) ? starts[si] : ends[ei];
+
+			fill(pos,at,c);
+			while (si < starts.size() && starts[si] == at) { c++; si++; }
+			while (ei < ends.size() && ends[ei] == at) { c--; ei++; }
+			pos = at;
+		}
+	}
+
+	return true;
+}
+
+/* set bits [a,b), a word at a time */
+static void occupancy_set_bits(std::vector<unsigned long long> &bits,size_t a,size_t b) {
+	if (a >= b) return;
+
+	size_t wa = a >> 6,wb = b >> 6;
+	if (wa == wb) {
+		bits[wa] |= ((b & 63) == 0 ? 0ULL : (~0ULL >> (64 - (b & 63)))) & (~0ULL << (a & 63));
+		return;
+	}
+
+	bits[wa] |= ~0ULL << (a & 63);
+	for (size_t w=wa+1;w < wb;w++) bits[w] = ~0ULL;
+	if ((b & 63) != 0) bits[wb] |= ~0ULL >> (64 - (b & 63));
+}
+
+/* slots [a,b) are covered c times */
+void Castus4publicScheduleOccupancy::fill(const size_t a,const size_t b,const int c) {
+	if (a >= b || c <= 0) return;
+
+	memset(&count[a],c > 255 ? 255 : c,b - a);
+	occupancy_set_bits(covered,a,b);
+	if (c >= 2) occupancy_set_bits(doubled,a,b);
+}
+
+size_t Castus4publicScheduleOccupancy::to_slot(const ideal_time_t t) const {
+	if (t <= 0) return 0;
+
+	ideal_time_t s = (t + (resolution / 2)) / resolution;
+	return (s > (ideal_time_t)slots) ? slots : (size_t)s;
+}
+
+void Castus4publicScheduleOccupancy::adjust(const ideal_time_t start,const ideal_time_t end,const int delta) {
+	if (start == Castus4publicSchedule::ideal_time_t_invalid || end == Castus4publicSchedule::ideal_time_t_invalid) return;
+
+	size_t a = to_slot(start),b = to_slot(end);
+	for (size_t i=a;i < b;i++) {
+		unsigned char &c = count[i];
+		const unsigned long long bit = 1ULL << (i & 63);
+
+		if (delta > 0) {
+			if (c < 255) c++;
+		}
+		else {
+			if (c > 0 && c < 255) c--;
+		}
+
+		if (c >= 1) covered[i >> 6] |= bit;
+		else covered[i >> 6] &= ~bit;
+		if (c >= 2) doubled[i >> 6] |= bit;
+		else doubled[i >> 6] &= ~bit;
+	}
+}
+
+void Castus4publicScheduleOccupancy::add(const ideal_time_t start,const ideal_time_t end) {
+	adjust(start,end,1);
+}
+
+void Castus4publicScheduleOccupancy::remove(const ideal_time_t start,const ideal_time_t end) {
+	adjust(start,end,-1);
+}
+
+void Castus4publicScheduleOccupancy::update(const ideal_time_t old_start,const ideal_time_t old_end,const ideal_time_t start,const ideal_time_t end) {
+	remove(old_start,old_end);
+	add(start,end);
+}
+
+/* set bits in slots [a,b). Whole words go through popcount four at a time, which the compiler
+ * turns into vector code where the target has it */
+size_t Castus4publicScheduleOccupancy::count_bits(const std::vector<unsigned long long> &bits,size_t a,size_t b) {
+	size_t total = 0;
+
+	if (a >= b) return 0;
+
+	size_t wa = a >> 6,wb = b >> 6;
+	if (wa == wb) {
+		unsigned long long m = ((b & 63) == 0 ? 0ULL : (~0ULL >> (64 - (b & 63)))) & (~0ULL << (a & 63));
+		return (size_t)__builtin_popcountll(bits[wa] & m);
+	}
+
+	total += (size_t)__builtin_popcountll(bits[wa] & (~0ULL << (a & 63)));
+
+	size_t w = wa + 1;
+	const unsigned long long *p = &bits[0];
+	for (;(w + 4) <= wb;w += 4)
+		total += (size_t)(__builtin_popcountll(p[w]) + __builtin_popcountll(p[w+1]) +
+			__builtin_popcountll(p[w+2]) + __builtin_popcountll(p[w+3]));
+	for (;w < wb;w++)
+		total += (size_t)__builtin_popcountll(p[w]);
+
+	if ((b & 63) != 0)
+		total += (size_t)__builtin_popcountll(bits[wb] & (~0ULL >> (64 - (b & 63))));
+
+	return total;
+}
+
+bool Castus4publicScheduleOccupancy::any_uncovered(const ideal_time_t a,const ideal_time_t b) const {
+	size_t sa = to_slot(a),sb = to_slot(b);
+
+	if (b > length) return true; /* past the end of the timeline nothing is covered */
+	return count_bits(covered,sa,sb) != (sb - sa);
+}
+
+bool Castus4publicScheduleOccupancy::any_double_booked(const ideal_time_t a,const ideal_time_t b) const {
+	return count_bits(doubled,to_slot(a),to_slot(b)) != 0;
+}
+
+Castus4publicSchedule::ideal_time_t Castus4publicScheduleOccupancy::covered_time() const {
+	return (ideal_time_t)count_bits(covered,0,slots) * resolution;
+}
+
+Castus4publicSchedule::ideal_time_t Castus4publicScheduleOccupancy::covered_time(const ideal_time_t a,const ideal_time_t b) const {
+	return (ideal_time_t)count_bits(covered,to_slot(a),to_slot(b)) * resolution;
+}
+
+Castus4publicSchedule::ideal_time_t Castus4publicScheduleOccupancy::double_booked_time(const ideal_time_t a,const ideal_time_t b) const {
+	return (ideal_time_t)count_bits(doubled,to_slot(a),to_slot(b)) * resolution;
+}
@@ -0,0 +1,551 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/schedule_object.h>
+#include <castus4-public/schedule_helpers.h>
+#include <castus4-public/schedule_refindex.h>
+#include <castus4-public/chomp.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+
+static const char *Castus4publicScheduleRefIndex_magic = "castus4-refindex 2";
+
+/* Bloom filter: at least 16 bits per media path and 6 probes each, so well under 1% of the
+ * media nothing plays gets past it */
+static const size_t Castus4publicScheduleRefIndex_bits_per_media = 16;
+static const size_t Castus4publicScheduleRefIndex_min_bits = 4096;
+static const unsigned int Castus4publicScheduleRefIndex_hashes = 6;
+
+Castus4publicScheduleRefIndex::stamp::stamp() : dev(0), ino(0), mtime_sec(0), mtime_nsec(0), size(0) {
+}
+
+void Castus4publicScheduleRefIndex::stamp::from_stat(const struct stat &st) {
+	dev = (unsigned long long)st.st_dev;
+	ino = (unsigned long long)st.st_ino;
+	mtime_sec = (long long)st.st_mtim.tv_sec;
+	mtime_nsec = (long)st.st_mtim.tv_nsec;
+	size = (long long)st.st_size;
+}
+
+bool Castus4publicScheduleRefIndex::stamp::operator==(const stamp &a) const {
+	return dev == a.dev && ino == a.ino && mtime_sec == a.mtime_sec && mtime_nsec == a.mtime_nsec && size == a.size;
+}
+
+bool Castus4publicScheduleRefIndex::stamp::operator!=(const stamp &a) const {
+	return !(*this == a);
+}
+
+Castus4publicScheduleRefIndex::media_refs::media_refs() : count(0) {
+}
+
+Castus4publicScheduleRefIndex::schedule_refs::schedule_refs() : schedule_type(C4_SCHED_TYPE_NONE), length(0) {
+}
+
+Castus4publicScheduleRefIndex::Castus4publicScheduleRefIndex() : dirty(false), bloom_removed(0) {
+	bloom_rebuild();
+}
+
+Castus4publicScheduleRefIndex::~Castus4publicScheduleRefIndex() {
+}
+
+void Castus4publicScheduleRefIndex::clear() {
+	schedules.clear();
+	by_media.clear();
+	bloom_rebuild();
+	dirty = false;
+}
+
+size_t Castus4publicScheduleRefIndex::schedule_count() const {
+	return schedules.size();
+}
+
+size_t Castus4publicScheduleRefIndex::media_count() const {
+	return by_media.size();
+}
+
+/* FNV-1a and a 64-bit finalizer; the probes are taken from the two halves */
+unsigned long long Castus4publicScheduleRefIndex::hash(const std::string &s) {
+	unsigned long long h = 0xCBF29CE484222325ULL;
+
+	for (size_t i=0;i < s.length();i++) {
+		h ^= (unsigned long long)((unsigned char)s[i]);
+		h *= 0x100000001B3ULL;
+	}
+
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/* realpath(), or for a file that does not exist (any more), realpath() of its directory */
+std::string Castus4publicScheduleRefIndex::canonical(const std::string &path) {
+	std::string res;
+	char *r;
+
+	if (path.empty()) return path;
+
+	if ((r=realpath(path.c_str(),NULL)) != NULL) {
+		res = r;
+		free(r);
+		return res;
+	}
+
+	const size_t sl = path.find_last_of('/');
+	const std::string dir = (sl == std::string::npos) ? std::string(".") : (sl == 0 ? std::string("/") : path.substr(0,sl));
+	const std::string name = (sl == std::string::npos) ? path : path.substr(sl+1);
+
+	if (name.empty() || name == "." || name == "..") return path;
+	if ((r=realpath(dir.c_str(),NULL)) == NULL) return path;
+
+	res = r;
+	free(r);
+	if (res.empty() || res[res.length()-1] != '/') res += '/';
+	return res + name;
+}
+
+void Castus4publicScheduleRefIndex::bloom_add(const std::string &media_path) {
+	const unsigned long long h = hash(media_path);
+	const unsigned long long step = (h >> 32) | 1ULL;
+	const unsigned long long mask = ((unsigned long long)bloom.size() * 64ULL) - 1ULL;
+	unsigned long long b = h;
+
+	for (unsigned int i=0;i < Castus4publicScheduleRefIndex_hashes;i++,b += step)
+		bloom[(size_t)((b & mask) >> 6)] |= 1ULL << (b & 63ULL);
+}
+
+void Castus4publicScheduleRefIndex::bloom_rebuild() {
+	size_t bits = Castus4publicScheduleRefIndex_min_bits;
+
+	/* twice what is needed now, so that growth does not rebuild it every time */
+	while (bits < by_media.size() * Castus4publicScheduleRefIndex_bits_per_media * 2) bits *= 2;
+
+	bloom.assign(bits / 64,0ULL);
+	bloom_removed = 0;
+
+	for (std::unordered_map<std::string,std::vector<std::string> >::const_iterator i=by_media.begin();i!=by_media.end();i++)
+		bloom_add(i->first);
+}
+
+bool Castus4publicScheduleRefIndex::maybe_referenced(const std::string &path) const {
+	return bloom_test(canonical(path));
+}
+
+bool Castus4publicScheduleRefIndex::bloom_test(const std::string &media_path) const {
+	const unsigned long long h = hash(media_path);
+	const unsigned long long step = (h >> 32) | 1ULL;
+	const unsigned long long mask = ((unsigned long long)bloom.size() * 64ULL) - 1ULL;
+	unsigned long long b = h;
+
+	for (unsigned int i=0;i < Castus4publicScheduleRefIndex_hashes;i++,b += step) {
+		if (!(bloom[(size_t)((b & mask) >> 6)] & (1ULL << (b & 63ULL))))
+			return false;
+	}
+
+	return true;
+}
+
+bool Castus4publicScheduleRefIndex::referenced(const std::string &path) const {
+	const std::string media_path = canonical(path);
+
+	if (!bloom_test(media_path)) return false;
+	return by_media.find(media_path) != by_media.end();
+}
+
+void Castus4publicScheduleRefIndex::index_schedule(const std::string &schedule_path,const schedule_refs &s) {
+	for (std::map<std::string,media_refs>::const_iterator i=s.media.begin();i!=s.media.end();i++) {
+		std::unordered_map<std::string,std::vector<std::string> >::iterator m = by_media.find(i->first);
+
+		if (m == by_media.end()) {
+			by_media[i->first].push_back(schedule_path);
+			bloom_add(i->first);
+		}
+		else {
+			std::vector<std::string>::iterator p = std::lower_bound(m->second.begin(),m->second.end(),schedule_path);
+			if (p == m->second.end() || *p != schedule_path) m->second.insert(p,schedule_path);
+		}
+	}
+
+	if (by_media.size() * Castus4publicScheduleRefIndex_bits_per_media > bloom.size() * 64)
+		bloom_rebuild();
+}
+
+void Castus4publicScheduleRefIndex::unindex_schedule(const std::string &schedule_path,const schedule_refs &s) {
+	for (std::map<std::string,media_refs>::const_iterator i=s.media.begin();i!=s.media.end();i++) {
+		std::unordered_map<std::string,std::vector<std::string> >::iterator m = by_media.find(i->first);
+
+		if (m == by_media.end()) continue;
+
+		std::vector<std::string>::iterator p = std::lower_bound(m->second.begin(),m->second.end(),schedule_path);
+		if (p != m->second.end() && *p == schedule_path) m->second.erase(p);
+
+		if (m->second.empty()) {
+			by_media.erase(m);
+			bloom_removed++;
+		}
+	}
+
+	/* stale bits only cost false positives, until there are as many of them as live ones */
+	if (bloom_removed > Castus4publicScheduleRefIndex_min_bits / Castus4publicScheduleRefIndex_bits_per_media && bloom_removed > by_media.size())
+		bloom_rebuild();
+}
+
+void Castus4publicScheduleRefIndex::remove(const std::string &path) {
+	const std::string schedule_path = canonical(path);
+	std::map<std::string,schedule_refs>::iterator i = schedules.find(schedule_path);
+
+	if (i == schedules.end()) return;
+
+	unindex_schedule(schedule_path,i->second);
+	schedules.erase(i);
+	dirty = true;
+}
+
+bool Castus4publicScheduleRefIndex::update(const std::string &path) {
+	const std::string schedule_path = canonical(path);
+	std::map<std::string,std::string> resolved;	// item path as written to canonical, one realpath() each
+	Castus4publicSchedule schedule;
+	schedule_refs n;
+	struct stat st;
+
+	/* stat before reading: if the file changes in between, the next update() sees a new stamp */
+	if (stat(schedule_path.c_str(),&st) || !S_ISREG(st.st_mode)) {
+		remove(schedule_path);
+		return false;
+	}
+	n.st.from_stat(st);
+
+	std::map<std::string,schedule_refs>::iterator i = schedules.find(schedule_path);
+	if (i != schedules.end() && i->second.st == n.st)
+		return true;
+
+	if (!Castus4publicScheduleHelpers::load(schedule,schedule_path)) {
+		remove(schedule_path);
+		return false;
+	}
+
+	n.schedule_type = schedule.schedule_type;
+	if (schedule.interval_length > 0)
+		n.length = (ideal_time_t)schedule.interval_length * (ideal_time_t)Castus4publicSchedule::ideal_hour_per_day *
+			(ideal_time_t)Castus4publicSchedule::ideal_min_per_hour * (ideal_time_t)Castus4publicSchedule::ideal_sec_per_min *
+			(ideal_time_t)Castus4publicSchedule::ideal_microsec_per_sec;
+
+	for (std::list<Castus4publicSchedule::ScheduleItem>::const_iterator j=schedule.schedule_items.begin();j!=schedule.schedule_items.end();j++) {
+		const char *p = j->getItem();
+
+		if (p == NULL || *p == 0) continue;
+
+		std::map<std::string,std::string>::iterator c = resolved.find(p);
+		if (c == resolved.end()) c = resolved.insert(std::pair<std::string,std::string>(p,canonical(p))).first;
+
+		media_refs &r = n.media[c->second];
+		const ideal_time_t t = j->getStartTime();
+
+		r.count++;
+		if (t != Castus4publicSchedule::ideal_time_t_invalid) r.starts.push_back(t);
+	}
+
+	for (std::map<std::string,media_refs>::iterator j=n.media.begin();j!=n.media.end();j++)
+		std::sort(j->second.starts.begin(),j->second.starts.end());
+
+	if (i != schedules.end()) {
+		unindex_schedule(schedule_path,i->second);
+		std::swap(i->second,n);
+	}
+	else {
+		i = schedules.insert(std::pair<std::string,schedule_refs>(schedule_path,schedule_refs())).first;
+		std::swap(i->second,n);
+	}
+
+	index_schedule(schedule_path,i->second);
+	dirty = true;
+	return true;
+}
+
+bool Castus4publicScheduleRefIndex::update_all(const std::vector<std::string> &schedule_paths) {
+	std::vector<std::string> keep,gone;
+	bool ok = true;
+
+	keep.reserve(schedule_paths.size());
+	for (size_t i=0;i < schedule_paths.size();i++)
+		keep.push_back(canonical(schedule_paths[i]));
+	std::sort(keep.begin(),keep.end());
+	for (std::map<std::string,schedule_refs>::iterator i=schedules.begin();i!=schedules.end();i++) {
+		if (!std::binary_search(keep.begin(),keep.end(),i->first))
+			gone.push_back(i->first);
+	}
+	for (size_t i=0;i < gone.size();i++)
+		remove(gone[i]);
+
+	for (size_t i=0;i < keep.size();i++) {
+		if (!update(keep[i])) ok = false;
+	}
+
+	return ok;
+}
+
+static const Castus4publicSchedule::ideal_time_t Castus4publicScheduleRefIndex_day =
+	(Castus4publicSchedule::ideal_time_t)Castus4publicSchedule::ideal_hour_per_day * (Castus4publicSchedule::ideal_time_t)Castus4publicSchedule::ideal_min_per_hour *
+	(Castus4publicSchedule::ideal_time_t)Castus4publicSchedule::ideal_sec_per_min * (Castus4publicSchedule::ideal_time_t)Castus4publicSchedule::ideal_microsec_per_sec;
+
+static int Castus4publicScheduleRefIndex_days_in_month(const struct tm &tm) {
+	static const int days[12] = { 31,28,31,30,31,30,31,31,30,31,30,31 };
+	const int year = tm.tm_year + 1900;
+
+	if (tm.tm_mon == 1 && (year % 4) == 0 && ((year % 100) != 0 || (year % 400) == 0)) return 29;
+	return days[tm.tm_mon % 12];
+}
+
+size_t Castus4publicScheduleRefIndex::lookup(const std::string &path,std::vector<Reference> &out,time_t now) const {
+	const std::string media_path = canonical(path);
+	struct tm tm;
+
+	out.clear();
+	if (!bloom_test(media_path)) return 0;
+
+	std::unordered_map<std::string,std::vector<std::string> >::const_iterator m = by_media.find(media_path);
+	if (m == by_media.end()) return 0;
+
+	if (now == 0) now = time(NULL);
+	localtime_r(&now,&tm);
+
+	for (size_t i=0;i < m->second.size();i++) {
+		std::map<std::string,schedule_refs>::const_iterator s = schedules.find(m->second[i]);
+		assert(s != schedules.end());
+		std::map<std::string,media_refs>::const_iterator r = s->second.media.find(media_path);
+		assert(r != s->second.media.end());
+		Reference ref;
+
+		ref.schedule = s->first;
+		ref.count = r->second.count;
+		ref.until = Castus4publicSchedule::ideal_time_t_invalid;
+
+		/* now, as a time within this schedule's interval. A monthly schedule can only be followed
+		 * to the end of this month; yearly and interval ones not at all */
+		const int type = s->second.schedule_type;
+		if (type != C4_SCHED_TYPE_DAILY && type != C4_SCHED_TYPE_WEEKLY && type != C4_SCHED_TYPE_MONTHLY) {
+			out.push_back(ref);
+			continue;
+		}
+
+		ideal_time_t t = Castus4publicSchedule::time_tm_to_ideal_time(tm,0,type);
+		if (type != C4_SCHED_TYPE_MONTHLY && s->second.length > 0) t %= s->second.length;
+
+		const std::vector<ideal_time_t> &starts = r->second.starts;
+		std::vector<ideal_time_t>::const_iterator n = std::lower_bound(starts.begin(),starts.end(),t);
+		if (n != starts.end() && type == C4_SCHED_TYPE_MONTHLY) {
+			/* an airing on a day this month does not have (the 31st in April) is not next */
+			if (*n / Castus4publicScheduleRefIndex_day < (ideal_time_t)Castus4publicScheduleRefIndex_days_in_month(tm))
+				ref.until = *n - t;
+		}
+		else if (n != starts.end())
+			ref.until = *n - t;
+		else if (!starts.empty() && type != C4_SCHED_TYPE_MONTHLY && s->second.length > 0)
+			ref.until = (starts.front() + s->second.length) - t; /* the next time around */
+
+		out.push_back(ref);
+	}
+
+	return out.size();
+}
+
+/* fields are tab separated; tabs, newlines and backslashes within them are escaped */
+static void Castus4publicScheduleRefIndex_put(std::string &out,const std::string &s) {
+	for (size_t i=0;i < s.length();i++) {
+		const char c = s[i];
+
+		if (c == '\\') out += "\\\\";
+		else if (c == '\n') out += "\\n";
+		else if (c == '\t') out += "\\t";
+		else out += c;
+	}
+}
+
+static void Castus4publicScheduleRefIndex_fields(const char *line,std::vector<std::string> &f) {
+	f.clear();
+	f.push_back(std::string());
+
+	for (;*line != 0;line++) {
+		if (*line == '\t') {
+			f.push_back(std::string());
+		}
+		else if (*line == '\\' && line[1] != 0) {
+			line++;
+			f.back() += *line == 'n' ? '\n' : (*line == 't' ? '\t' : *line);
+		}
+		else {
+			f.back() += *line;
+		}
+	}
+}
+
+/*
+ * castus4-refindex 2
+ * schedule <path> <dev> <ino> <mtime sec> <mtime nsec> <size> <schedule type> <length us>
+ * media <media path> <item count> <start us>...    (one per media file the schedule above plays)
+ */
+bool Castus4publicScheduleRefIndex::load(const char *path) {
+	std::vector<std::string> f;
+	schedule_refs *cur = NULL;
+	std::string line;
+	char tmp[4096];
+	bool ok = true;
+	FILE *fp;
+
+	clear();
+	if (path == NULL) return false;
+
+	/* a planted index could hide the references checked before deleting media, so only take one
+	 * that nobody else could have written: ours, not writable by group or other, and not through
+	 * a symlink */
+	{
+		struct stat st;
+		int fd;
+
+		fd = open(path,O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+		if (fd < 0) return false;
+
+		if (fstat(fd,&st) || !S_ISREG(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0 ||
+			(fp = fdopen(fd,"r")) == NULL) {
+			close(fd);
+			return false;
+		}
+	}
+
+	if (fgets(tmp,sizeof(tmp),fp) == NULL || (castus4public_chomp(tmp),strcmp(tmp,Castus4publicScheduleRefIndex_magic))) {
+		fclose(fp);
+		return false;
+	}
+
+	while (ok) {
+		/* lines can be longer than the buffer */
+		line.clear();
+		while (fgets(tmp,sizeof(tmp),fp) != NULL) {
+			line += tmp;
+			if (!line.empty() && line[line.length()-1] == '\n') break;
+		}
+		if (line.empty()) break;
+		if (line[line.length()-1] != '\n') {
+			ok = false;	/* truncated */
+			break;
+		}
+		line.resize(line.length()-1);
+
+		Castus4publicScheduleRefIndex_fields(line.c_str(),f);
+		if (f[0] == "schedule" && f.size() == 9) {
+			cur = &schedules[f[1]];
+			cur->st.dev = strtoull(f[2].c_str(),NULL,10);
+			cur->st.ino = strtoull(f[3].c_str(),NULL,10);
+			cur->st.mtime_sec = strtoll(f[4].c_str(),NULL,10);
+			cur->st.mtime_nsec = strtol(f[5].c_str(),NULL,10);
+			cur->st.size = strtoll(f[6].c_str(),NULL,10);
+			cur->schedule_type = atoi(f[7].c_str());
+			cur->length = (ideal_time_t)strtoll(f[8].c_str(),NULL,10);
+		}
+		else if (f[0] == "media" && f.size() >= 3 && cur != NULL) {
+			media_refs &r = cur->media[f[1]];
+
+			r.count = (size_t)strtoull(f[2].c_str(),NULL,10);
+			for (size_t i=3;i < f.size();i++)
+				r.starts.push_back((ideal_time_t)strtoll(f[i].c_str(),NULL,10));
+			std::sort(r.starts.begin(),r.starts.end());
+		}
+		else {
+			ok = false;
+		}
+	}
+
+	fclose(fp);
+
+	if (ok) {
+		for (std::map<std::string,schedule_refs>::iterator i=schedules.begin();i!=schedules.end();i++)
+			index_schedule(i->first,i->second);
+		bloom_rebuild();
+	}
+	else {
+		clear();
+	}
+
+	dirty = false;
+	return ok;
+}
+
+bool Castus4publicScheduleRefIndex::save(const char *path) {
+	std::string out,tmp_path;
+	char tmp[192];
+	FILE *fp;
+
+	if (path == NULL) return false;
+
+	out = Castus4publicScheduleRefIndex_magic;
+	out += "\n";
+
+	for (std::map<std::string,schedule_refs>::iterator i=schedules.begin();i!=schedules.end();i++) {
+		const schedule_refs &s = i->second;
+
+		out += "schedule\t";
+		Castus4publicScheduleRefIndex_put(out,i->first);
+		sprintf(tmp,"\t%llu\t%llu\t%lld\t%ld\t%lld\t%d\t%lld\n",s.st.dev,s.st.ino,s.st.mtime_sec,s.st.mtime_nsec,s.st.size,
+			s.schedule_type,(signed long long)s.length);
+		out += tmp;
+
+		for (std::map<std::string,media_refs>::const_iterator j=s.media.begin();j!=s.media.end();j++) {
+			out += "media\t";
+			Castus4publicScheduleRefIndex_put(out,j->first);
+			sprintf(tmp,"\t%llu",(unsigned long long)j->second.count);
+			out += tmp;
+			for (size_t k=0;k < j->second.starts.size();k++) {
+				sprintf(tmp,"\t%lld",(signed long long)j->second.starts[k]);
+				out += tmp;
+			}
+			out += "\n";
+		}
+	}
+
+	/* write beside the target and rename over it, so the old index stays whole until then. The
+	 * temporary file gets a name nobody can guess ahead, created 0600 by mkstemp() */
+	{
+		std::vector<char> name(strlen(path) + 8);
+		int fd;
+
+		sprintf(&name[0],"%s.XXXXXX",path);
+		fd = mkstemp(&name[0]);
+		if (fd < 0) return false;
+
+		tmp_path = &name[0];
+		fp = fdopen(fd,"w");
+		if (fp == NULL) {
+			close(fd);
+			unlink(tmp_path.c_str());
+			return false;
+		}
+	}
+
+	if (fwrite(out.data(),1,out.length(),fp) != out.length() || fflush(fp) || fsync(fileno(fp))) {
+		fclose(fp);
+		unlink(tmp_path.c_str());
+		return false;
+	}
+
+	if (fclose(fp) || rename(tmp_path.c_str(),path)) {
+		unlink(tmp_path.c_str());
+		return false;
+	}
+
+	dirty = false;
+	return true;
+}
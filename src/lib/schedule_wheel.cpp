@@ -0,0 +1,310 @@
+
+#include <sys/types.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <castus4-public/schedule.h>
+#include <castus4-public/schedule_object.h>
+#include <castus4-public/schedule_wheel.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+
+Castus4publicScheduleTimingWheel::Castus4publicScheduleTimingWheel(const ideal_time_t res) : resolution(res > 0 ? res : 1), current(0), overflow(NULL) {
+	memset(slot,0,sizeof(slot));
+	memset(count,0,sizeof(count));
+}
+
+Castus4publicScheduleTimingWheel::~Castus4publicScheduleTimingWheel() {
+	reset();
+}
+
+void Castus4publicScheduleTimingWheel::reset(const ideal_time_t now) {
+	for (std::map<std::string,Event*>::iterator i=events.begin();i!=events.end();i++)
+		delete i->second;
+
+	events.clear();
+	memset(slot,0,sizeof(slot));
+	memset(count,0,sizeof(count));
+	overflow = NULL;
+	current = to_tick(now);
+}
+
+size_t Castus4publicScheduleTimingWheel::size() const {
+	return events.size();
+}
+
+unsigned long long Castus4publicScheduleTimingWheel::to_tick(const ideal_time_t t) const {
+	if (t <= 0) return 0;
+	return (unsigned long long)(t / resolution);
+}
+
+/* The level is picked by how far away the event is, the slot by the event's own tick bits at
+ * that level, so the slot comes up for cascading exactly when the event is within reach of the
+ * level below */
+void Castus4publicScheduleTimingWheel::link(Event *ev) {
+	unsigned long long tick = ev->tick < current ? current : ev->tick;
+	unsigned long long delta = tick - current;
+	unsigned int level = 0;
+
+	while (level < levels && (delta >> (level_bits * (level + 1))) != 0ULL) level++;
+
+	if (level < levels)
+		ev->head = &slot[level][(tick >> (level_bits * level)) & (level_slots - 1)];
+	else
+		ev->head = &overflow;
+
+	ev->level = level;
+	ev->prev = NULL;
+	ev->next = *(ev->head);
+	if (ev->next != NULL) ev->next->prev = ev;
+	*(ev->head) = ev;
+	count[level]++;
+}
+
+void Castus4publicScheduleTimingWheel::unlink(Event *ev) {
+	if (ev->prev != NULL) ev->prev->next = ev->next;
+	else *(ev->head) = ev->next;
+	if (ev->next != NULL) ev->next->prev = ev->prev;
+
+	assert(count[ev->level] != 0);
+	count[ev->level]--;
+	ev->prev = ev->next = NULL;
+	ev->head = NULL;
+}
+
+void Castus4publicScheduleTimingWheel::destroy(Event *ev) {
+	unlink(ev);
+	events.erase(ev->key);
+	delete ev;
+}
+
+/* re-link every event of the slot that just came up at this level (or the overflow list) */
+void Castus4publicScheduleTimingWheel::cascade(const unsigned int level) {
+	Event **head = level < levels ? &slot[level][(current >> (level_bits * level)) & (level_slots - 1)] : &overflow;
+	Event *ev = *head;
+
+	*head = NULL;
+	while (ev != NULL) {
+		Event *next = ev->next;
+		assert(count[level] != 0);
+		count[level]--;
+		link(ev);
+		ev = next;
+	}
+}
+
+void Castus4publicScheduleTimingWheel::add(const std::string &key,const ideal_time_t t,const enum event_type type,
+	const Castus4publicSchedule::ScheduleItem *item,const Castus4publicSchedule::ScheduleBlock *block) {
+	Event *ev = new Event();
+
+	ev->time = t;
+	ev->type = type;
+	ev->item = item;
+	ev->block = block;
+	ev->tick = to_tick(t);
+	ev->key = events.insert(std::pair<std::string,Event*>(key,ev)).first;
+	link(ev);
+}
+
+class Castus4publicScheduleTimingWheelPending {
+public:
+	Castus4publicSchedule::ideal_time_t			time;
+	enum Castus4publicScheduleTimingWheel::event_type	type;
+	const Castus4publicSchedule::ScheduleItem*		item;
+	const Castus4publicSchedule::ScheduleBlock*		block;
+public:
+	/* identity of an event: when, what kind, and the full content of the record */
+	static std::string key(const Castus4publicSchedule::ideal_time_t t,const int type,const char src,const std::map<std::string,std::string> &entry) {
+		std::string r;
+		char tmp[48];
+
+		sprintf(tmp,"%lld:%d:%c\n",(long long)t,type,src);
+		r = tmp;
+		for (std::map<std::string,std::string>::const_iterator i=entry.begin();i!=entry.end();i++) {
+			r += i->first;
+			r += '=';
+			r += i->second;
+			r += '\n';
+		}
+
+		return r;
+	}
+	/* identical records at the same time are told apart by occurrence */
+	static void insert(std::map<std::string,Castus4publicScheduleTimingWheelPending> &m,std::string k,const Castus4publicScheduleTimingWheelPending &p) {
+		if (m.find(k) != m.end()) {
+			unsigned int n = 1;
+			char tmp[24];
+
+			do {
+				sprintf(tmp,"#%u",n++);
+			} while (m.find(k + tmp) != m.end());
+
+			k += tmp;
+		}
+
+		m[k] = p;
+	}
+};
+
+bool Castus4publicScheduleTimingWheel::load(const Castus4publicSchedule &schedule,const int sources,const ideal_time_t origin) {
+	std::map<std::string,Castus4publicScheduleTimingWheelPending> want;
+	Castus4publicScheduleTimingWheelPending p;
+
+	schedule.apply_time_shifts();
+	if (sources & Items) {
+		for (std::list<Castus4publicSchedule::ScheduleItem>::const_iterator i=schedule.schedule_items.begin();i!=schedule.schedule_items.end();i++) {
+			const ideal_time_t s = i->getStartTime(),e = i->getEndTime();
+
+			p.item = &(*i);
+			p.block = NULL;
+			if (s != Castus4publicSchedule::ideal_time_t_invalid) {
+				p.time = s + origin;
+				p.type = Start;
+				Castus4publicScheduleTimingWheelPending::insert(want,Castus4publicScheduleTimingWheelPending::key(p.time,p.type,'i',i->entry),p);
+			}
+			if (e != Castus4publicSchedule::ideal_time_t_invalid) {
+				p.time = e + origin;
+				p.type = End;
+				Castus4publicScheduleTimingWheelPending::insert(want,Castus4publicScheduleTimingWheelPending::key(p.time,p.type,'i',i->entry),p);
+			}
+		}
+	}
+
+	if (sources & Blocks) {
+		for (std::list<Castus4publicSchedule::ScheduleBlock>::const_iterator i=schedule.schedule_blocks.begin();i!=schedule.schedule_blocks.end();i++) {
+			const ideal_time_t s = i->getStartTime(),e = i->getEndTime();
+
+			p.item = NULL;
+			p.block = &(*i);
+			if (s != Castus4publicSchedule::ideal_time_t_invalid) {
+				p.time = s + origin;
+				p.type = Start;
+				Castus4publicScheduleTimingWheelPending::insert(want,Castus4publicScheduleTimingWheelPending::key(p.time,p.type,'b',i->entry),p);
+			}
+			if (e != Castus4publicSchedule::ideal_time_t_invalid) {
+				p.time = e + origin;
+				p.type = End;
+				Castus4publicScheduleTimingWheelPending::insert(want,Castus4publicScheduleTimingWheelPending::key(p.time,p.type,'b',i->entry),p);
+			}
+		}
+	}
+
+	/* events no longer in the schedule come out */
+	for (std::map<std::string,Event*>::iterator i=events.begin();i!=events.end();) {
+		Event *ev = i->second;
+		i++;
+		if (want.find(ev->key->first) == want.end()) destroy(ev);
+	}
+
+	/* unchanged events stay where they are, new ones go in */
+	for (std::map<std::string,Castus4publicScheduleTimingWheelPending>::iterator i=want.begin();i!=want.end();i++) {
+		std::map<std::string,Event*>::iterator e = events.find(i->first);
+
+		if (e != events.end()) {
+			e->second->item = i->second.item;
+			e->second->block = i->second.block;
+		}
+		else if (to_tick(i->second.time) >= current) {
+			add(i->first,i->second.time,i->second.type,i->second.item,i->second.block);
+		}
+	}
+
+	return true;
+}
+
+static bool Castus4publicScheduleTimingWheel_event_order(const Castus4publicScheduleTimingWheel::Event *a,const Castus4publicScheduleTimingWheel::Event *b) {
+	if (a->time != b->time) return a->time < b->time;
+	return a->type < b->type;
+}
+
+size_t Castus4publicScheduleTimingWheel::advance(const ideal_time_t now,callback_t cb,void *opaque) {
+	const unsigned long long now_tick = to_tick(now);
+	std::vector<Event*> due;
+	size_t dispatched = 0;
+
+	if (now < 0) return 0;
+
+	while (current <= now_tick) {
+		/* higher levels first, so their events can land in the levels below */
+		for (unsigned int level=levels;level >= 1;level--) {
+			if ((current & ((1ULL << (level_bits * level)) - 1ULL)) == 0ULL)
+				cascade(level);
+		}
+
+		Event **head = &slot[0][current & (level_slots - 1)];
+		due.clear();
+		while (*head != NULL) {
+			Event *ev = *head;
+			unlink(ev);
+			events.erase(ev->key);
+			due.push_back(ev);
+		}
+
+		if (!due.empty()) {
+			std::stable_sort(due.begin(),due.end(),Castus4publicScheduleTimingWheel_event_order);
+			for (size_t i=0;i < due.size();i++) {
+				if (cb != NULL) cb(*due[i],opaque);
+				delete due[i];
+			}
+			dispatched += due.size();
+		}
+
+		/* skip ahead to the next slot that can hold anything: if the lowest levels are
+		 * empty, nothing happens until the next boundary of the first level that is not */
+		unsigned long long next = current + 1ULL;
+		if (count[0] == 0) {
+			unsigned int level = 1;
+
+			while (level < levels && count[level] == 0) level++;
+			if (level == levels && count[levels] == 0)
+				next = now_tick + 1ULL;
+			else
+				next = ((current >> (level_bits * level)) + 1ULL) << (level_bits * level);
+		}
+
+		current = std::min(next,now_tick + 1ULL);
+	}
+
+	return dispatched;
+}
+
+Castus4publicSchedule::ideal_time_t Castus4publicScheduleTimingWheel::earliest(const Event *ev,const ideal_time_t best) {
+	Castus4publicSchedule::ideal_time_t r = best;
+
+	for (;ev != NULL;ev=ev->next) {
+		if (r == Castus4publicSchedule::ideal_time_t_invalid || ev->time < r)
+			r = ev->time;
+	}
+
+	return r;
+}
+
+/* the first occupied slot of each level (in time order from the current position) holds that
+ * level's earliest events. Above level 0 the current position's own slot comes last, a full
+ * turn away, unless the position is on its boundary: an advance() that stopped there has not
+ * cascaded it yet, and it comes first. */
+Castus4publicSchedule::ideal_time_t Castus4publicScheduleTimingWheel::next_time() const {
+	ideal_time_t r = Castus4publicSchedule::ideal_time_t_invalid;
+
+	for (unsigned int level=0;level < levels;level++) {
+		if (count[level] == 0) continue;
+
+		const bool boundary = (current & ((1ULL << (level_bits * level)) - 1ULL)) == 0ULL;
+		const unsigned long long first = (current >> (level_bits * level)) + (level != 0 && !boundary ? 1ULL : 0ULL);
+		for (unsigned int i=0;i < level_slots;i++) {
+			const Event *ev = slot[level][(first + i) & (level_slots - 1)];
+			if (ev != NULL) {
+				r = earliest(ev,r);
+				break;
+			}
+		}
+	}
+
+	return earliest(overflow,r);
+}